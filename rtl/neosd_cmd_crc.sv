@@ -0,0 +1,39 @@
+module neosd_cmd_crc (
+    input clk_i,
+    input rstn_i,
+    // Strobe to obtain the slow SD clock
+    input clkstrb_i,
+
+    input clear_i,
+    input data_s_i,
+    input shift_s_i,
+    input output_s_i,
+    output data_s_o,
+    output nonzero_o
+);
+    // CRC7, x^7 + x^3 + 1. sreg[0] holds the highest order bit.
+    logic[6:0] sreg;
+    logic sreg_fb;
+
+    assign nonzero_o = |sreg;
+    assign data_s_o = sreg[0];
+    // If we're shifting out, sreg_fb should be 0 so that we don't modify stored values
+    assign sreg_fb = (data_s_i ^ sreg[0]) & ~output_s_i;
+
+    always @(posedge clk_i or negedge rstn_i) begin
+        if (rstn_i == 1'b0) begin
+            sreg <= '0;
+        end else begin
+            if (clkstrb_i == 1'b1) begin
+                if (clear_i == 1'b1) begin
+                    sreg <= '0;
+                end else if (shift_s_i == 1'b1) begin
+                    sreg[6] <= sreg_fb;
+                    sreg[5:4] <= sreg[6:5];
+                    sreg[3] <= sreg[4] ^ sreg_fb;
+                    sreg[2:0] <= sreg[3:1];
+                end
+            end
+        end
+    end
+endmodule
\ No newline at end of file
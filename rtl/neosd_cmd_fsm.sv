@@ -21,7 +21,12 @@ module neosd_cmd_fsm (
     input ctrl_resp_ack_i,
     input[1:0] ctrl_rmode_i,
     input[1:0] ctrl_dmode_i,
+    // Send the generated CRC instead of cmd_crc_i
+    input ctrl_auto_crc_i,
     output start_dat_o,
+    // One strobe after the last response CRC bit, crc_ok valid
+    output status_resp_done_o,
+    output status_resp_crc_ok_o,
 
     // If we want to have an SD card clock active
     output sd_clk_req_o,
@@ -45,6 +50,7 @@ module neosd_cmd_fsm (
 
     logic[47:0] cmd_reg_dout;
     logic cmd_reg_shift;
+    logic cmd_reg_s_o;
 
     neosd_cmd_reg sreg (
         .clk_i(clk_i),
@@ -55,7 +61,7 @@ module neosd_cmd_fsm (
         .data_p_o(cmd_reg_dout),
         .data_s_i(sd_cmd_i),
         .shift_s_i(cmd_reg_shift),
-        .data_s_o(sd_cmd_o)
+        .data_s_o(cmd_reg_s_o)
     );
 
     typedef enum logic[2:0] {STATE_IDLE, STATE_WRITE, STATE_WAIT_RESP, STATE_READ_RESP, STATE_REGOUT, STATE_TAIL} STATE;
@@ -68,6 +74,10 @@ module neosd_cmd_fsm (
         logic clk_stall;
         logic cmd_oe;
         logic start_dat;
+        // Response bits after start and transmission bit
+        logic rx;
+        logic[7:0] rx_counter;
+        logic resp_done;
     } FSM_STATE;
     FSM_STATE cmd_fsm_curr;
     FSM_STATE cmd_fsm_next;
@@ -83,10 +93,46 @@ module neosd_cmd_fsm (
     assign sd_clk_stall_o = cmd_fsm_curr.clk_stall;
     assign sd_cmd_oe = cmd_fsm_curr.cmd_oe;
     assign start_dat_o = cmd_fsm_curr.start_dat;
+    assign status_resp_done_o = cmd_fsm_curr.resp_done;
 
     // Expected response: No response, short (? bit, Rx/Ry) response, long (? bit, Rx/Ry) response
     typedef enum logic[1:0] {RESP_NONE, RESP_SHORT, RESP_LONG} RESP_MODE;
 
+    // CRC7 over the 40 command bits, then shifted out in bits 40..46.
+    // Responses: CRC7 over the bits after start and transmission bit (R1, R6, R7), or after the
+    // reserved bits (R2), followed by the received CRC. R3 has no CRC, the result is meaningless.
+    logic crc_clear, crc_shift, crc_output, crc_din, crc_dout, crc_nonzero;
+    logic resp_start, rx_shift, rx_crc;
+    logic[7:0] rx_crc_first, rx_crc_end;
+
+    assign resp_start = cmd_fsm_curr.state == STATE_WAIT_RESP && cmd_reg_dout[1:0] == 2'b00;
+    assign rx_shift = cmd_reg_shift && (cmd_fsm_curr.rx || resp_start);
+    assign rx_crc_first = ctrl_rmode_i == RESP_LONG ? 8'd6 : 8'd0;
+    assign rx_crc_end = ctrl_rmode_i == RESP_LONG ? 8'd133 : 8'd45;
+    assign rx_crc = cmd_fsm_curr.rx_counter >= rx_crc_first && cmd_fsm_curr.rx_counter < rx_crc_end;
+
+    assign crc_clear = cmd_fsm_curr.state == STATE_IDLE || (cmd_fsm_curr.state == STATE_WAIT_RESP && !resp_start);
+    assign crc_output = cmd_fsm_curr.state == STATE_WRITE && cmd_fsm_curr.bit_counter >= 40;
+    assign crc_din = cmd_fsm_curr.state == STATE_WRITE ? cmd_reg_s_o : sd_cmd_i;
+    assign crc_shift = cmd_fsm_curr.state == STATE_WRITE ?
+        cmd_reg_shift && cmd_fsm_curr.bit_counter < 47 : rx_shift && rx_crc;
+    assign status_resp_crc_ok_o = !crc_nonzero;
+
+    neosd_cmd_crc crc (
+        .clk_i(clk_i),
+        .rstn_i(rstn_i),
+        .clkstrb_i(clkstrb_i),
+        .clear_i(crc_clear),
+        .data_s_i(crc_din),
+        .shift_s_i(crc_shift),
+        .output_s_i(crc_output),
+        .data_s_o(crc_dout),
+        .nonzero_o(crc_nonzero)
+    );
+
+    assign sd_cmd_o = (ctrl_auto_crc_i && cmd_fsm_curr.state == STATE_WRITE &&
+        cmd_fsm_curr.bit_counter >= 40 && cmd_fsm_curr.bit_counter < 47) ? crc_dout : cmd_reg_s_o;
+
     always @(posedge clk_i or negedge rstn_i) begin
         if (rstn_i == 1'b0) begin
             cmd_fsm_curr <= '0;
@@ -96,6 +142,17 @@ module neosd_cmd_fsm (
                 cmd_fsm_next = cmd_fsm_curr;
                 // Resets after one cycle, one-shot signal
                 cmd_fsm_next.start_dat = 0;
+                cmd_fsm_next.resp_done = 0;
+
+                // Count response bits up to the end bit
+                if (resp_start)
+                    cmd_fsm_next.rx = 1'b1;
+                if (rx_shift && cmd_fsm_curr.rx_counter != rx_crc_end) begin
+                    cmd_fsm_next.rx_counter = cmd_fsm_curr.rx_counter + 1;
+                    if (cmd_fsm_curr.rx_counter == rx_crc_end - 1)
+                        cmd_fsm_next.resp_done = 1'b1;
+                end
+
                 case (cmd_fsm_curr.state)
                     STATE_IDLE: begin
                         if (ctrl_start_i == 1'b1) begin
@@ -103,6 +160,8 @@ module neosd_cmd_fsm (
                             cmd_fsm_next.bit_counter = 0;
                             cmd_fsm_next.cmd_oe = 1'b1;
                             cmd_fsm_next.clk_req = 1'b1;
+                            cmd_fsm_next.rx = 1'b0;
+                            cmd_fsm_next.rx_counter = 0;
                         end
                     end
                     STATE_WRITE: begin
@@ -0,0 +1,56 @@
+module neosd_dat_fifo #(
+    // 2 ** DEPTH_LOG2 words
+    parameter DEPTH_LOG2 = 4
+) (
+    input clk_i,
+    input rstn_i,
+
+    // Drop all words
+    input clear_i,
+    input push_i,
+    input[31:0] data_i,
+    input pop_i,
+    // First word, valid if not empty
+    output[31:0] data_o,
+
+    output[DEPTH_LOG2:0] level_o,
+    output empty_o,
+    output full_o
+);
+    // No reset, so that FPGA tools can map this to distributed RAM. The read is asynchronous on
+    // purpose: the first word is on data_o without a cycle of latency, so DATA reads and the data
+    // FSM pop one word per cycle without a prefetch stage. The default 16 words are far below a
+    // block RAM (2 KiB on Gowin), distributed RAM is the better fit there. Depths up to a full
+    // block still map to distributed RAM or flip-flops, not block RAM. The ASIC flow uses
+    // flip-flops in any case.
+    logic[31:0] mem[2**DEPTH_LOG2];
+    // One more bit than needed for the address to tell full from empty
+    logic[DEPTH_LOG2:0] wr_ptr, rd_ptr;
+
+    assign level_o = wr_ptr - rd_ptr;
+    assign empty_o = wr_ptr == rd_ptr;
+    assign full_o = level_o[DEPTH_LOG2] == 1'b1;
+    assign data_o = mem[rd_ptr[DEPTH_LOG2-1:0]];
+
+    always @(posedge clk_i) begin
+        if (push_i == 1'b1 && full_o == 1'b0)
+            mem[wr_ptr[DEPTH_LOG2-1:0]] <= data_i;
+    end
+
+    always @(posedge clk_i or negedge rstn_i) begin
+        if (rstn_i == 1'b0) begin
+            wr_ptr <= '0;
+            rd_ptr <= '0;
+        end else begin
+            if (clear_i == 1'b1) begin
+                wr_ptr <= '0;
+                rd_ptr <= '0;
+            end else begin
+                if (push_i == 1'b1 && full_o == 1'b0)
+                    wr_ptr <= wr_ptr + 1;
+                if (pop_i == 1'b1 && empty_o == 1'b0)
+                    rd_ptr <= rd_ptr + 1;
+            end
+        end
+    end
+endmodule
\ No newline at end of file
@@ -15,11 +15,21 @@ module neosd_dat_fsm (
     output status_data_o,
     output status_block_done_o,
     output status_crc_ok_o,
+    // Read: Direction of the word in dat_o / dat_i
+    output status_rnw_o,
+    // FIFO mode, read: The word completed at the last strobe is in dat_o until the next strobe
+    output status_word_o,
+    // FIFO mode, write: The next word is loaded into the register at this strobe
+    output status_word_load_o,
     input ctrl_start_i,
     input ctrl_dat_ack_i,
     input ctrl_last_block_i,
     input[1:0] ctrl_dmode_i,
     input ctrl_d4_i,
+    // FIFO mode: Words are moved without stalling the clock while ctrl_fifo_ready_i is set,
+    // which means room for a word when reading and a word available when writing
+    input ctrl_fifo_i,
+    input ctrl_fifo_ready_i,
 
     // If we want to have an SD card clock active
     output sd_clk_req_o,
@@ -91,6 +101,7 @@ module neosd_dat_fsm (
         logic[1:0] block_ctrl_omux;
         logic crc_ok, block_done;
         logic write_start;
+        logic word;
     } FSM_STATE;
     FSM_STATE dat_fsm_curr;
     FSM_STATE dat_fsm_next;
@@ -116,6 +127,13 @@ module neosd_dat_fsm (
 
     assign status_crc_ok_o = dat_fsm_curr.crc_ok;
     assign status_block_done_o = dat_fsm_curr.block_done;
+    assign status_rnw_o = dat_fsm_curr.block_ctrl_rnw;
+    assign status_word_o = dat_fsm_curr.word;
+
+    logic word_last;
+    assign word_last = dat_fsm_curr.bit_counter == (ctrl_d4_i == 1'b1 ? 7 : 31);
+    assign status_word_load_o = ctrl_fifo_i && ctrl_fifo_ready_i && sd_clk_en_i && word_last &&
+        dat_fsm_curr.state == STATE_WRITE_DATA && dat_fsm_curr.word_counter != 1;
 
     assign block_shift_s = sd_clk_en_i && dat_fsm_curr.block_shift_s;
 
@@ -137,8 +155,9 @@ module neosd_dat_fsm (
             if (clkstrb_i == 1'b1) begin
                 // State transition logic
                 dat_fsm_next = dat_fsm_curr;
-                // Strobe signal
+                // Strobe signals
                 dat_fsm_next.block_done = 1'b0;
+                dat_fsm_next.word = 1'b0;
 
                 case (dat_fsm_curr.state)
                     STATE_IDLE: begin
@@ -184,11 +203,19 @@ module neosd_dat_fsm (
                     STATE_READ_BLOCK: begin
                         // Only count, if not stalled
                         if (sd_clk_en_i == 1'b1) begin
-                            if (dat_fsm_curr.bit_counter == (ctrl_d4_i == 1'b1 ? 7 : 31)) begin
+                            if (word_last == 1'b1) begin
                                 dat_fsm_next.bit_counter = 0;
                                 dat_fsm_next.word_counter = dat_fsm_curr.word_counter - 1;
-                                dat_fsm_next.clk_stall = 1;
-                                dat_fsm_next.state = STATE_REGOUT;
+                                if (ctrl_fifo_i == 1'b1 && ctrl_fifo_ready_i == 1'b1) begin
+                                    // The FIFO takes the word at the next strobe, before the first
+                                    // bit of the next word is shifted in. No need to stall.
+                                    dat_fsm_next.word = 1'b1;
+                                    if (dat_fsm_curr.word_counter == 1)
+                                        dat_fsm_next.state = STATE_READ_CRC;
+                                end else begin
+                                    dat_fsm_next.clk_stall = 1;
+                                    dat_fsm_next.state = STATE_REGOUT;
+                                end
                             end else begin
                                 dat_fsm_next.bit_counter = dat_fsm_curr.bit_counter + 1;
                             end
@@ -279,13 +306,15 @@ module neosd_dat_fsm (
                     STATE_WRITE_DATA: begin
                         // Only count, if not stalled
                         if (sd_clk_en_i == 1'b1) begin
-                            if (dat_fsm_curr.bit_counter == (ctrl_d4_i == 1'b1 ? 7 : 31)) begin
+                            if (word_last == 1'b1) begin
                                 dat_fsm_next.bit_counter = 0;
                                 dat_fsm_next.word_counter = dat_fsm_curr.word_counter - 1;
                                 if (dat_fsm_curr.word_counter == 1) begin
                                     dat_fsm_next.block_ctrl_omux = 2'b11;
                                     dat_fsm_next.block_ctrl_output_crc = 1'b1;
                                     dat_fsm_next.state = STATE_WRITE_CRC;
+                                end else if (status_word_load_o == 1'b1) begin
+                                    // Loaded from the FIFO instead of shifting, keep going
                                 end else begin
                                     dat_fsm_next.clk_stall = 1;
                                     dat_fsm_next.state = STATE_WRITE_REGIN;
@@ -361,8 +390,11 @@ module neosd_dat_fsm (
                 endcase
 
                 // Abort
+                // A busy wait is never aborted: CMD12 is committed with the abort bit and
+                // the bit stays set while the data FSM waits for the R1b busy of that CMD12.
                 if (dat_fsm_curr.state != STATE_IDLE &&
                     dat_fsm_curr.state != STATE_TAIL &&
+                    dat_fsm_curr.state != STATE_WAIT_BUSY &&
                     ctrl_last_block_i == 1'b1) begin
                     
                     dat_fsm_next.block_ctrl_rstn_crc = 1'b0;
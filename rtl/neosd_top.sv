@@ -1,4 +1,7 @@
-module neosd (
+module neosd #(
+    // Data FIFO with 2 ** FIFO_DEPTH_LOG2 words, FIFO_DEPTH_LOG2 >= 1
+    parameter FIFO_DEPTH_LOG2 = 4
+) (
     input clk_i,
     input rstn_i,
 
@@ -30,21 +33,53 @@ module neosd (
     localparam ADDR_CMD = 8'h0C;
     localparam ADDR_RESP = 8'h10;
     localparam ADDR_DATA = 8'h14;
+    localparam ADDR_STATUS = 8'h18;
+    localparam ADDR_FLAGS = 8'h1C;
+    localparam ADDR_BLKCNT = 8'h20;
+    localparam ADDR_FIFO = 8'h24;
 
     // Control and status register
-    logic CTRL_RST, CTRL_D4, CTRL_IDLE_SDCLK;
+    logic CTRL_RST, CTRL_D4, CTRL_FIFO, CTRL_IDLE_SDCLK;
     logic[2:0] CTRL_CLK_PRSC;
     logic[3:0] CTRL_CLK_DIV;
     logic CTRL_CLK_HS;
-    logic CTRL_STAT_CRCERR;
+    logic CTRL_STAT_CRCERR, CTRL_STAT_RESP_CRCERR;
     logic CTRL_FLAG_CMD_RESP, CTRL_FLAG_DAT_DATA, CTRL_FLAG_CMD_DONE, CTRL_FLAG_DAT_DONE, CTRL_FLAG_BLK_DONE;
     logic CTRL_MASK_CMD_RESP, CTRL_MASK_DAT_DATA, CTRL_MASK_CMD_DONE, CTRL_MASK_DAT_DONE, CTRL_MASK_BLK_DONE;
 
     // Command register
-    logic CMD_COMMIT, CMD_ABRT_DAT;
+    logic CMD_COMMIT, CMD_ABRT_DAT, CMD_AUTO_CRC;
     logic[1:0] CMD_DMODE;
     logic[1:0] CMD_RMODE;
 
+    // Block counter: Blocks left in the transfer, then stop it. Optionally sends CMD12.
+    logic[23:0] BLKCNT_COUNT;
+    logic BLKCNT_AUTO_CMD12;
+    logic autostop_pend, autostop_issue;
+    // The CMD registers hold the CMD12 until the command FSM takes it. A CMD write replaces it and
+    // autostop_pend stays set, so the CMD12 follows the command of the CPU.
+    logic autostop_cmd;
+    // CMDARG or CMD written by the CPU in this cycle, CMDARG written and CMD not yet
+    logic cmd_wr, cmdarg_pend;
+    // Stop without CMD12. Unlike CMD_ABRT_DAT, a dataless command committed meanwhile keeps it.
+    logic blkcnt_abrt;
+
+    // Data FIFO: DATA accesses go through the FIFO if CTRL_FIFO is set
+    logic[15:0] FIFO_WM;
+    logic FIFO_FLAG_DATA;
+    // CTRL_FLAG_DAT_DATA or FIFO_FLAG_DATA, depending on the mode
+    logic flag_dat_data;
+    logic[15:0] fifo_wm;
+    logic[FIFO_DEPTH_LOG2:0] fifo_level, fifo_room;
+    logic[31:0] fifo_dout, fifo_din;
+    logic fifo_clear, fifo_push, fifo_pop, fifo_load, fifo_empty, fifo_full;
+    // Direction of the current transfer, latched when the data command is committed, so that CMD12
+    // or a dataless command during the transfer don't change it. Also selects R1b for the automatic
+    // CMD12. And if the data FSM can move a word without stalling.
+    logic fifo_write, fifo_ready;
+    logic dat_rnw, dat_word, dat_word_load;
+    logic[31:0] dat_data_o;
+
     // Wishbone code based on https://zipcpu.com/zipcpu/2017/05/29/simple-wishbone.html
     logic wb_stall_o;
 
@@ -55,17 +90,39 @@ module neosd (
     logic status_idle_dat, status_data_dat;
     logic status_idle_dat_last, status_data_dat_last;
     logic status_block_done, status_crc_ok;
+    logic status_resp_done, status_resp_crc_ok;
+
+    // Write-1-to-clear mask of a FLAGS write in this cycle. For software written for 0.2.0 and
+    // older, a CTRL write still clears the error and flag bits written as 0. Bits written as 1
+    // are kept (0.2.0 set them), so a CTRL write with all of them set changes no flag.
+    logic[31:0] flags_clr;
+    always_comb begin
+        flags_clr = '0;
+        if (wb_stb_i && wb_we_i && !wb_stall_o && wb_adr_i[7:0] == ADDR_FLAGS)
+            flags_clr = wb_dat_i;
+        if (wb_stb_i && wb_we_i && !wb_stall_o && wb_adr_i[7:0] == ADDR_CTRL)
+            flags_clr = ~wb_dat_i;
+    end
+
+    // Send the pending CMD12 once the command FSM is idle and CMD_DONE of the previous command was
+    // acknowledged, so its response can't be mistaken for the one of the previous command. A
+    // command of the CPU goes first once its CMDARG is written, committed or not.
+    assign cmd_wr = wb_stb_i && wb_we_i && !wb_stall_o &&
+        (wb_adr_i[7:0] == ADDR_CMD || wb_adr_i[7:0] == ADDR_CMDARG);
+    assign autostop_issue = autostop_pend && !autostop_cmd && !CMD_COMMIT && !cmd_wr && !cmdarg_pend &&
+        status_idle_cmd && status_idle_cmd_last && !CTRL_FLAG_CMD_DONE;
 
 
     // CTRL_FLAG_DAT_DATA gets cleared on read and write, so it get's its own block
     always @(posedge clk_i or negedge rstn_i) begin
         if (rstn_i == 1'b0) begin
             CTRL_FLAG_DAT_DATA <= 1'b0;
+            FIFO_FLAG_DATA <= 1'b0;
             status_data_dat_last <= 1'b0;
         end else begin
             // DAT DATA IRQ is edge triggered
             status_data_dat_last <= status_data_dat;
-            if (status_data_dat == 1'b1 && status_data_dat_last == 1'b0)
+            if (status_data_dat == 1'b1 && status_data_dat_last == 1'b0 && CTRL_FIFO == 1'b0)
                 CTRL_FLAG_DAT_DATA <= 1'b1;
 
             if (wb_stb_i && (!wb_we_i || !wb_stall_o)) begin
@@ -73,19 +130,82 @@ module neosd (
                     CTRL_FLAG_DAT_DATA <= 1'b0;
                 end;
             end
+
+            // FIFO mode: Level triggered, at least watermark words to read or free words to write
+            FIFO_FLAG_DATA <= (fifo_write ? fifo_room : fifo_level) >= fifo_wm;
         end
     end
+    assign flag_dat_data = CTRL_FIFO ? FIFO_FLAG_DATA : CTRL_FLAG_DAT_DATA;
+
+    // SD Implementation: Data FIFO
+    assign fifo_room = 2**FIFO_DEPTH_LOG2 - fifo_level;
+    assign fifo_wm = FIFO_WM == 0 ? 1 : FIFO_WM;
+    assign fifo_ready = dat_rnw ? !fifo_full : !fifo_empty;
+
+    neosd_dat_fifo #(
+        .DEPTH_LOG2(FIFO_DEPTH_LOG2)
+    ) dat_fifo (
+        .clk_i(clk_i),
+        .rstn_i(rstn_i),
+        .clear_i(fifo_clear),
+        .push_i(fifo_push),
+        .data_i(fifo_din),
+        .pop_i(fifo_pop),
+        .data_o(fifo_dout),
+        .level_o(fifo_level),
+        .empty_o(fifo_empty),
+        .full_o(fifo_full)
+    );
+
+    // Reads push the words of the data FSM, writes the ones of the CPU. The data FSM pops writes,
+    // the CPU reads. The FIFO is dropped on reset and when a new data transfer is committed.
+    always_comb begin
+        fifo_clear = CTRL_RST;
+        fifo_push = 1'b0;
+        fifo_din = dat_data_o;
+        fifo_pop = 1'b0;
+        fifo_load = 1'b0;
+
+        if (CTRL_FIFO == 1'b1) begin
+            if (clkstrb == 1'b1 && dat_rnw == 1'b1) begin
+                // Word completed without stalling, or stalled on a full FIFO and room now
+                if (dat_word == 1'b1 || (status_data_dat == 1'b1 && fifo_full == 1'b0))
+                    fifo_push = 1'b1;
+            end
+            if (clkstrb == 1'b1 && dat_rnw == 1'b0) begin
+                // Word loaded without stalling, or stalled on an empty FIFO and data now
+                if (dat_word_load == 1'b1 || (status_data_dat == 1'b1 && fifo_empty == 1'b0))
+                    fifo_load = 1'b1;
+            end
+
+            if (wb_stb_i && !wb_stall_o && wb_adr_i[7:0] == ADDR_DATA) begin
+                if (wb_we_i && fifo_write) begin
+                    fifo_push = 1'b1;
+                    fifo_din = wb_dat_i;
+                end else if (!wb_we_i && !fifo_write) begin
+                    fifo_pop = 1'b1;
+                end
+            end
+        end
+        fifo_pop = fifo_pop | fifo_load;
+
+        if (wb_stb_i && wb_we_i && !wb_stall_o && wb_adr_i[7:0] == ADDR_CMD &&
+            wb_dat_i[0] == 1'b1 && wb_dat_i[5] == 1'b1)
+            fifo_clear = 1'b1;
+    end
 
     // Wishbone Write Logic
     always @(posedge clk_i or negedge rstn_i) begin
         if (rstn_i == 1'b0) begin
             CTRL_RST <= '0;
             CTRL_D4 <= '0;
+            CTRL_FIFO <= '0;
             CTRL_IDLE_SDCLK <= '0;
             CTRL_CLK_PRSC <= '0;
             CTRL_CLK_DIV <= '0;
             CTRL_CLK_HS <= '0;
             CTRL_STAT_CRCERR <= '0;
+            CTRL_STAT_RESP_CRCERR <= '0;
             CTRL_FLAG_CMD_DONE <= '0;
             CTRL_FLAG_DAT_DONE <= '0;
             CTRL_FLAG_BLK_DONE <= '0;
@@ -97,19 +217,80 @@ module neosd (
         
             CMD_COMMIT <= '0;
             CMD_ABRT_DAT <= '0;
+            CMD_AUTO_CRC <= '0;
             CMD_DMODE <= '0;
             CMD_RMODE <= '0;
+            fifo_write <= 1'b0;
+
+            BLKCNT_COUNT <= '0;
+            BLKCNT_AUTO_CMD12 <= '0;
+            autostop_pend <= '0;
+            autostop_cmd <= '0;
+            cmdarg_pend <= '0;
+            blkcnt_abrt <= '0;
+
+            FIFO_WM <= 16'd1;
 
             status_idle_cmd_last <= 1'b1;
             status_idle_dat_last <= 1'b1;
         end else begin
+            // Write-1-to-clear. Events in the same cycle are assigned below and win, so none get lost.
+            // CTRL_FLAG_CMD_RESP and CTRL_FLAG_DAT_DATA clear on data access only.
+            if (flags_clr[14] == 1'b1)
+                CTRL_STAT_CRCERR <= 1'b0;
+            if (flags_clr[15] == 1'b1)
+                CTRL_STAT_RESP_CRCERR <= 1'b0;
+            if (flags_clr[18] == 1'b1)
+                CTRL_FLAG_CMD_DONE <= 1'b0;
+            if (flags_clr[19] == 1'b1)
+                CTRL_FLAG_DAT_DONE <= 1'b0;
+            if (flags_clr[20] == 1'b1)
+                CTRL_FLAG_BLK_DONE <= 1'b0;
+
             // Auto-reset after CMD FSM read those
             if (clkstrb == 1'b1) begin
                 CMD_COMMIT <= 1'b0;
+                if (CMD_COMMIT == 1'b1 && autostop_cmd == 1'b1)
+                    autostop_pend <= 1'b0;
+                autostop_cmd <= 1'b0;
+                if (status_idle_dat == 1'b1)
+                    blkcnt_abrt <= 1'b0;
                 if (status_block_done == 1'b1) begin
                     CTRL_FLAG_BLK_DONE <= 1'b1;
-                    CTRL_STAT_CRCERR <= CTRL_STAT_CRCERR | !status_crc_ok;
+                    CTRL_STAT_CRCERR <= (CTRL_STAT_CRCERR & !flags_clr[14]) | !status_crc_ok;
                 end
+                if (status_resp_done == 1'b1)
+                    CTRL_STAT_RESP_CRCERR <= (CTRL_STAT_RESP_CRCERR & !flags_clr[15]) | !status_resp_crc_ok;
+
+                // Count down, the last block stops the data FSM right away or with CMD12
+                if (status_block_done == 1'b1 && BLKCNT_COUNT != 0) begin
+                    BLKCNT_COUNT <= BLKCNT_COUNT - 1;
+                    if (BLKCNT_COUNT == 1) begin
+                        if (BLKCNT_AUTO_CMD12 == 1'b1)
+                            autostop_pend <= 1'b1;
+                        else
+                            blkcnt_abrt <= 1'b1;
+                    end
+                end
+            end
+
+            // CMD12: STOP_TRANSMISSION with generated CRC, R1b after writes. Same as a CMD write.
+            if (autostop_issue == 1'b1) begin
+                autostop_cmd <= 1'b1;
+                CMD_COMMIT <= 1'b1;
+                CMD_ABRT_DAT <= 1'b1;
+                CMD_AUTO_CRC <= 1'b1;
+                CMD_RMODE <= 2'b01;
+                CMD_DMODE <= fifo_write ? 2'b01 : 2'b00;
+                CTRL_STAT_RESP_CRCERR <= 1'b0;
+            end
+
+            if (CTRL_RST == 1'b1) begin
+                BLKCNT_COUNT <= '0;
+                autostop_pend <= 1'b0;
+                autostop_cmd <= 1'b0;
+                cmdarg_pend <= 1'b0;
+                blkcnt_abrt <= 1'b0;
             end
 
             // CMD done IRQ is edge triggered
@@ -127,19 +308,14 @@ module neosd (
                     ADDR_CTRL: begin
                         CTRL_RST <= wb_dat_i[0];
                         CTRL_D4 <= wb_dat_i[1];
+                        CTRL_FIFO <= wb_dat_i[2];
                         CTRL_IDLE_SDCLK <= wb_dat_i[3];
 
                         CTRL_CLK_PRSC <= wb_dat_i[6:4];
                         CTRL_CLK_HS <= wb_dat_i[7];
                         CTRL_CLK_DIV <= wb_dat_i[11:8];
 
-                        // status_idle_cmd and status_idle_dat are read only
-                        CTRL_STAT_CRCERR <= wb_dat_i[14];
-
-                        // CTRL_FLAG_CMD_RESP and CTRL_FLAG_DAT_DATA clear on data read instead
-                        CTRL_FLAG_CMD_DONE <= wb_dat_i[18];
-                        CTRL_FLAG_DAT_DONE <= wb_dat_i[19];
-                        CTRL_FLAG_BLK_DONE <= wb_dat_i[20];
+                        // Error and flag bits written as 0 are cleared through flags_clr
 
                         CTRL_MASK_CMD_RESP <= wb_dat_i[22];
                         CTRL_MASK_DAT_DATA <= wb_dat_i[23];
@@ -147,13 +323,35 @@ module neosd (
                         CTRL_MASK_DAT_DONE <= wb_dat_i[25];
                         CTRL_MASK_BLK_DONE <= wb_dat_i[26];
                     end
+                    ADDR_CMDARG: begin
+                        // Loaded by neosd_cmd_reg, the automatic CMD12 waits for the CMD write
+                        cmdarg_pend <= 1'b1;
+                    end
                     ADDR_CMD: begin
                         CMD_COMMIT <= wb_dat_i[0];
+                        autostop_cmd <= 1'b0;
+                        cmdarg_pend <= 1'b0;
                         CMD_ABRT_DAT <= wb_dat_i[1];
+                        CMD_AUTO_CRC <= wb_dat_i[2];
+                        // Response CRC error refers to the last command
+                        if (wb_dat_i[0] == 1'b1)
+                            CTRL_STAT_RESP_CRCERR <= 1'b0;
                         CMD_DMODE <= wb_dat_i[5:4];
+                        if (wb_dat_i[0] == 1'b1 && wb_dat_i[5] == 1'b1)
+                            fifo_write <= wb_dat_i[4];
                         CMD_RMODE <= wb_dat_i[7:6];
                         // Rest handled async and forwarded to neosd_cmd_fsm
                     end
+                    ADDR_BLKCNT: begin
+                        // Arm before the data transfer starts, 0 disarms
+                        BLKCNT_COUNT <= wb_dat_i[23:0];
+                        BLKCNT_AUTO_CMD12 <= wb_dat_i[31];
+                        autostop_pend <= 1'b0;
+                        autostop_cmd <= 1'b0;
+                    end
+                    ADDR_FIFO: begin
+                        FIFO_WM <= wb_dat_i[31:16];
+                    end
                     // INFO REG is readonly
                     // CMDARG handled async and forwarded to neosd_cmd_fsm
                     // CMD_RESP handled async and forwarded to neosd_cmd_fsm
@@ -166,7 +364,6 @@ module neosd (
     end
 
     logic[31:0] cmd_resp_data;
-    logic[31:0] dat_data_o;
     // Wishbone Read Logic
     always @(posedge clk_i or negedge rstn_i) begin
         if (rstn_i == 1'b0) begin
@@ -185,13 +382,15 @@ module neosd (
                     ADDR_INFO: begin
                         wb_dat_o[31:16] <= 16'hE05D;
                         // Version X.Y.Z
+                        wb_dat_o[15:12] <= FIFO_DEPTH_LOG2;
                         wb_dat_o[11:8] <= 0;
-                        wb_dat_o[7:4] <= 1;
+                        wb_dat_o[7:4] <= 5;
                         wb_dat_o[3:0] <= 0;
                     end
                     ADDR_CTRL: begin
                         wb_dat_o[0] <= CTRL_RST;
                         wb_dat_o[1] <= CTRL_D4;
+                        wb_dat_o[2] <= CTRL_FIFO;
                         wb_dat_o[3] <= CTRL_IDLE_SDCLK;
 
                         wb_dat_o[6:4] <= CTRL_CLK_PRSC;
@@ -201,9 +400,10 @@ module neosd (
                         wb_dat_o[12] <= !status_idle_cmd;
                         wb_dat_o[13] <= !status_idle_dat;
                         wb_dat_o[14] <= CTRL_STAT_CRCERR;
+                        wb_dat_o[15] <= CTRL_STAT_RESP_CRCERR;
 
                         wb_dat_o[16] <= CTRL_FLAG_CMD_RESP;
-                        wb_dat_o[17] <= CTRL_FLAG_DAT_DATA;
+                        wb_dat_o[17] <= flag_dat_data;
                         wb_dat_o[18] <= CTRL_FLAG_CMD_DONE;
                         wb_dat_o[19] <= CTRL_FLAG_DAT_DONE;
                         wb_dat_o[20] <= CTRL_FLAG_BLK_DONE;
@@ -214,12 +414,47 @@ module neosd (
                         wb_dat_o[25] <= CTRL_MASK_DAT_DONE;
                         wb_dat_o[26] <= CTRL_MASK_BLK_DONE;
                     end
+                    ADDR_STATUS: begin
+                        // CTRL without the configuration
+                        wb_dat_o[12] <= !status_idle_cmd;
+                        wb_dat_o[13] <= !status_idle_dat;
+                        wb_dat_o[14] <= CTRL_STAT_CRCERR;
+                        wb_dat_o[15] <= CTRL_STAT_RESP_CRCERR;
+
+                        wb_dat_o[16] <= CTRL_FLAG_CMD_RESP;
+                        wb_dat_o[17] <= flag_dat_data;
+                        wb_dat_o[18] <= CTRL_FLAG_CMD_DONE;
+                        wb_dat_o[19] <= CTRL_FLAG_DAT_DONE;
+                        wb_dat_o[20] <= CTRL_FLAG_BLK_DONE;
+                    end
+                    ADDR_FLAGS: begin
+                        wb_dat_o[14] <= CTRL_STAT_CRCERR;
+                        wb_dat_o[15] <= CTRL_STAT_RESP_CRCERR;
+
+                        wb_dat_o[16] <= CTRL_FLAG_CMD_RESP;
+                        wb_dat_o[17] <= flag_dat_data;
+                        wb_dat_o[18] <= CTRL_FLAG_CMD_DONE;
+                        wb_dat_o[19] <= CTRL_FLAG_DAT_DONE;
+                        wb_dat_o[20] <= CTRL_FLAG_BLK_DONE;
+                    end
+                    ADDR_BLKCNT: begin
+                        wb_dat_o[23:0] <= BLKCNT_COUNT;
+                        wb_dat_o[31] <= BLKCNT_AUTO_CMD12;
+                    end
+                    ADDR_FIFO: begin
+                        wb_dat_o[FIFO_DEPTH_LOG2:0] <= fifo_level;
+                        wb_dat_o[31:16] <= FIFO_WM;
+                    end
                     ADDR_RESP: begin
                         wb_dat_o[31:0] <= cmd_resp_data;
                         CTRL_FLAG_CMD_RESP <= 1'b0;
                     end
                     ADDR_DATA: begin
-                        wb_dat_o[31:0] <= dat_data_o;
+                        // The FIFO is popped in the data FIFO block
+                        if (CTRL_FIFO == 1'b1)
+                            wb_dat_o[31:0] <= fifo_write ? '0 : fifo_dout;
+                        else
+                            wb_dat_o[31:0] <= dat_data_o;
                         // CTRL_FLAG_DAT_DATA is reset in extra block
                     end
                     // CMDARG is write-only
@@ -254,7 +489,7 @@ module neosd (
         .clkstrb_i(clkstrb),
         .fsm_rst_i(CTRL_RST),
 
-        .dat_i(wb_dat_i),
+        .dat_i(CTRL_FIFO ? fifo_dout : wb_dat_i),
         .dat_load_i(dat_load),
         .dat_o(dat_data_o),
 
@@ -262,11 +497,16 @@ module neosd (
         .status_data_o(status_data_dat),
         .status_block_done_o(status_block_done),
         .status_crc_ok_o(status_crc_ok),
+        .status_rnw_o(dat_rnw),
+        .status_word_o(dat_word),
+        .status_word_load_o(dat_word_load),
         .ctrl_start_i(dat_start),
-        .ctrl_dat_ack_i(~CTRL_FLAG_DAT_DATA),
-        .ctrl_last_block_i(CMD_ABRT_DAT),
+        .ctrl_dat_ack_i(CTRL_FIFO ? fifo_ready : ~CTRL_FLAG_DAT_DATA),
+        .ctrl_last_block_i(CMD_ABRT_DAT | blkcnt_abrt),
         .ctrl_dmode_i(CMD_DMODE),
         .ctrl_d4_i(CTRL_D4),
+        .ctrl_fifo_i(CTRL_FIFO),
+        .ctrl_fifo_ready_i(fifo_ready),
 
         .sd_clk_req_o(sd_clk_req_dat),
         .sd_clk_stall_o(sd_clk_stall_dat),
@@ -279,7 +519,10 @@ module neosd (
     // Forward register accesses to neosd_dat_fsm
     always_comb begin
         dat_load = 1'b0;
-        if (wb_stb_i && wb_we_i && !wb_stall_o) begin
+        if (CTRL_FIFO == 1'b1) begin
+            // Load the word the FIFO block pops
+            dat_load = fifo_load;
+        end else if (wb_stb_i && wb_we_i && !wb_stall_o) begin
             if (wb_adr_i[7:0] == ADDR_DATA) begin
                 dat_load = 1'b1;
             end
@@ -316,7 +559,10 @@ module neosd (
         .ctrl_resp_ack_i(~CTRL_FLAG_CMD_RESP),
         .ctrl_rmode_i(CMD_RMODE),
         .ctrl_dmode_i(CMD_DMODE),
+        .ctrl_auto_crc_i(CMD_AUTO_CRC),
         .start_dat_o(dat_start),
+        .status_resp_done_o(status_resp_done),
+        .status_resp_crc_ok_o(status_resp_crc_ok),
 
         .sd_clk_req_o(sd_clk_req_cmd),
         .sd_clk_stall_o(sd_clk_stall_cmd),
@@ -350,16 +596,27 @@ module neosd (
                 end
             endcase
         end
+
+        // Block counter CMD12, argument 0. The CRC is generated.
+        if (autostop_issue == 1'b1) begin
+            cmd_idx = 6'd12;
+            cmd_crc = '0;
+            cmdarg = '0;
+            cmd_idx_load = 1'b1;
+            cmd_crc_load = 1'b1;
+            cmdarg_load = 4'b1111;
+        end
     end
 
     // Interrupts
     assign irq_o = (CTRL_FLAG_BLK_DONE & CTRL_MASK_BLK_DONE) |
         (CTRL_FLAG_CMD_DONE & CTRL_MASK_CMD_DONE) |
         (CTRL_FLAG_CMD_RESP & CTRL_MASK_CMD_RESP) |
-        (CTRL_FLAG_DAT_DATA & CTRL_MASK_DAT_DATA) |
+        (flag_dat_data & CTRL_MASK_DAT_DATA) |
         (CTRL_FLAG_DAT_DONE & CTRL_MASK_DAT_DONE);
     
-    assign flag_data_o = CTRL_FLAG_DAT_DATA;
+    // FIFO mode: Request single words as long as there's data or room
+    assign flag_data_o = CTRL_FIFO ? (fifo_write ? !fifo_full : !fifo_empty) : CTRL_FLAG_DAT_DATA;
 
     logic[7:0] clkgen;
 
@@ -0,0 +1,224 @@
+#include <neorv32.h>
+#include <neosd.h>
+#include <neosd_app.h>
+
+#ifdef NEOSD_HOST
+#include "neosd_model.h"
+#endif
+
+/*
+* Throughput benchmark. Sweeps transfer mode, bus width, clock setting and
+* transfer size and prints one CSV row per combination:
+*
+*   mode     single: CMD17 / CMD24 per block, cmd12 / cmd23: CMD18 / CMD25
+*            ended by STOP_TRANSMISSION or announced by SET_BLOCK_COUNT
+*   fifo     1: CPU moves the data in FIFO bursts, 0: one word per data flag
+*   cycles   mcycle per 512 byte block, instret: minstret per block
+*   kib_s    KiB/s at the system clock
+*
+* A comment line before the table gives the CMD13 round trip (commit, response
+* and the blocking wait) in mcycle and minstret.
+*
+* Writes destroy the data at BENCH_BLOCK, so they only run with BENCH_WRITE.
+* Builds for the target and for the host (make -C sw/host bench).
+*/
+
+#define BAUD_RATE 19200
+
+// First block of the benchmark area
+#ifndef BENCH_BLOCK
+#define BENCH_BLOCK 0
+#endif
+// Largest transfer, sets the buffer size
+#ifndef BENCH_MAX_BLOCKS
+#define BENCH_MAX_BLOCKS 16
+#endif
+// Transfers averaged per row
+#ifndef BENCH_RUNS
+#define BENCH_RUNS 4
+#endif
+// Skip settings faster than the default speed bus mode allows. Cards switched to
+// high speed by card init allow 50 MHz.
+#ifndef BENCH_MAX_SD_HZ
+#define BENCH_MAX_SD_HZ 25000000
+#endif
+#ifndef BENCH_MAX_HS_HZ
+#define BENCH_MAX_HS_HZ 50000000
+#endif
+
+#ifdef NEOSD_HOST
+#ifndef BENCH_IMAGE
+#define BENCH_IMAGE "bench.img"
+#endif
+#ifndef BENCH_CLK_HZ
+#define BENCH_CLK_HZ 100000000
+#endif
+#endif
+
+enum bench_mode { BENCH_SINGLE, BENCH_CMD12, BENCH_CMD23 };
+
+static const char* const BENCH_MODE_NAME[3] = {"single", "cmd12", "cmd23"};
+static const size_t BENCH_SIZES[] = {1, 4, BENCH_MAX_BLOCKS};
+static const uint32_t PRSC_LUT[8] = {2, 4, 8, 64, 128, 1024, 2048, 4096};
+
+static uint32_t bench_buf[BENCH_MAX_BLOCKS * 128];
+
+static bool bench_transfer(bench_mode mode, bool write, size_t count)
+{
+    if (mode != BENCH_SINGLE)
+    {
+        if (write)
+            return neosd_app_write_blocks(BENCH_BLOCK, count, bench_buf);
+        return neosd_app_read_blocks(BENCH_BLOCK, count, bench_buf);
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (write)
+            ok &= neosd_app_write_block(BENCH_BLOCK + i, bench_buf + i * 128);
+        else
+            ok &= neosd_app_read_block(BENCH_BLOCK + i, bench_buf + i * 128);
+    }
+    return ok;
+}
+
+/**********************************************************************//**
+* Measure and print one row. Returns false if a transfer failed.
+**************************************************************************/
+static bool bench_row(bench_mode mode, bool write, bool fifo, bool d4, int prsc, int cdiv, bool hs, size_t count)
+{
+    bool ok = true;
+    uint64_t cycle = neorv32_cpu_get_cycle();
+    uint64_t instret = neorv32_cpu_get_instret();
+    for (int i = 0; i < BENCH_RUNS; i++)
+        ok &= bench_transfer(mode, write, count);
+    cycle = neorv32_cpu_get_cycle() - cycle;
+    instret = neorv32_cpu_get_instret() - instret;
+
+    uint32_t clk = neorv32_sysinfo_get_clk();
+    uint32_t div = (hs ? 2 : 2 * PRSC_LUT[prsc]) * (cdiv + 1);
+    uint32_t blocks = BENCH_RUNS * count;
+    uint32_t kib_s = (uint32_t)((uint64_t)blocks * clk / 2 / cycle);
+
+    neorv32_uart0_printf("%s,%s,%u,%s,%u,%u,%u,%u,%u,%u,%u,%u,%u\n", BENCH_MODE_NAME[mode], write ? "write" : "read",
+        fifo, d4 ? "D4" : "D1", prsc, cdiv, hs, clk / 1000 / div, (uint32_t)count, (uint32_t)(cycle / blocks),
+        (uint32_t)(instret / blocks), kib_s, ok);
+    return ok;
+}
+
+/**********************************************************************//**
+* Measure and print the command round trip. Returns false if a command failed.
+**************************************************************************/
+static bool bench_command()
+{
+    bool ok = true;
+    sd_status_t status;
+    uint64_t cycle = neorv32_cpu_get_cycle();
+    uint64_t instret = neorv32_cpu_get_instret();
+    for (int i = 0; i < BENCH_RUNS; i++)
+        ok &= neosd_app_card_status(&status) == NEOSD_OK;
+    cycle = neorv32_cpu_get_cycle() - cycle;
+    instret = neorv32_cpu_get_instret() - instret;
+
+    neorv32_uart0_printf("# CMD13 round trip: %u cycles, %u instret\n", (uint32_t)(cycle / BENCH_RUNS),
+        (uint32_t)(instret / BENCH_RUNS));
+    return ok;
+}
+
+static bool bench_setting(bool d4, int prsc, int cdiv, bool hs)
+{
+    bool ok = true;
+    neosd_set_clock(prsc, cdiv, hs);
+    for (int dir = 0; dir < 2; dir++)
+    {
+        bool write = dir != 0;
+#ifndef BENCH_WRITE
+        if (write)
+            break;
+#endif
+        for (int fifo = 1; fifo >= 0; fifo--)
+        {
+            if (neosd_app_use_fifo(fifo) != (fifo != 0))
+                continue;
+            for (int mode = BENCH_SINGLE; mode <= BENCH_CMD23; mode++)
+            {
+                if (mode != BENCH_SINGLE && neosd_app_use_cmd23(mode == BENCH_CMD23) != (mode == BENCH_CMD23))
+                    continue;
+                for (size_t count : BENCH_SIZES)
+                {
+                    if (mode != BENCH_SINGLE && count == 1)
+                        continue;
+                    ok &= bench_row((bench_mode)mode, write, fifo, d4, prsc, cdiv, hs, count);
+                }
+            }
+        }
+    }
+    neosd_app_use_cmd23(true);
+    neosd_app_use_fifo(true);
+    return ok;
+}
+
+int main()
+{
+#ifdef NEOSD_HOST
+    static sd_card_model card(BENCH_IMAGE, 64 << 20, sd_card_model::timing_t());
+    static neosd_model controller(card, BENCH_CLK_HZ, 4);
+    if (!card.ok())
+    {
+        neorv32_uart0_printf("Cannot open %s\n", BENCH_IMAGE);
+        return 1;
+    }
+    neosd_host_attach(&controller);
+#else
+    neorv32_rte_setup();
+    neorv32_uart0_setup(BAUD_RATE, 0);
+#endif
+
+    // Identification at <= 400 kHz: 2 * 64 * (cdiv + 1) system clocks
+    uint32_t clk = neorv32_sysinfo_get_clk();
+    neosd_version_t ver;
+    if (!neosd_setup(3, (clk - 1) / (2 * 64 * 400000), &ver))
+    {
+        neorv32_uart0_printf("NEOSD: Controller not found. Stopping\n");
+        return 1;
+    }
+
+    sd_card_t info;
+    SD_CODE code = neosd_app_card_init(&info, clk);
+    if (code != NEOSD_OK)
+    {
+        neorv32_uart0_printf("Card init failed: %d\n", code);
+        return 1;
+    }
+
+    for (size_t i = 0; i < BENCH_MAX_BLOCKS * 128; i++)
+        bench_buf[i] = i * 0x01010101;
+
+    uint32_t max_sd_hz = info.hs ? BENCH_MAX_HS_HZ : BENCH_MAX_SD_HZ;
+    neorv32_uart0_printf("# High speed: %u, init clock %u kHz\n", info.hs, neosd_get_clock_speed() / 1000);
+
+    // Data rate settings from fast to slow, HS: 2 * (cdiv + 1) system clocks per SD clock
+    bool ok = bench_command();
+    neorv32_uart0_printf("mode,dir,fifo,bus,prsc,cdiv,hs,sd_khz,blocks,cycles,instret,kib_s,ok\n");
+    for (int d4 = 1; d4 >= 0; d4--)
+    {
+        ok &= neosd_app_configure_datamode(d4, info.rca);
+        for (int cdiv = 0; cdiv < 2; cdiv++)
+        {
+            if (clk / (2 * (cdiv + 1)) <= max_sd_hz)
+                ok &= bench_setting(d4, 0, cdiv, true);
+        }
+        for (int prsc = 0; prsc < 4; prsc++)
+        {
+            for (int cdiv = 0; cdiv < 2; cdiv++)
+            {
+                if (clk / (2 * PRSC_LUT[prsc] * (cdiv + 1)) <= max_sd_hz)
+                    ok &= bench_setting(d4, prsc, cdiv, false);
+            }
+        }
+    }
+
+    neorv32_uart0_printf(ok ? "# PASS\n" : "# FAIL\n");
+    return ok ? 0 : 1;
+}
@@ -62,14 +62,14 @@ SD_CODE neosd_card_init(sd_card_t* info)
         
 
         // Now do the initialization ACMD41. 4.2.3.1 Initialization Command (ACMD41)
-        uint64_t timeout = neosd_clint_time_get_ms() + 1000;
+        neosd_deadline_t deadline = neosd_deadline_ms(1000);
         // FIXME: Voltage switch not supported for now in driver, always using 3.3V
         uint32_t acmd41_arg = (1 << SD_ACMD41_HCS) | (1 << SD_ACMD41_XPC) | (0 << SD_ACMD41_S18R) |
             (1 << 20); //3.3V
         NEOSD_DEBUG_MSG("NEOSD: acmd41_arg=%x\n", acmd41_arg);
         while (true)
         {
-            if (neosd_clint_time_get_ms() > timeout)
+            if (neosd_deadline_expired(&deadline))
             {
                 NEOSD_DEBUG_MSG("NEOSD: Card was returning busy for more than 1s\n");
                 return NEOSD_TIMEOUT;
@@ -213,7 +213,7 @@ void neosd_read_blocks_stop(size_t offset, size_t num)
     // R1 and maybe data
     while (true)
     {
-        auto irq = NEOSD->CTRL;
+        auto irq = neosd_status();
         if (irq & (1 << NEOSD_CTRL_FLAG_CMD_RESP))
         {
             *(rptr--) = NEOSD->RESP;
@@ -221,7 +221,7 @@ void neosd_read_blocks_stop(size_t offset, size_t num)
         }
         if (irq & (1 << NEOSD_CTRL_FLAG_CMD_DONE))
         {
-            NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_CMD_DONE);
+            neosd_ack(1 << NEOSD_CTRL_FLAG_CMD_DONE);
             neorv32_uart0_printf("=> CMD response is done\n");
             NEOSD_DEBUG_R1(&resp.rshort);
         }
@@ -234,7 +234,7 @@ void neosd_read_blocks_stop(size_t offset, size_t num)
         if (irq & (1 << NEOSD_CTRL_FLAG_BLK_DONE))
         {
             neorv32_uart0_printf("=> Finished a block. CRC is %s\n", (irq & (1 << NEOSD_CTRL_CRCERR)) ? "fail" : "ok");
-            NEOSD->CTRL &= ~((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR));
+            neosd_ack(irq & ((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR)));
 
             if (++blocks == num)
             {
@@ -245,7 +245,7 @@ void neosd_read_blocks_stop(size_t offset, size_t num)
         }
         if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DONE))
         {
-            NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_DAT_DONE);
+            neosd_ack(1 << NEOSD_CTRL_FLAG_DAT_DONE);
             neorv32_uart0_printf("=> DAT response is done\n");
             break;
         }
@@ -256,7 +256,7 @@ void neosd_read_blocks_stop(size_t offset, size_t num)
     neorv32_uart0_printf("=> Waiting for stop\n");
     while (true)
     {
-        auto irq = NEOSD->CTRL;
+        auto irq = neosd_status();
         if (irq & (1 << NEOSD_CTRL_FLAG_CMD_RESP))
         {
             *(rptr--) = NEOSD->RESP;
@@ -264,7 +264,7 @@ void neosd_read_blocks_stop(size_t offset, size_t num)
         }
         if (irq & (1 << NEOSD_CTRL_FLAG_CMD_DONE))
         {
-            NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_CMD_DONE);
+            neosd_ack(1 << NEOSD_CTRL_FLAG_CMD_DONE);
             neorv32_uart0_printf("=> CMD response is done\n");
             NEOSD_DEBUG_R1(&resp.rshort);
             break;
@@ -277,11 +277,11 @@ void neosd_read_blocks_stop(size_t offset, size_t num)
         if (irq & (1 << NEOSD_CTRL_FLAG_BLK_DONE))
         {
             neorv32_uart0_printf("=> Finished a block. CRC is %s\n", (irq & (1 << NEOSD_CTRL_CRCERR)) ? "fail" : "ok");
-            NEOSD->CTRL &= ~((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR));
+            neosd_ack(irq & ((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR)));
         }
         if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DONE))
         {
-            NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_DAT_DONE);
+            neosd_ack(1 << NEOSD_CTRL_FLAG_DAT_DONE);
             neorv32_uart0_printf("=> DAT response is done\n");
         }
     }
@@ -312,7 +312,7 @@ bool neosd_read_blocks_23(size_t offset, size_t num)
     // R1 and maybe data
     while (true)
     {
-        auto irq = NEOSD->CTRL;
+        auto irq = neosd_status();
         if (irq & (1 << NEOSD_CTRL_FLAG_CMD_RESP))
         {
             *(rptr--) = NEOSD->RESP;
@@ -320,7 +320,7 @@ bool neosd_read_blocks_23(size_t offset, size_t num)
         }
         if (irq & (1 << NEOSD_CTRL_FLAG_CMD_DONE))
         {
-            NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_CMD_DONE);
+            neosd_ack(1 << NEOSD_CTRL_FLAG_CMD_DONE);
             //neorv32_uart0_printf("=> CMD response is done\n");
             //NEOSD_DEBUG_R1(&resp.rshort);
         }
@@ -332,7 +332,7 @@ bool neosd_read_blocks_23(size_t offset, size_t num)
         if (irq & (1 << NEOSD_CTRL_FLAG_BLK_DONE))
         {
             neorv32_uart0_printf("=> Finished a block. CRC is %s\n", (irq & (1 << NEOSD_CRC_ERR)) ? "fail" : "ok");
-            NEOSD->CTRL &= ~((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR));
+            neosd_ack(irq & ((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR)));
 
             if (++blocks == num)
             {
@@ -343,7 +343,7 @@ bool neosd_read_blocks_23(size_t offset, size_t num)
         }
         if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DONE))
         {
-            NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_DAT_DONE);
+            neosd_ack(1 << NEOSD_CTRL_FLAG_DAT_DONE);
             //neorv32_uart0_printf("=> DAT response is done\n");
         }
     }
@@ -364,7 +364,7 @@ bool neosd_read_block(size_t offset)
     // R1 and maybe data
     while (true)
     {
-        auto irq = NEOSD->CTRL;
+        auto irq = neosd_status();
         if (irq & (1 << NEOSD_CTRL_FLAG_CMD_RESP))
         {
             *(rptr--) = NEOSD->RESP;
@@ -372,7 +372,7 @@ bool neosd_read_block(size_t offset)
         }
         if (irq & (1 << NEOSD_CTRL_FLAG_CMD_DONE))
         {
-            NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_CMD_DONE);
+            neosd_ack(1 << NEOSD_CTRL_FLAG_CMD_DONE);
             //neorv32_uart0_printf("=> CMD response is done\n");
             //NEOSD_DEBUG_R1(&resp.rshort);
         }
@@ -383,13 +383,13 @@ bool neosd_read_block(size_t offset)
         }
         if (irq & (1 << NEOSD_CTRL_FLAG_BLK_DONE))
         {
-            neorv32_uart0_printf("=> Finished a block. CRC is %s\n", (NEOSD->CTRL & (1 << NEOSD_CTRL_CRCERR)) ? "fail" : "ok");
-            NEOSD->CTRL &= ~((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR));
+            neorv32_uart0_printf("=> Finished a block. CRC is %s\n", (irq & (1 << NEOSD_CTRL_CRCERR)) ? "fail" : "ok");
+            neosd_ack(irq & ((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR)));
             NEOSD->CMD = (1 << NEOSD_CMD_ABRT_DAT);
         }
         if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DONE))
         {
-            NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_DAT_DONE);
+            neosd_ack(1 << NEOSD_CTRL_FLAG_DAT_DONE);
             //neorv32_uart0_printf("=> DAT response is done\n");
             break;
         }
@@ -419,9 +419,9 @@ bool neosd_set_data_mode(bool d4mode)
     //NEOSD_DEBUG_R1(&resp.rshort);
 
     if (d4mode)
-        NEOSD->CTRL |= (1 << NEOSD_CTRL_D4);
+        neosd_ctrl_modify(0, 1 << NEOSD_CTRL_D4);
     else
-        NEOSD->CTRL &= ~(1 << NEOSD_CTRL_D4);
+        neosd_ctrl_modify(1 << NEOSD_CTRL_D4, 0);
 
     return true;
 }
@@ -440,7 +440,7 @@ bool neosd_write_block(size_t offset)
     // R1 and write data
     while (true)
     {
-        auto irq = NEOSD->CTRL;
+        auto irq = neosd_status();
         if (irq & (1 << NEOSD_CTRL_FLAG_CMD_RESP))
         {
             *(rptr--) = NEOSD->RESP;
@@ -448,7 +448,7 @@ bool neosd_write_block(size_t offset)
         }
         if (irq & (1 << NEOSD_CTRL_FLAG_CMD_DONE))
         {
-            NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_CMD_RESP);
+            neosd_ack(1 << NEOSD_CTRL_FLAG_CMD_DONE);
             neorv32_uart0_printf("=> CMD response is done\n");
             NEOSD_DEBUG_R1(&resp.rshort);
         }
@@ -463,13 +463,13 @@ bool neosd_write_block(size_t offset)
         }
         if (irq & (1 << NEOSD_CTRL_FLAG_BLK_DONE))
         {
-            neorv32_uart0_printf("=> Finished a block. CRC sticky is %s\n", (NEOSD->CTRL & (1 << NEOSD_CTRL_CRCERR)) ? "err" : "ok");
-            NEOSD->CTRL &= ~((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR));
+            neorv32_uart0_printf("=> Finished a block. CRC sticky is %s\n", (irq & (1 << NEOSD_CTRL_CRCERR)) ? "err" : "ok");
+            neosd_ack(irq & ((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR)));
             NEOSD->CMD = (1 << NEOSD_CMD_ABRT_DAT);
         }
         if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DONE))
         {
-            NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_DAT_DONE);
+            neosd_ack(1 << NEOSD_CTRL_FLAG_DAT_DONE);
             neorv32_uart0_printf("=> DAT response is done\n");
             break;
         }
@@ -494,7 +494,7 @@ void neosd_write_blocks_stop(size_t offset, size_t num)
     // R1 and maybe data
     while (true)
     {
-        auto irq = NEOSD->CTRL;
+        auto irq = neosd_status();
         if (irq & (1 << NEOSD_CTRL_FLAG_CMD_RESP))
         {
             *(rptr--) = NEOSD->RESP;
@@ -502,7 +502,7 @@ void neosd_write_blocks_stop(size_t offset, size_t num)
         }
         if (irq & (1 << NEOSD_CTRL_FLAG_CMD_DONE))
         {
-            NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_CMD_DONE);
+            neosd_ack(1 << NEOSD_CTRL_FLAG_CMD_DONE);
             neorv32_uart0_printf("=> CMD response is done\n");
             NEOSD_DEBUG_R1(&resp.rshort);
         }
@@ -518,7 +518,7 @@ void neosd_write_blocks_stop(size_t offset, size_t num)
         if (irq & (1 << NEOSD_CTRL_FLAG_BLK_DONE))
         {
             neorv32_uart0_printf("=> Finished a block. CRC is %s\n", (irq & (1 << NEOSD_CTRL_CRCERR)) ? "fail" : "ok");
-            NEOSD->CTRL &= ~((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR));
+            neosd_ack(irq & ((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR)));
 
             if (++blocks == num)
             {
@@ -529,7 +529,7 @@ void neosd_write_blocks_stop(size_t offset, size_t num)
         }
         if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DONE))
         {
-            NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_DAT_DONE);
+            neosd_ack(1 << NEOSD_CTRL_FLAG_DAT_DONE);
             neorv32_uart0_printf("=> DAT response is done\n");
             break;
         }
@@ -539,7 +539,7 @@ void neosd_write_blocks_stop(size_t offset, size_t num)
     // FIXME: Wait till data and CMD is idle
     while (true)
     {
-        auto irq = NEOSD->CTRL;
+        auto irq = neosd_status();
         if (irq & (1 << NEOSD_CTRL_FLAG_CMD_RESP))
         {
             *(rptr--) = NEOSD->RESP;
@@ -547,7 +547,7 @@ void neosd_write_blocks_stop(size_t offset, size_t num)
         }
         if (irq & (1 << NEOSD_CTRL_FLAG_CMD_DONE))
         {
-            NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_CMD_DONE);
+            neosd_ack(1 << NEOSD_CTRL_FLAG_CMD_DONE);
             neorv32_uart0_printf("=> CMD response is done\n");
             NEOSD_DEBUG_R1(&resp.rshort);
         }
@@ -558,12 +558,12 @@ void neosd_write_blocks_stop(size_t offset, size_t num)
         }
         if (irq & (1 << NEOSD_CTRL_FLAG_BLK_DONE))
         {
-            NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_BLK_DONE);
+            neosd_ack(1 << NEOSD_CTRL_FLAG_BLK_DONE);
             neorv32_uart0_printf("=> BLK is done\n");
         }
         if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DONE))
         {
-            NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_DAT_DONE);
+            neosd_ack(1 << NEOSD_CTRL_FLAG_DAT_DONE);
             neorv32_uart0_printf("=> DAT response is done\n");
             break;
         }
@@ -594,7 +594,7 @@ bool neosd_write_blocks_23(size_t offset, size_t num)
     // R1 and maybe data
     while (true)
     {
-        auto irq = NEOSD->CTRL;
+        auto irq = neosd_status();
         if (irq & (1 << NEOSD_CTRL_FLAG_CMD_RESP))
         {
             *(rptr--) = NEOSD->RESP;
@@ -602,7 +602,7 @@ bool neosd_write_blocks_23(size_t offset, size_t num)
         }
         if (irq & (1 << NEOSD_CTRL_FLAG_CMD_DONE))
         {
-            NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_CMD_DONE);
+            neosd_ack(1 << NEOSD_CTRL_FLAG_CMD_DONE);
             neorv32_uart0_printf("=> CMD response is done\n");
             NEOSD_DEBUG_R1(&resp.rshort);
         }
@@ -613,8 +613,8 @@ bool neosd_write_blocks_23(size_t offset, size_t num)
         }
         if (irq & (1 << NEOSD_CTRL_FLAG_BLK_DONE))
         {
-            neorv32_uart0_printf("=> Finished a block. CRC is %s\n", (NEOSD->CTRL & (1 << NEOSD_CTRL_CRCERR)) ? "fail" : "ok");
-            NEOSD->CTRL &= ~((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR));
+            neorv32_uart0_printf("=> Finished a block. CRC is %s\n", (irq & (1 << NEOSD_CTRL_CRCERR)) ? "fail" : "ok");
+            neosd_ack(irq & ((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR)));
 
             if (++blocks == num)
             {
@@ -624,7 +624,7 @@ bool neosd_write_blocks_23(size_t offset, size_t num)
         }
         if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DONE))
         {
-            NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_DAT_DONE);
+            neosd_ack(1 << NEOSD_CTRL_FLAG_DAT_DONE);
             neorv32_uart0_printf("=> DAT response is done\n");
             break;
         }
@@ -648,7 +648,7 @@ int test_data_read()
     }
 
     neosd_wait_idle();
-    NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_DAT_DONE);
+    neosd_ack(1 << NEOSD_CTRL_FLAG_DAT_DONE);
     NEOSD_DEBUG_MSG("NEOSD: Got response\n");
     NEOSD_DEBUG_R1(&resp.rshort);
 
@@ -669,9 +669,9 @@ int test_data_read()
     NEOSD_DEBUG_MSG("NEOSD: Got response\n");
     NEOSD_DEBUG_R1(&resp.rshort);
 
-    // Increase clock rate
-    NEOSD_DEBUG_MSG("NEOSD: Increasing Clock Rate\n");
-    neosd_set_clock(CLK_PRSC_8, 0, false);
+    // Increase clock rate to the default speed limit of 25 MHz
+    neosd_set_clock_max(neorv32_sysinfo_get_clk(), 25000000);
+    NEOSD_DEBUG_MSG("NEOSD: Increased Clock Rate to %u Hz\n", neosd_get_clock_speed());
 
 
 
@@ -703,48 +703,7 @@ int test_data_read()
     neorv32_uart0_getc();
     neosd_read_blocks_stop(0, 2);
 
-    uint64_t dataSize = 32*1024*2*512*8*1000ULL;
-/*
-    uint64_t last = neosd_clint_time_get_ms();
-    neosd_read_blocks_stop(0, 32 * 1024 * 2);
-    uint64_t now = neosd_clint_time_get_ms();
-    neorv32_uart0_printf("=> With STOP_TRANSMISSION CMD: %u bit/s (%u ms)\n", (uint32_t)((dataSize)/(now-last)), (uint32_t)(now-last));
-
-    last = neosd_clint_time_get_ms();
-    neosd_read_blocks_23(0, 32 * 1024 * 2);
-    now = neosd_clint_time_get_ms();
-    neorv32_uart0_printf("=> With SET_BLOCK_COUNT CMD: %u bit/s (%u ms)\n", (uint32_t)((dataSize)/(now-last)), (uint32_t)(now-last));
-
-    last = neosd_clint_time_get_ms();
-    for (size_t i = 0; i < 32 * 1024 * 2; i++)
-        neosd_read_block(i*512);
-    now = neosd_clint_time_get_ms();
-    neorv32_uart0_printf("=> With individual reads: %u bit/s\n (%u ms)", (uint32_t)((dataSize)/(now-last)), (uint32_t)(now-last));
-
-
-
-
-    neorv32_uart0_printf("\n\nD4 Mode:\n");
-    neosd_set_data_mode(true);
-
-    last = neosd_clint_time_get_ms();
-    neosd_read_blocks_stop(0, 32 * 1024 * 2);
-    now = neosd_clint_time_get_ms();
-    neorv32_uart0_printf("=> With STOP_TRANSMISSION CMD: %u bit/s (%u ms)\n", (uint32_t)((dataSize)/(now-last)), (uint32_t)(now-last));
-
-
-    last = neosd_clint_time_get_ms();
-    neosd_read_blocks_23(0, 32 * 1024 * 2);
-    now = neosd_clint_time_get_ms();
-    neorv32_uart0_printf("=> With SET_BLOCK_COUNT CMD: %u bit/s (%u ms)\n", (uint32_t)((dataSize)/(now-last)), (uint32_t)(now-last));
-
-
-    last = neosd_clint_time_get_ms();
-    for (size_t i = 0; i < 32 * 1024 * 2; i++)
-        neosd_read_block(i*512);
-    now = neosd_clint_time_get_ms();
-    neorv32_uart0_printf("=> With individual reads: %u bit/s (%u ms)\n", (uint32_t)((dataSize)/(now-last)), (uint32_t)(now-last));
-    */
+    // Throughput measurements: see sw/example/bench_sd
 
     return 0;
 }
@@ -12,9 +12,133 @@
 
 /* Example: Declarations of the platform and disk functions in the project */
 #include <neosd_app.h>
+#include <neosd_stripe.h>
+
+/* Sequential reads are served from an open-ended CMD18 stream. The stream */
+/* is stopped on a non-sequential access, a write or CTRL_SYNC. A stream   */
+/* left idle for longer than DISK_STREAM_IDLE milliseconds is stopped by   */
+/* disk_close_idle, call it periodically from the main loop. A sequential  */
+/* read after a long pause still continues the stream.                     */
+#ifndef DISK_STREAM_IDLE
+#define DISK_STREAM_IDLE	100
+#endif
+
+/* Each drive is a controller of its own with NEOSD_MULTI: Drive 0 is     */
+/* neosd_dev0, attach the others with disk_attach. Without it, drive 0 is */
+/* the only controller. disk_attach_stripe makes a drive of several       */
+/* controllers, transferring chunks on all of them at the same time.      */
+
+/* Single sector accesses (FAT, directories, partial file sectors) go     */
+/* through a set associative write-back cache with LRU replacement.      */
+/* Sequential single sector reads are file data streamed by f_forward or */
+/* small f_reads, they go straight to the FatFs buffer.                  */
+/* Sectors in pinned ranges (see disk_cache_pin) are only replaced by    */
+/* other pinned sectors. The default 2 x 2 sectors (2 KiB) fit next to   */
+/* FatFs into 8 KiB DMEM. Set DISK_CACHE_SETS to 0 to disable the cache. */
+#ifndef DISK_CACHE_SETS
+#define DISK_CACHE_SETS		2	/* Number of sets, power of 2 */
+#endif
+#ifndef DISK_CACHE_WAYS
+#define DISK_CACHE_WAYS		2	/* Sectors per set */
+#endif
+#ifndef DISK_CACHE_PINS
+#define DISK_CACHE_PINS		2	/* Number of pinned sector ranges */
+#endif
+
+/* The driver moves whole words. Buffers at an address that is not a      */
+/* multiple of 4 (f_read / f_write of whole sectors into a user buffer)    */
+/* go through an aligned bounce buffer of DISK_BOUNCE_SECTORS sectors,     */
+/* word stores to them trap or are emulated on rv32i. Sequential reads     */
+/* keep the stream open across the chunks. Set DISK_BOUNCE_SECTORS to 0   */
+/* to save the buffer, unaligned buffers then fail with RES_PARERR.       */
+#ifndef DISK_BOUNCE_SECTORS
+#define DISK_BOUNCE_SECTORS	1
+#endif
+
+/* Writes return once the controller has the data, the card programs the  */
+/* last sector in the background (write-behind). The next access to the   */
+/* drive waits for it. CTRL_SYNC (f_sync, f_close) is the barrier and      */
+/* reports a failed background write. Costs a sector per drive, set       */
+/* DISK_WRITE_BEHIND to 0 to save it.                                     */
+#ifndef DISK_WRITE_BEHIND
+#define DISK_WRITE_BEHIND	1
+#endif
+
+#include <stdint.h>
+#include <string.h>
 
 extern "C"
 {
+#if DISK_BOUNCE_SECTORS
+	static uint32_t disk_bounce[DISK_BOUNCE_SECTORS * FF_MAX_SS / 4];
+#endif
+#if FF_FS_READONLY == 0 && DISK_WRITE_BEHIND
+	static uint32_t disk_behind[FF_VOLUMES][FF_MAX_SS / 4];	/* Sector programmed in the background */
+#endif
+	static LBA_t disk_next[FF_VOLUMES];	/* Sector following the last read + 1, 0: none */
+	static neosd_deadline_t disk_idle[FF_VOLUMES];	/* DISK_STREAM_IDLE from the last read */
+#if FF_USE_MKFS
+	static LBA_t disk_sectors[FF_VOLUMES];	/* Media size for GET_SECTOR_COUNT, 0: unknown */
+
+	/* The driver does not read the CSD, so f_mkfs gets the size from the application */
+	void disk_set_sectors (BYTE pdrv, LBA_t count)
+	{
+		if (pdrv < FF_VOLUMES)
+			disk_sectors[pdrv] = count;
+	}
+#endif
+
+#ifdef NEOSD_MULTI
+	static neosd_dev_t* disk_dev[FF_VOLUMES] = {&neosd_dev0};
+	static neosd_stripe_t* disk_stripe[FF_VOLUMES];
+
+	void disk_attach (BYTE pdrv, neosd_dev_t* dev)
+	{
+		disk_dev[pdrv] = dev;
+		disk_stripe[pdrv] = 0;
+	}
+
+	void disk_attach_stripe (BYTE pdrv, neosd_stripe_t* stripe)
+	{
+		disk_dev[pdrv] = stripe->dev[0];
+		disk_stripe[pdrv] = stripe;
+	}
+
+	/* Select the controller of a drive for the following driver calls */
+	static bool disk_select (BYTE pdrv)
+	{
+		if (pdrv >= FF_VOLUMES || !disk_dev[pdrv])
+			return false;
+		neosd_select(disk_dev[pdrv]);
+		return true;
+	}
+#else
+	static inline bool disk_select (BYTE pdrv)
+	{
+		return pdrv == 0;
+	}
+#endif
+
+#if DISK_CACHE_SETS
+	typedef struct {
+		uint32_t data[FF_MAX_SS / 4];
+		LBA_t sector;
+		DWORD stamp;		/* Time of last access for LRU */
+		BYTE pdrv;
+		BYTE valid;
+		BYTE dirty;
+		BYTE pinned;
+	} DISK_CACHE_LINE;
+
+	static DISK_CACHE_LINE disk_cache[DISK_CACHE_SETS][DISK_CACHE_WAYS];
+	static DWORD disk_cache_clock;
+	static struct {
+		LBA_t sector;
+		LBA_t count;
+		BYTE pdrv;
+	} disk_cache_pins[DISK_CACHE_PINS];
+	static DISK_CACHE_STATS disk_cache_stat;
+#endif
 
 	/*-----------------------------------------------------------------------*/
 	/* Get Drive Status                                                      */
@@ -22,7 +146,7 @@ extern "C"
 
 	DSTATUS disk_status (BYTE pdrv)
 	{
-		return 0;
+		return disk_select(pdrv) ? 0 : STA_NOINIT;
 	}
 
 
@@ -33,74 +157,443 @@ extern "C"
 
 	DSTATUS disk_initialize (BYTE pdrv)
 	{
+		if (!disk_select(pdrv))
+			return STA_NOINIT;
+		disk_idle[pdrv] = neosd_deadline_ms(DISK_STREAM_IDLE);
+#if FF_FS_READONLY == 0 && DISK_WRITE_BEHIND
+#ifdef NEOSD_MULTI
+		if (!disk_stripe[pdrv])
+#endif
+			neosd_app_use_write_behind(disk_behind[pdrv]);
+#endif
 		return 0;
 	}
 
 
 
 	/*-----------------------------------------------------------------------*/
-	/* Read Sector(s)                                                        */
+	/* Card Access                                                           */
 	/*-----------------------------------------------------------------------*/
 
-	DRESULT disk_read (BYTE pdrv, BYTE *buff, LBA_t sector,	UINT count)
+	static bool disk_sequential (BYTE pdrv, LBA_t sector)
+	{
+		return sector + 1 == disk_next[pdrv];
+	}
+
+	/* Keep the stream of the selected drive if it continues at sector, open */
+	/* one if asked to.                                                      */
+	static void stream_seek (BYTE pdrv, LBA_t sector, bool open)
 	{
-		for (size_t i = 0; i < count; i++)
+		if (neosd_app_stream_active() && sector != neosd_app_stream_next())
+			neosd_app_stream_close();
+
+		if (!neosd_app_stream_active() && open)
+			neosd_app_stream_open(sector);
+
+		/* Same timeout again, no division per read */
+		neosd_deadline_restart(&disk_idle[pdrv]);
+	}
+
+	/*-----------------------------------------------------------------------*/
+	/* Stop Idle Streams: Releases the card of drives that were not read for */
+	/* DISK_STREAM_IDLE ms. Call from the main loop, not from an interrupt.  */
+	/*-----------------------------------------------------------------------*/
+
+	void disk_close_idle (void)
+	{
+		for (BYTE pdrv = 0; pdrv < FF_VOLUMES; pdrv++)
 		{
-			if (!neosd_app_read_block(sector + i, (uint32_t*)(buff + 512 * i)))
-				return RES_ERROR;
+			if (!disk_select(pdrv))
+				continue;
+#ifdef NEOSD_MULTI
+			if (disk_stripe[pdrv])
+				continue;
+#endif
+			if (neosd_app_stream_active() && neosd_deadline_expired(&disk_idle[pdrv]))
+				neosd_app_stream_close();
+		}
+	}
+
+	static bool dev_aligned (const BYTE *buff)
+	{
+		return ((uintptr_t)buff & 3) == 0;
+	}
+
+	static DRESULT dev_read_words (BYTE pdrv, uint32_t *buff, LBA_t sector, UINT count, bool stream)
+	{
+		if (!disk_select(pdrv))
+			return RES_NOTRDY;
+#ifdef NEOSD_MULTI
+		if (disk_stripe[pdrv])
+			return neosd_stripe_read(disk_stripe[pdrv], sector, count, buff) ? RES_OK : RES_ERROR;
+#endif
+
+		stream_seek(pdrv, sector, stream);
+
+		bool ok;
+		if (neosd_app_stream_active())
+			ok = neosd_app_stream_read(count, buff);
+		else
+			ok = neosd_app_read_block(sector, buff);
+
+		if (!ok)
+		{
+			neosd_app_stream_close();
+			disk_next[pdrv] = 0;
+			return RES_ERROR;
+		}
+
+		disk_next[pdrv] = sector + count + 1;
+		return RES_OK;
+	}
+
+	static DRESULT dev_read (BYTE pdrv, BYTE *buff, LBA_t sector, UINT count)
+	{
+		/* Multi sector reads are file data, a sequential single sector read hints at streaming */
+		bool stream = count > 1 || disk_sequential(pdrv, sector);
+		if (dev_aligned(buff))
+			return dev_read_words(pdrv, (uint32_t*)buff, sector, count, stream);
+#if DISK_BOUNCE_SECTORS == 0
+		(void)stream;
+		return RES_PARERR;
+#else
+		for (UINT n; count != 0; sector += n, buff += n * FF_MAX_SS, count -= n)
+		{
+			n = count < DISK_BOUNCE_SECTORS ? count : DISK_BOUNCE_SECTORS;
+			DRESULT res = dev_read_words(pdrv, disk_bounce, sector, n, stream);
+			if (res != RES_OK)
+				return res;
+			memcpy(buff, disk_bounce, n * FF_MAX_SS);
 		}
+		return RES_OK;
+#endif
+	}
+
+	static DRESULT dev_write_words (BYTE pdrv, const uint32_t *buff, LBA_t sector, UINT count)
+	{
+		if (!disk_select(pdrv))
+			return RES_NOTRDY;
+#ifdef NEOSD_MULTI
+		if (disk_stripe[pdrv])
+			return neosd_stripe_write(disk_stripe[pdrv], sector, count, buff) ? RES_OK : RES_ERROR;
+#endif
+		if (!neosd_app_write_blocks(sector, count, buff))
+			return RES_ERROR;
 
 		return RES_OK;
 	}
 
+	static DRESULT dev_write (BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count)
+	{
+		if (dev_aligned(buff))
+			return dev_write_words(pdrv, (const uint32_t*)buff, sector, count);
+#if DISK_BOUNCE_SECTORS == 0
+		return RES_PARERR;
+#else
+		for (UINT n; count != 0; sector += n, buff += n * FF_MAX_SS, count -= n)
+		{
+			n = count < DISK_BOUNCE_SECTORS ? count : DISK_BOUNCE_SECTORS;
+			memcpy(disk_bounce, buff, n * FF_MAX_SS);
+			DRESULT res = dev_write_words(pdrv, disk_bounce, sector, n);
+			if (res != RES_OK)
+				return res;
+		}
+		return RES_OK;
+#endif
+	}
+
 
 
+#if DISK_CACHE_SETS
 	/*-----------------------------------------------------------------------*/
-	/* Write Sector(s)                                                       */
+	/* Sector Cache                                                          */
 	/*-----------------------------------------------------------------------*/
 
-	#if FF_FS_READONLY == 0
+	static bool cache_pinned (BYTE pdrv, LBA_t sector)
+	{
+		for (UINT i = 0; i < DISK_CACHE_PINS; i++)
+		{
+			if (disk_cache_pins[i].pdrv == pdrv && sector - disk_cache_pins[i].sector < disk_cache_pins[i].count)
+				return true;
+		}
+		return false;
+	}
+
+	static DISK_CACHE_LINE* cache_find (BYTE pdrv, LBA_t sector)
+	{
+		DISK_CACHE_LINE* set = disk_cache[sector & (DISK_CACHE_SETS - 1)];
+		for (UINT i = 0; i < DISK_CACHE_WAYS; i++)
+		{
+			if (set[i].valid && set[i].sector == sector && set[i].pdrv == pdrv)
+				return &set[i];
+		}
+		return 0;
+	}
+
+	/* Get the line to replace: Free lines first, then unpinned ones, then the least recently used. */
+	/* Returns 0 if an unpinned sector finds only pinned lines, the access then bypasses the cache.  */
+	static DISK_CACHE_LINE* cache_victim (LBA_t sector, bool pinned)
+	{
+		DISK_CACHE_LINE* set = disk_cache[sector & (DISK_CACHE_SETS - 1)];
+		DISK_CACHE_LINE* victim = 0;
+		for (UINT i = 0; i < DISK_CACHE_WAYS; i++)
+		{
+			DISK_CACHE_LINE* line = &set[i];
+			if (!line->valid)
+				return line;
+			if (line->pinned && !pinned)
+				continue;
+			if (!victim || (victim->pinned && !line->pinned) ||
+				(victim->pinned == line->pinned && (int32_t)(line->stamp - victim->stamp) < 0))
+				victim = line;
+		}
+		return victim;
+	}
+
+	static DRESULT cache_writeback (DISK_CACHE_LINE* line)
+	{
+		if (line->valid && line->dirty)
+		{
+			if (dev_write(line->pdrv, (const BYTE*)line->data, line->sector, 1) != RES_OK)
+				return RES_ERROR;
+			line->dirty = 0;
+			disk_cache_stat.writebacks++;
+		}
+		return RES_OK;
+	}
+
+	static DRESULT cache_flush (BYTE pdrv)
+	{
+		DRESULT res = RES_OK;
+		for (UINT i = 0; i < DISK_CACHE_SETS; i++)
+		{
+			for (UINT j = 0; j < DISK_CACHE_WAYS; j++)
+			{
+				if (disk_cache[i][j].pdrv == pdrv && cache_writeback(&disk_cache[i][j]) != RES_OK)
+					res = RES_ERROR;
+			}
+		}
+		return res;
+	}
+
+	/* Allocate a line for sector, writing back the replaced one. */
+	static DRESULT cache_alloc (BYTE pdrv, LBA_t sector, DISK_CACHE_LINE** line)
+	{
+		bool pinned = cache_pinned(pdrv, sector);
+		*line = cache_victim(sector, pinned);
+		if (!*line)
+			return RES_OK;
+
+		if (cache_writeback(*line) != RES_OK)
+			return RES_ERROR;
+		(*line)->valid = 0;
+		(*line)->sector = sector;
+		(*line)->pdrv = pdrv;
+		(*line)->pinned = pinned;
+		return RES_OK;
+	}
+
+	static DRESULT cache_read (BYTE pdrv, BYTE *buff, LBA_t sector)
+	{
+		DISK_CACHE_LINE* line = cache_find(pdrv, sector);
+		if (line)
+		{
+			disk_cache_stat.hits++;
+		}
+		else
+		{
+			disk_cache_stat.misses++;
+			if (cache_alloc(pdrv, sector, &line) != RES_OK)
+				return RES_ERROR;
+			if (!line)
+				return dev_read(pdrv, buff, sector, 1);
+
+			if (dev_read(pdrv, (BYTE*)line->data, sector, 1) != RES_OK)
+				return RES_ERROR;
+			line->valid = 1;
+		}
+
+		line->stamp = ++disk_cache_clock;
+		memcpy(buff, line->data, FF_MAX_SS);
+		return RES_OK;
+	}
+
+#if FF_FS_READONLY == 0
+	static DRESULT cache_write (BYTE pdrv, const BYTE *buff, LBA_t sector)
+	{
+		DISK_CACHE_LINE* line = cache_find(pdrv, sector);
+		if (!line)
+		{
+			if (cache_alloc(pdrv, sector, &line) != RES_OK)
+				return RES_ERROR;
+			if (!line)
+				return dev_write(pdrv, buff, sector, 1);
+			line->valid = 1;
+		}
+
+		memcpy(line->data, buff, FF_MAX_SS);
+		line->dirty = 1;
+		line->stamp = ++disk_cache_clock;
+		return RES_OK;
+	}
+#endif
+
+	/* Multi sector transfers bypass the cache. Reads take newer dirty sectors from */
+	/* the cache, writes refresh cached copies.                                    */
+	static void cache_bypass (BYTE pdrv, BYTE *buff, LBA_t sector, UINT count, bool write)
+	{
+		for (UINT i = 0; i < DISK_CACHE_SETS; i++)
+		{
+			for (UINT j = 0; j < DISK_CACHE_WAYS; j++)
+			{
+				DISK_CACHE_LINE* line = &disk_cache[i][j];
+				if (!line->valid || line->pdrv != pdrv || line->sector - sector >= count)
+					continue;
+
+				BYTE* ptr = buff + FF_MAX_SS * (line->sector - sector);
+				if (write)
+				{
+					memcpy(line->data, ptr, FF_MAX_SS);
+					line->dirty = 0;
+				}
+				else if (line->dirty)
+				{
+					memcpy(ptr, line->data, FF_MAX_SS);
+				}
+			}
+		}
+	}
+
+	/*-----------------------------------------------------------------------*/
+	/* Pin a range of sectors, e.g. the FAT, in the cache. A count of 0      */
+	/* removes all pinned ranges of the drive.                               */
+	/*-----------------------------------------------------------------------*/
 
-	DRESULT disk_write (
-		BYTE pdrv,			/* Physical drive nmuber to identify the drive */
-		const BYTE *buff,	/* Data to be written */
-		LBA_t sector,		/* Start sector in LBA */
-		UINT count			/* Number of sectors to write */
-	)
+	void disk_cache_pin (BYTE pdrv, LBA_t sector, LBA_t count)
 	{
-		DRESULT res;
-		int result;
+		for (UINT i = 0; i < DISK_CACHE_PINS; i++)
+		{
+			if (count == 0)
+			{
+				if (disk_cache_pins[i].pdrv == pdrv)
+					disk_cache_pins[i].count = 0;
+			}
+			else if (disk_cache_pins[i].count == 0)
+			{
+				disk_cache_pins[i].sector = sector;
+				disk_cache_pins[i].count = count;
+				disk_cache_pins[i].pdrv = pdrv;
+				break;
+			}
+		}
 
-		switch (pdrv) {
-		case DEV_RAM :
-			// translate the arguments here
+		for (UINT i = 0; i < DISK_CACHE_SETS; i++)
+		{
+			for (UINT j = 0; j < DISK_CACHE_WAYS; j++)
+				disk_cache[i][j].pinned = cache_pinned(disk_cache[i][j].pdrv, disk_cache[i][j].sector);
+		}
+	}
 
-			result = RAM_disk_write(buff, sector, count);
+	void disk_cache_stats (BYTE pdrv, DISK_CACHE_STATS* stats)
+	{
+		*stats = disk_cache_stat;
+	}
+#else
+	void disk_cache_pin (BYTE pdrv, LBA_t sector, LBA_t count)
+	{
+	}
 
-			// translate the reslut code here
+	void disk_cache_stats (BYTE pdrv, DISK_CACHE_STATS* stats)
+	{
+		memset(stats, 0, sizeof(*stats));
+	}
+#endif
 
-			return res;
 
-		case DEV_MMC :
-			// translate the arguments here
 
-			result = MMC_disk_write(buff, sector, count);
+	/*-----------------------------------------------------------------------*/
+	/* Read Sector(s)                                                        */
+	/*-----------------------------------------------------------------------*/
 
-			// translate the reslut code here
+	DRESULT disk_read (BYTE pdrv, BYTE *buff, LBA_t sector,	UINT count)
+	{
+#if DISK_CACHE_SETS
+		if (count == 1 && !disk_sequential(pdrv, sector))
+			return cache_read(pdrv, buff, sector);
+
+		DRESULT res = dev_read(pdrv, buff, sector, count);
+		if (res == RES_OK)
+			cache_bypass(pdrv, buff, sector, count, false);
+		return res;
+#else
+		return dev_read(pdrv, buff, sector, count);
+#endif
+	}
 
-			return res;
 
-		case DEV_USB :
-			// translate the arguments here
 
-			result = USB_disk_write(buff, sector, count);
+	/*-----------------------------------------------------------------------*/
+	/* Forward Sector(s): Pass the data words of count sectors to sink as    */
+	/* they are read from the card, without any sector buffer. For a         */
+	/* contiguous file (f_expand), forward the first sector with f_forward,  */
+	/* the following ones start at fp->sect + 1.                             */
+	/*-----------------------------------------------------------------------*/
 
-			// translate the reslut code here
+	DRESULT disk_forward (BYTE pdrv, LBA_t sector, UINT count, void (*sink)(void*, DWORD), void* user)
+	{
+		if (!disk_select(pdrv))
+			return RES_NOTRDY;
+#ifdef NEOSD_MULTI
+		if (disk_stripe[pdrv])
+			return RES_PARERR;
+#endif
+
+#if DISK_CACHE_SETS
+		/* The card has to hold the latest data */
+		for (UINT i = 0; i < DISK_CACHE_SETS; i++)
+		{
+			for (UINT j = 0; j < DISK_CACHE_WAYS; j++)
+			{
+				DISK_CACHE_LINE* line = &disk_cache[i][j];
+				if (line->pdrv == pdrv && line->sector - sector < count && cache_writeback(line) != RES_OK)
+					return RES_ERROR;
+			}
+		}
+#endif
 
-			return res;
+		stream_seek(pdrv, sector, true);
+		if (!neosd_app_stream_sink(count, sink, user))
+		{
+			neosd_app_stream_close();
+			disk_next[pdrv] = 0;
+			return RES_ERROR;
 		}
 
-		return RES_PARERR;
+		disk_next[pdrv] = sector + count + 1;
+		return RES_OK;
+	}
+
+
+
+	/*-----------------------------------------------------------------------*/
+	/* Write Sector(s)                                                       */
+	/*-----------------------------------------------------------------------*/
+
+	#if FF_FS_READONLY == 0
+
+	DRESULT disk_write (BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count)
+	{
+#if DISK_CACHE_SETS
+		if (count == 1)
+			return cache_write(pdrv, buff, sector);
+
+		DRESULT res = dev_write(pdrv, buff, sector, count);
+		if (res == RES_OK)
+			cache_bypass(pdrv, (BYTE*)buff, sector, count, true);
+		return res;
+#else
+		return dev_write(pdrv, buff, sector, count);
+#endif
 	}
 
 	#endif
@@ -112,6 +605,37 @@ extern "C"
 
 	DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void *buff)
 	{
-		return RES_PARERR;
+		switch (cmd)
+		{
+			// Write back the cache, then wait until the card programmed the last write
+			case CTRL_SYNC:
+			{
+				DRESULT res = RES_OK;
+#if DISK_CACHE_SETS
+				res = cache_flush(pdrv);
+#endif
+				if (!disk_select(pdrv) || !neosd_app_stream_close() || !neosd_app_write_sync())
+					res = RES_ERROR;
+#ifdef NEOSD_MULTI
+				/* Blocking fallbacks of a stripe can leave writes on each controller */
+				for (UINT i = 0; disk_stripe[pdrv] && i < NEOSD_STRIPE_WAYS; i++)
+				{
+					neosd_select(disk_stripe[pdrv]->dev[i]);
+					if (!neosd_app_write_sync())
+						res = RES_ERROR;
+				}
+#endif
+				return res;
+			}
+#if FF_USE_MKFS
+			case GET_SECTOR_COUNT:
+				if (pdrv >= FF_VOLUMES || disk_sectors[pdrv] == 0)
+					return RES_PARERR;
+				*(LBA_t*)buff = disk_sectors[pdrv];
+				return RES_OK;
+#endif
+			default:
+				return RES_PARERR;
+		}
 	}
 }
\ No newline at end of file
@@ -31,6 +31,45 @@ DSTATUS disk_status (BYTE pdrv);
 DRESULT disk_read (BYTE pdrv, BYTE* buff, LBA_t sector, UINT count);
 DRESULT disk_write (BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count);
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
+DRESULT disk_forward (BYTE pdrv, LBA_t sector, UINT count, void (*sink)(void*, DWORD), void* user);
+
+
+/*---------------------------------------*/
+/* Sector cache of the NEOSD glue        */
+
+typedef struct {
+	DWORD hits;			/* Single sector reads served from the cache */
+	DWORD misses;		/* Single sector reads forwarded to the card */
+	DWORD writebacks;	/* Dirty sectors written to the card */
+} DISK_CACHE_STATS;
+
+void disk_cache_pin (BYTE pdrv, LBA_t sector, LBA_t count);
+void disk_cache_stats (BYTE pdrv, DISK_CACHE_STATS* stats);
+
+
+/*---------------------------------------*/
+/* Read streams of the NEOSD glue        */
+
+void disk_close_idle (void);
+
+
+/*---------------------------------------*/
+/* Media size for f_mkfs of the NEOSD glue */
+
+#if FF_USE_MKFS
+void disk_set_sectors (BYTE pdrv, LBA_t count);
+#endif
+
+
+/*---------------------------------------*/
+/* Drive controllers (NEOSD_MULTI)       */
+
+#ifdef NEOSD_MULTI
+struct neosd_device;
+struct neosd_stripe;
+void disk_attach (BYTE pdrv, struct neosd_device* dev);
+void disk_attach_stripe (BYTE pdrv, struct neosd_stripe* stripe);
+#endif
 
 
 /* Disk Status Bits (DSTATUS) */
@@ -8,7 +8,9 @@
 / Function Configurations
 /---------------------------------------------------------------------------*/
 
+#ifndef FF_FS_READONLY
 #define FF_FS_READONLY	1
+#endif
 /* This option switches read-only configuration. (0:Read/Write or 1:Read-only)
 /  Read-only configuration removes writing API functions, f_write(), f_sync(),
 /  f_unlink(), f_mkdir(), f_chmod(), f_rename(), f_truncate(), f_getfree()
@@ -30,7 +32,9 @@
 /  f_findnext(). (0:Disable, 1:Enable 2:Enable with matching altname[] too) */
 
 
+#ifndef FF_USE_MKFS
 #define FF_USE_MKFS		0
+#endif
 /* This option switches f_mkfs(). (0:Disable or 1:Enable) */
 
 
@@ -52,7 +56,7 @@
 /  (0:Disable or 1:Enable) */
 
 
-#define FF_USE_FORWARD	0
+#define FF_USE_FORWARD	1
 /* This option switches f_forward(). (0:Disable or 1:Enable) */
 
 
@@ -178,7 +182,9 @@
 / Drive/Volume Configurations
 /---------------------------------------------------------------------------*/
 
+#ifndef FF_VOLUMES
 #define FF_VOLUMES		1
+#endif
 /* Number of volumes (logical drives) to be used. (1-10) */
 
 
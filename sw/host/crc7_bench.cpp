@@ -0,0 +1,68 @@
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "neosd.h"
+
+/*
+* Compares the CRC7 variants: Checks that they agree with each other and with
+* the compile-time command words, then reports ns per command (5 bytes) and
+* per R2 response (15 bytes). Returns non-zero on mismatch.
+*/
+
+// CMD0 is sent as 40 00 00 00 00 95
+static_assert(neosd_crc7_bits(0x4000000000ull, 39) == 0x4A, "CRC7 of CMD0");
+
+typedef uint8_t (*crc7_fn)(const uint8_t* data, size_t length);
+
+static const struct {
+    const char* name;
+    crc7_fn fn;
+} variants[] = {
+    {"bitwise", neosd_crc7_bitwise},
+    {"nibble", neosd_crc7_nibble},
+    {"table", neosd_crc7_table},
+};
+
+static uint8_t data[4096 + 16];
+
+static double measure(crc7_fn fn, size_t length)
+{
+    const size_t runs = 64;
+    volatile uint8_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < runs; r++)
+    {
+        for (size_t i = 0; i < 4096; i++)
+            sink = sink ^ fn(&data[i], length);
+    }
+    std::chrono::duration<double, std::nano> ns = std::chrono::steady_clock::now() - start;
+    return ns.count() / (runs * 4096);
+}
+
+int main()
+{
+    srand(1);
+    for (size_t i = 0; i < sizeof(data); i++)
+        data[i] = rand();
+
+    bool ok = true;
+    for (size_t i = 0; i < 4096; i++)
+    {
+        for (const auto& v : variants)
+            ok &= v.fn(&data[i], 5) == neosd_crc7_bitwise(&data[i], 5) &&
+                v.fn(&data[i], 15) == neosd_crc7_bitwise(&data[i], 15);
+
+        SD_CMD_IDX cmd = (SD_CMD_IDX)(data[i] & 0x3F);
+        uint32_t arg = data[i + 1] | (data[i + 2] << 8) | (data[i + 3] << 16) | ((uint32_t)data[i + 4] << 24);
+        uint32_t word = neosd_cmd_word(cmd, arg, NEOSD_RMODE_SHORT, NEOSD_DMODE_NONE);
+        ok &= ((word >> NEOSD_CMD_CRC_LSB) & 0x7F) == neosd_cmd_crc(cmd, arg);
+    }
+
+    printf("variant,ns_cmd,ns_r2\n");
+    for (const auto& v : variants)
+        printf("%s,%.2f,%.2f\n", v.name, measure(v.fn, 5), measure(v.fn, 15));
+
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? 0 : 1;
+}
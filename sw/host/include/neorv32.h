@@ -0,0 +1,31 @@
+#pragma once
+
+/*
+* The parts of the NEORV32 HAL used by the driver, for host builds.
+* Time and mcycle are the virtual system clock of the attached backend.
+* There is no instruction count, minstret counts register accesses instead.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    uint64_t neorv32_clint_time_get(void);
+    uint32_t neorv32_sysinfo_get_clk(void);
+    uint64_t neorv32_cpu_get_cycle(void);
+    uint64_t neorv32_cpu_get_instret(void);
+
+    enum { CSR_MCYCLE = 0xB00 };
+    static inline uint32_t neorv32_cpu_csr_read(int csr) { return csr == CSR_MCYCLE ? neorv32_cpu_get_cycle() : 0; }
+
+    static inline void neorv32_rte_setup(void) {}
+    static inline void neorv32_uart0_setup(uint32_t, uint32_t) {}
+
+    #define neorv32_uart0_printf printf
+
+#ifdef __cplusplus
+}
+#endif
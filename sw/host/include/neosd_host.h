@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+* Host build of the driver (NEOSD_HOST): Register accesses are forwarded to a
+* backend instead of MMIO, so the unmodified driver runs against a model.
+*/
+
+// Something that implements the NEOSD register interface
+class neosd_host_backend
+{
+public:
+    virtual ~neosd_host_backend() = default;
+
+    virtual uint32_t read(uint32_t addr) = 0;
+    virtual void write(uint32_t addr, uint32_t data) = 0;
+    // System clock cycles since start, this is the CLINT time
+    virtual uint64_t cycles() = 0;
+    // System clock in Hz
+    virtual uint32_t clock() = 0;
+    // Let time pass until cycles if the backend is behind, returns its time. Keeps several
+    // controllers on the clock of the one CPU accessing them.
+    virtual uint64_t sync(uint64_t cycles) { return cycles; }
+};
+
+// Backend of controller dev, registers at neosd_host_regs[dev]. Controller 0 is the
+// time base: CLINT, mcycle and driver timeouts.
+void neosd_host_attach(neosd_host_backend* backend, unsigned dev = 0);
+neosd_host_backend* neosd_host_get(unsigned dev = 0);
+
+// Register accesses through the attached backend, counted for benchmarks
+uint32_t neosd_host_read(uint32_t addr);
+void neosd_host_write(uint32_t addr, uint32_t data);
+uint64_t neosd_host_accesses();
+
+// A single register. Behaves like a volatile uint32_t for the driver.
+class neosd_host_reg
+{
+public:
+    explicit constexpr neosd_host_reg(uint32_t addr) : addr(addr) {}
+    neosd_host_reg(const neosd_host_reg&) = delete;
+    neosd_host_reg& operator=(const neosd_host_reg&) = delete;
+
+    operator uint32_t() const { return neosd_host_read(addr); }
+    neosd_host_reg& operator=(uint32_t data) { neosd_host_write(addr, data); return *this; }
+    neosd_host_reg& operator|=(uint32_t data) { return *this = (uint32_t)*this | data; }
+    neosd_host_reg& operator&=(uint32_t data) { return *this = (uint32_t)*this & data; }
+    // Bits 11:8 select the backend
+    uint32_t address() const { return addr; }
+
+private:
+    const uint32_t addr;
+};
+
+typedef neosd_host_reg neosd_reg_t;
+
+// Register proxies of one controller. Bits 11:8 of the addresses select the backend.
+struct neosd_t {
+    explicit constexpr neosd_t(uint32_t base) : INFO(base + 0x00), CTRL(base + 0x04), CMDARG(base + 0x08),
+        CMD(base + 0x0C), RESP(base + 0x10), DATA(base + 0x14), STATUS(base + 0x18), FLAGS(base + 0x1C),
+        BLKCNT(base + 0x20), FIFO(base + 0x24) {}
+
+    neosd_host_reg INFO;
+    neosd_host_reg CTRL;
+    neosd_host_reg CMDARG;
+    neosd_host_reg CMD;
+    neosd_host_reg RESP;
+    neosd_host_reg DATA;
+    neosd_host_reg STATUS;
+    neosd_host_reg FLAGS;
+    neosd_host_reg BLKCNT;
+    neosd_host_reg FIFO;
+};
+
+// Controllers the host build can attach backends for
+#define NEOSD_HOST_DEVICES 4
+
+extern neosd_t neosd_host_regs[NEOSD_HOST_DEVICES];
+
+#define NEOSD_DEV0_REGS (&neosd_host_regs[0])
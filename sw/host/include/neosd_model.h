@@ -0,0 +1,139 @@
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include "neosd.h"
+#include "neosd_host.h"
+#include "sd_card_model.h"
+
+/*
+* Behavioral model of the NEOSD controller (rtl/neosd_top.sv).
+*
+* Time only advances with register accesses, each costing access_cycles
+* system clocks. The command and data FSMs are stepped once per clock strobe
+* like in the RTL, so response / data flags, the clock stall while a word is
+* not acknowledged and the timing on the SD bus match the hardware.
+* fifo_depth_log2 is the FIFO_DEPTH_LOG2 parameter of the RTL.
+*
+* A DMA channel triggered by flag_data_o can be attached to the DATA register,
+* the driver uses it through neosd_model_dma (neosd_set_dma). It moves one
+* word per request after the clock strobe that raised it, each costing
+* access_cycles of bus time like a CPU access.
+*/
+class neosd_model : public neosd_host_backend
+{
+public:
+    neosd_model(sd_card_model& card, uint32_t clk_hz, uint32_t access_cycles, unsigned fifo_depth_log2 = 4);
+
+    uint32_t read(uint32_t addr) override;
+    void write(uint32_t addr, uint32_t data) override;
+    uint64_t cycles() override;
+    uint32_t clock() override { return clk_hz; }
+    uint64_t sync(uint64_t cycles) override;
+
+    // Let time pass without register accesses
+    void delay(uint64_t cycles);
+    // DMA channel: Move words between DATA and mem, write: mem to DATA
+    void dma_start(uint32_t* mem, size_t words, bool write);
+    void dma_stop();
+    // Words moved by the DMA channel
+    uint64_t dma_words() const { return dma.moved; }
+    bool irq() const;
+    bool flag_data() const;
+    // SD clocks sent to the card
+    uint64_t sd_clocks() const { return card.stats().clocks; }
+
+private:
+    void run();
+    void tick();
+    void tick_cmd(bool en);
+    void tick_dat(bool en, bool start);
+    uint32_t strobe_period() const;
+    uint32_t status() const;
+    void clear_flags(uint32_t mask);
+    uint32_t data_read();
+    void data_write(uint32_t data);
+    bool fifo_mode() const;
+    bool flag_data_level() const;
+    uint8_t dat_visible() const;
+    bool cmd_visible() const;
+
+    sd_card_model& card;
+    uint32_t clk_hz;
+    uint32_t access_cycles;
+    uint64_t now = 0;
+    uint64_t next_strobe = 0;
+
+    // CTRL configuration and masks, CMD modes
+    uint32_t ctrl = 0;
+    bool crcerr = false, resp_crcerr = false;
+    bool flag_cmd_resp = false, flag_dat_data = false, flag_cmd_done = false;
+    bool flag_dat_done = false, flag_blk_done = false;
+    bool cmd_commit = false, cmd_abrt = false, auto_crc = false;
+    // CMDARG written, CMD not yet. The CMD12 of the block counter waits for the command.
+    bool cmdarg_pend = false;
+    uint8_t dmode = 0, rmode = 0;
+    // FIFO direction, latched on data command commit. CMD12 and dataless commands keep it.
+    bool fifo_write = false;
+
+    // Block counter, CMD12 waiting for the command FSM
+    uint32_t blkcnt = 0;
+    bool blkcnt_cmd12 = false, autostop = false;
+    // Stop without CMD12, survives commits of dataless commands
+    bool blkcnt_abrt = false;
+
+    // DMA channel, earliest cycle of its next bus access
+    struct {
+        uint32_t* mem = nullptr;
+        size_t words = 0;
+        bool write = false;
+        uint64_t ready = 0;
+        uint64_t moved = 0;
+    } dma;
+
+    // Data FIFO, words as in the data register
+    std::deque<uint32_t> fifo;
+    size_t fifo_depth;
+    unsigned fifo_depth_log2;
+    uint16_t fifo_wm = 1;
+
+    // Command FSM, 48 bit shift register and CRC7 generator / checker
+    enum { CMD_IDLE, CMD_WRITE, CMD_WAIT_RESP, CMD_READ_RESP, CMD_REGOUT, CMD_TAIL };
+    struct {
+        int state;
+        unsigned bit_counter, word_counter;
+        bool clk_req, clk_stall, cmd_oe, start_dat;
+        bool rx, resp_done;
+        unsigned rx_counter;
+    } cmd = {};
+    uint64_t cmd_reg = 0;
+    uint8_t cmd_crc = 0;
+
+    // Data FSM and its data / CRC registers
+    enum {
+        DAT_IDLE, DAT_WAIT_BLOCK, DAT_READ_BLOCK, DAT_REGOUT, DAT_READ_CRC, DAT_READ_FINISH, DAT_TAIL,
+        DAT_WAIT_BUSY, DAT_WRITE_REGIN, DAT_WRITE_START, DAT_WRITE_DATA, DAT_WRITE_CRC, DAT_WRITE_STOP,
+        DAT_WRITE_CHECK_CRC, DAT_WRITE_BUSY, DAT_WRITE_TAIL
+    };
+    // Output mux: '0', '1', data, CRC
+    enum { OMUX_ZERO, OMUX_ONE, OMUX_DATA, OMUX_CRC };
+    struct {
+        int state;
+        unsigned bit_counter, word_counter;
+        bool clk_req, clk_stall, dat_oe, write_start, crc_ok, block_done;
+        // Read direction, word for the FIFO completed without stalling
+        bool rnw, word;
+        int omux;
+    } dat = {};
+    uint32_t data_reg = 0;
+    unsigned data_pos = 0, crc_pos = 0;
+    uint16_t crc[4] = {0};
+    uint8_t token = 0;
+
+    // Last sampled bus state
+    bool cmd_line = true;
+    uint8_t dat_line = 0xF;
+};
+
+// DMA hook driving the channel of the model behind the selected controller
+extern const neosd_dma_t neosd_model_dma;
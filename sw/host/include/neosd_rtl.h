@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include "neosd_host.h"
+#include "sd_card_model.h"
+
+class Vneosd;
+
+/*
+* The Verilated RTL (rtl/neosd_top.sv) as register backend.
+*
+* Register accesses are Wishbone cycles after access_cycles idle system
+* clocks, so driver and hardware run together cycle by cycle. The card model
+* is clocked on each falling edge of sd_clk_o, when the RTL samples and
+* updates its outputs one system clock later.
+*/
+class neosd_rtl : public neosd_host_backend
+{
+public:
+    neosd_rtl(sd_card_model& card, uint32_t clk_hz, uint32_t access_cycles);
+    ~neosd_rtl();
+
+    uint32_t read(uint32_t addr) override;
+    void write(uint32_t addr, uint32_t data) override;
+    uint64_t cycles() override;
+    uint32_t clock() override { return clk_hz; }
+
+    // Let time pass without register accesses
+    void delay(uint64_t cycles);
+    bool irq() const;
+    bool flag_data() const;
+    // SD clocks sent to the card
+    uint64_t sd_clocks() const { return card.stats().clocks; }
+
+private:
+    void step();
+    uint32_t bus(uint32_t addr, uint32_t data, bool we);
+
+    Vneosd* top;
+    sd_card_model& card;
+    uint32_t clk_hz;
+    uint32_t access_cycles;
+    uint64_t now = 0;
+    bool sd_clk_last = false;
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <deque>
+#include <vector>
+
+/*
+* Pin level model of an SDHC card in SD bus mode, serving a disk image file.
+*
+* clock() is called once per SD clock with the host outputs of the previous
+* clock. The card outputs for this clock are available afterwards, as if the
+* card drives on the falling edge and the host samples on the next rising edge.
+*/
+class sd_card_model
+{
+public:
+    struct timing_t {
+        // Clocks from command end bit to response start bit (N_CR)
+        unsigned ncr = 2;
+        // Clocks from command end bit / block end bit to the next read block (N_AC)
+        unsigned nac = 2;
+        // Busy clocks after a written block and for R1b responses
+        unsigned busy = 16;
+        // ACMD41 calls until power up is done
+        unsigned acmd41 = 1;
+    };
+
+    struct stats_t {
+        uint64_t clocks;
+        uint64_t commands;
+        uint64_t blocks_read;
+        uint64_t blocks_written;
+        uint64_t crc_errors;
+        // Data blocks given a CRC error by inject_crc_errors
+        uint64_t injected;
+    };
+
+    // The image is created with size bytes if it does not exist
+    sd_card_model(const char* image, uint64_t size, const timing_t& timing);
+    ~sd_card_model();
+    bool ok() const { return file != nullptr; }
+    uint64_t blocks() const { return size / 512; }
+
+    // Host outputs, dat bits 3:0 are DAT3..DAT0
+    void clock(bool cmd_oe, bool cmd_o, uint8_t dat_oe, uint8_t dat_o);
+    bool cmd() const { return cmd_out; }
+    uint8_t dat() const { return dat_out; }
+
+    const stats_t& stats() const { return stat; }
+
+    // Give every nth read or written data block a CRC error, 0: none
+    void inject_crc_errors(unsigned every) { crc_every = every; crc_count = 0; }
+
+private:
+    enum state_t { IDLE = 0, READY = 1, IDENT = 2, STBY = 3, TRAN = 4, DATA = 5, RCV = 6, PRG = 7 };
+
+    void command(uint8_t idx, uint32_t arg);
+    void respond(uint8_t idx, uint32_t payload);
+    void respond_long(const uint8_t* reg);
+    void respond_r1(uint8_t idx, bool busy);
+    void queue_block(const uint8_t* data, size_t length, bool bad_crc = false);
+    void queue_busy(unsigned clocks);
+    bool inject_crc();
+    void receive(uint8_t dat);
+    void read_image(uint64_t block, uint8_t* data);
+    void write_image(uint64_t block, const uint8_t* data);
+
+    FILE* file;
+    uint64_t size;
+    timing_t timing;
+    stats_t stat = {};
+
+    // Card state
+    state_t state = IDLE;
+    bool app_cmd = false;
+    bool ready = false;
+    bool d4 = false;
+    bool hs = false;
+    unsigned acmd41_calls = 0;
+    uint16_t rca = 0;
+    uint32_t status_err = 0;
+    uint32_t block_count = 0;
+
+    // Command receiver
+    uint64_t cmd_shift = 0;
+    unsigned cmd_bits = 0;
+
+    // Queued line outputs, one entry per clock
+    std::deque<bool> cmd_queue;
+    std::deque<uint8_t> dat_queue;
+    bool cmd_out = true;
+    uint8_t dat_out = 0xF;
+
+    // Read blocks: Next block and remaining blocks, 0 = until CMD12
+    bool rd_active = false;
+    uint64_t rd_block = 0;
+    uint32_t rd_left = 0;
+
+    // Write blocks
+    bool wr_active = false;
+    bool wr_rx = false;
+    bool wr_discard = false;
+    uint64_t wr_block = 0;
+    uint32_t wr_left = 0;
+    std::vector<uint8_t> wr_units;
+
+    // CRC error injection
+    unsigned crc_every = 0;
+    unsigned crc_count = 0;
+};
@@ -0,0 +1,792 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "neosd.h"
+#include "neosd_app.h"
+#include "neosd_irq.h"
+#include "neosd_stripe.h"
+#include "neosd_model.h"
+#include "ff.h"
+#include "diskio.h"
+
+/*
+* Runs the unmodified driver against the controller and card models:
+* Card initialization, a write / read roundtrip on the last blocks of the
+* image and read throughput in virtual time. Returns non-zero on failure.
+* Built with NEOSD_MULTI, -j adds a second controller and card as drive 1.
+*/
+
+static neosd_model* model;
+
+static double elapsed_us(uint64_t start)
+{
+    return (model->cycles() - start) * 1e6 / model->clock();
+}
+
+static bool roundtrip(size_t block, size_t count)
+{
+    static uint32_t wbuf[64 * 128], rbuf[64 * 128], save[64 * 128];
+
+    bool ok = count == 1 ? neosd_app_read_block(block, save) : neosd_app_read_blocks(block, count, save);
+    for (size_t i = 0; i < count * 128; i++)
+        wbuf[i] = (block << 16) ^ (i * 0x9E3779B9);
+
+    ok = ok && (count == 1 ? neosd_app_write_block(block, wbuf) : neosd_app_write_blocks(block, count, wbuf));
+    ok = ok && (count == 1 ? neosd_app_read_block(block, rbuf) : neosd_app_read_blocks(block, count, rbuf));
+    ok = ok && memcmp(wbuf, rbuf, count * 512) == 0;
+
+    // Stream the same blocks in two parts
+    memset(rbuf, 0, sizeof(rbuf));
+    neosd_app_stream_open(block);
+    ok = ok && neosd_app_stream_read(count / 2 + 1, rbuf);
+    ok = ok && (count < 2 || neosd_app_stream_read(count - count / 2 - 1, rbuf + (count / 2 + 1) * 128));
+    ok = neosd_app_stream_close() && ok;
+    ok = ok && memcmp(wbuf, rbuf, count * 512) == 0;
+
+    ok = ok && (count == 1 ? neosd_app_write_block(block, save) : neosd_app_write_blocks(block, count, save));
+    printf("Roundtrip %3u block(s) at %u: %s\n", (unsigned)count, (unsigned)block, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+struct forward_ctx
+{
+    uint32_t* ptr;
+};
+
+static void forward_sink(void* user, uint32_t word)
+{
+    forward_ctx* ctx = (forward_ctx*)user;
+    *ctx->ptr++ = word;
+}
+
+// Stream and FatFs forward reads against a buffered read of the same blocks
+static bool forward(size_t block, size_t count)
+{
+    static uint32_t ref[64 * 128], buf[64 * 128];
+
+    bool ok = neosd_app_read_blocks(block, count, ref);
+
+    forward_ctx ctx = {buf};
+    memset(buf, 0, sizeof(buf));
+    neosd_app_stream_open(block);
+    ok = ok && neosd_app_stream_sink(1, forward_sink, &ctx);
+    ok = ok && neosd_app_stream_sink(count - 1, forward_sink, &ctx);
+    ok = neosd_app_stream_close() && ok;
+    ok = ok && ctx.ptr == buf + count * 128 && memcmp(ref, buf, count * 512) == 0;
+
+    ctx.ptr = buf;
+    memset(buf, 0, sizeof(buf));
+    ok = ok && disk_forward(0, block, count, forward_sink, &ctx) == RES_OK;
+    ok = ok && ctx.ptr == buf + count * 128 && memcmp(ref, buf, count * 512) == 0;
+
+    printf("Forward %3u block(s) at %u: %s\n", (unsigned)count, (unsigned)block, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// Sequential disk_read calls continue one CMD18 stream, disk_close_idle stops it after a pause
+// longer than DISK_STREAM_IDLE (100 ms)
+static bool stream_idle(size_t sector)
+{
+    static uint32_t buf[2 * 128];
+
+    bool ok = disk_initialize(0) == 0;
+    ok = ok && disk_read(0, (BYTE*)buf, sector, 2) == RES_OK && disk_read(0, (BYTE*)buf, sector + 2, 1) == RES_OK;
+    ok = ok && neosd_app_stream_active() && neosd_app_stream_next() == sector + 3;
+
+    disk_close_idle();
+    ok = ok && neosd_app_stream_active();
+    // Without disk_close_idle, a read after the pause still continues the stream
+    model->delay(model->clock() / 5);
+    ok = ok && disk_read(0, (BYTE*)buf, sector + 3, 1) == RES_OK && neosd_app_stream_next() == sector + 4;
+    model->delay(model->clock() / 5);
+    disk_close_idle();
+    ok = ok && !neosd_app_stream_active();
+
+    printf("Stream idle close at %u: %s\n", (unsigned)sector, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// Interrupt driven transfer, polling the handler. Like the stripe code, a failed transfer (CRC
+// error) is repeated by the blocking driver, which retries.
+static bool irq_transfer(size_t block, size_t count, uint32_t* buf, bool write)
+{
+    neosd_xfer_t xfer;
+    if (write)
+        neosd_xfer_write(&xfer, block, count, buf);
+    else
+        neosd_xfer_read(&xfer, block, count, buf);
+    if (!neosd_irq_submit(&xfer, nullptr, nullptr))
+        return false;
+    while (neosd_irq_busy())
+        neosd_irq_handler();
+    if (xfer.state == NEOSD_XFER_DONE)
+        return !write || neosd_app_write_sync();
+    return write ? neosd_app_write_blocks(block, count, buf) : neosd_app_read_blocks(block, count, buf);
+}
+
+// The same transfers with the data words moved by the DMA channel of the model: Blocking
+// reads (CMD17 / CMD18), writes and a stream, then an interrupt driven write and read
+static bool dma_roundtrip(size_t block, size_t count)
+{
+    static uint32_t wbuf[64 * 128], rbuf[64 * 128];
+
+    uint64_t words = model->dma_words();
+    neosd_set_dma(&neosd_model_dma);
+    bool ok = roundtrip(block, 1) && roundtrip(block, count);
+    // Without the block counter of 0.4.0, the driver stops multi-block reads itself and discards
+    // the word following the last block. Once with CMD12, once with CMD23.
+    bool cmd23 = neosd_app_use_cmd23(false);
+    neosd_dev0.blkcnt = false;
+    ok = ok && roundtrip(block + 1, count);
+    neosd_app_use_cmd23(cmd23);
+    ok = ok && roundtrip(block + 1, count);
+    neosd_dev0.blkcnt = true;
+
+    ok = ok && neosd_app_read_blocks(block, count, wbuf);
+    for (size_t i = 0; i < count * 128; i++)
+        wbuf[i] ^= 0xA5A5A5A5;
+    ok = ok && irq_transfer(block, count, wbuf, true);
+    memset(rbuf, 0, sizeof(rbuf));
+    ok = ok && irq_transfer(block, count, rbuf, false) && memcmp(wbuf, rbuf, count * 512) == 0;
+
+    for (size_t i = 0; i < count * 128; i++)
+        wbuf[i] ^= 0xA5A5A5A5;
+    ok = ok && neosd_app_write_blocks(block, count, wbuf);
+    neosd_set_dma(nullptr);
+
+    // Five passes over the blocks per roundtrip, four around the interrupt driven transfers.
+    // Retries move more.
+    words = model->dma_words() - words;
+    ok = ok && words >= 128 * (5 * (1 + 3 * count) + 4 * count);
+    printf("DMA roundtrip %3u block(s) at %u, %llu words by DMA: %s\n", (unsigned)count, (unsigned)block,
+        (unsigned long long)words, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// Counted write with the automatic CMD12 and a CMD13 while the blocks are sent. The CMD13 write
+// must not turn the CMD12 into R1, the data FSM stays busy until the card released DAT0.
+static bool autostop_busy(const sd_card_model& card, size_t block)
+{
+    static uint32_t wbuf[2 * 128], rbuf[2 * 128], save[2 * 128];
+    const uint32_t flags = (1 << NEOSD_CTRL_FLAG_CMD_DONE) | (1 << NEOSD_CTRL_FLAG_DAT_DONE) |
+        (1 << NEOSD_CTRL_FLAG_BLK_DONE);
+    neosd_res_t res;
+    sd_status_t status = {};
+
+    bool ok = neosd_app_read_blocks(block, 2, save);
+    for (size_t i = 0; i < 2 * 128; i++)
+        wbuf[i] = (block << 12) ^ (i * 0x9E3779B9);
+
+    neosd_ack(flags);
+    model->dma_start(wbuf, 2 * 128, true);
+    ok = ok && neosd_set_block_count(2, true);
+    neosd_cmd_commit((SD_CMD_IDX)25, block, NEOSD_RMODE_SHORT, NEOSD_DMODE_WRITE);
+    ok = ok && neosd_cmd_wait_res(&res, NEOSD_CMD_TIMEOUT);
+    ok = ok && neosd_app_card_status(&status) == NEOSD_OK;
+
+    // CMD_DONE of the CMD12, then the busy wait
+    uint64_t deadline = model->cycles() + 1000000;
+    uint32_t flags_set = 0;
+    while (ok && model->cycles() < deadline &&
+        (!(flags_set & (1 << NEOSD_CTRL_FLAG_CMD_DONE)) || (neosd_busy() & 2)))
+    {
+        uint32_t irq = neosd_status();
+        if (irq & (1 << NEOSD_CTRL_FLAG_CMD_RESP))
+            neosd_discard(NEOSD->RESP);
+        flags_set |= irq;
+    }
+    bool released = (card.dat() & 1) != 0;
+    ok = ok && released && model->cycles() < deadline;
+    neosd_ack(flags);
+    model->dma_stop();
+
+    ok &= neosd_app_card_status(&status) == NEOSD_OK;
+    unsigned state = (status._raw >> SD_STATUS_CURRENT_STATE) & 0xF;
+    ok = ok && state == 4;
+    ok = ok && neosd_app_read_blocks(block, 2, rbuf) && memcmp(wbuf, rbuf, sizeof(rbuf)) == 0;
+    ok = ok && neosd_app_write_blocks(block, 2, save) && neosd_app_write_sync();
+    printf("Auto CMD12 after CMD13 at %u: %s, DAT0 %s, card state %u\n", (unsigned)block, ok ? "ok" : "FAILED",
+        released ? "released" : "busy", state);
+    return ok;
+}
+
+// Counted single block read with the automatic CMD12, then a CMD13 while the CMD12 is pending. The
+// CMD13 is written right around the acknowledge of CMD_DONE of the CMD18, which lets the CMD12 go.
+// The CMD13 goes first, the CMD12 follows once its CMD_DONE is acknowledged.
+static bool autostop_cmd13(const sd_card_model& card, size_t block)
+{
+    static uint32_t rbuf[2 * 128], expect[128];
+    const uint32_t flags = (1 << NEOSD_CTRL_FLAG_CMD_DONE) | (1 << NEOSD_CTRL_FLAG_DAT_DONE) |
+        (1 << NEOSD_CTRL_FLAG_BLK_DONE);
+    uint32_t arg = neosd_dev->card.rca << 16;
+    uint32_t word = neosd_cmd_word((SD_CMD_IDX)13, arg, NEOSD_RMODE_SHORT, NEOSD_DMODE_NONE);
+    neosd_res_t res;
+
+    bool ok = neosd_app_read_blocks(block, 1, expect);
+    uint64_t commands = card.stats().commands;
+    memset(rbuf, 0, sizeof(rbuf));
+    neosd_ack(flags);
+    model->dma_start(rbuf, 2 * 128, false);
+    ok = ok && neosd_set_block_count(1, true);
+    neosd_cmd_commit((SD_CMD_IDX)18, block, NEOSD_RMODE_SHORT, NEOSD_DMODE_READ);
+
+    // CMD_DONE of the CMD18 holds the CMD12 back until the block is done
+    uint64_t deadline = model->cycles() + 200000;
+    uint32_t irq = 0;
+    const uint32_t held = (1 << NEOSD_CTRL_FLAG_CMD_DONE) | (1 << NEOSD_CTRL_FLAG_BLK_DONE);
+    while (model->cycles() < deadline && (irq & held) != held)
+    {
+        irq = neosd_status();
+        if (irq & (1 << NEOSD_CTRL_FLAG_CMD_RESP))
+            neosd_discard(NEOSD->RESP);
+    }
+    NEOSD->CMDARG = arg;
+    neosd_ack(1 << NEOSD_CTRL_FLAG_CMD_DONE);
+    NEOSD->CMD = word;
+    ok = ok && neosd_cmd_wait_res(&res, NEOSD_CMD_TIMEOUT);
+    unsigned state = (res.rshort.r1.status >> SD_STATUS_CURRENT_STATE) & 0xF;
+
+    // CMD_DONE of the CMD12, then the end of the stopped transfer
+    uint32_t flags_set = 0;
+    while (ok && model->cycles() < deadline &&
+        (!(flags_set & (1 << NEOSD_CTRL_FLAG_CMD_DONE)) || (neosd_busy() & 2)))
+    {
+        irq = neosd_status();
+        if (irq & (1 << NEOSD_CTRL_FLAG_CMD_RESP))
+            neosd_discard(NEOSD->RESP);
+        flags_set |= irq;
+    }
+    neosd_ack(flags);
+    model->dma_stop();
+
+    commands = card.stats().commands - commands;
+    ok = ok && model->cycles() < deadline && commands == 3 && state == 5;
+    ok = ok && NEOSD->BLKCNT == (1u << NEOSD_BLKCNT_AUTO_CMD12) && memcmp(expect, rbuf, 512) == 0;
+    printf("CMD13 before the auto CMD12 at %u: %s, card state %u, %u commands\n", (unsigned)block,
+        ok ? "ok" : "FAILED", state, (unsigned)commands);
+    return ok;
+}
+
+static uint32_t behind_copy[128];
+
+// Write-behind: The call returns while the card programs the last block. The driver keeps its
+// own copy for a retry, so the buffer is overwritten right away.
+static bool write_behind(size_t block, size_t count)
+{
+    static uint32_t wbuf[64 * 128], rbuf[64 * 128], save[64 * 128], expect[64 * 128];
+
+    bool ok = neosd_app_read_blocks(block, count, save);
+    for (size_t i = 0; i < count * 128; i++)
+        wbuf[i] = expect[i] = (block << 12) ^ (i * 0x7F4A7C15);
+
+    ok &= neosd_app_use_write_behind(behind_copy);
+    ok = ok && neosd_app_write_blocks(block, count, wbuf);
+    bool pending = neosd_app_write_pending();
+    memset(wbuf, 0, sizeof(wbuf));
+
+    // CMD13 has no data, the card answers while it still receives or programs
+    sd_status_t status = {};
+    ok = ok && neosd_app_card_status(&status) == NEOSD_OK;
+    unsigned state = (status._raw >> SD_STATUS_CURRENT_STATE) & 0xF;
+
+    // The read waits for the write
+    ok = ok && neosd_app_read_blocks(block, count, rbuf) && neosd_app_write_sync();
+    ok = ok && memcmp(expect, rbuf, count * 512) == 0;
+
+    ok = ok && neosd_app_write_blocks(block, count, save) && neosd_app_write_sync();
+    neosd_app_use_write_behind(nullptr);
+    printf("Write-behind %3u block(s) at %u: %s, %s, card state %u\n", (unsigned)count, (unsigned)block,
+        ok ? "ok" : "FAILED", pending ? "pending" : "done", state);
+    return ok;
+}
+
+// Data logging: Some CPU work per record, then a single block write. Write-behind lets the
+// card program the block during the work of the next record.
+static bool logging(size_t block, double work_us)
+{
+    static uint32_t rec[128], save[32 * 128];
+    const size_t records = 32;
+
+    bool ok = neosd_app_read_blocks(block, records, save);
+    double kib_s[2];
+    for (int behind = 0; behind < 2; behind++)
+    {
+        neosd_app_use_write_behind(behind ? behind_copy : nullptr);
+        uint64_t start = model->cycles();
+        for (size_t i = 0; i < records; i++)
+        {
+            model->delay((uint64_t)(work_us * model->clock() / 1e6));
+            for (size_t w = 0; w < 128; w++)
+                rec[w] = (i << 16) | w;
+            ok &= neosd_app_write_block(block + i, rec);
+        }
+        ok &= neosd_app_write_sync();
+        kib_s[behind] = records * 512 / 1024.0 / (elapsed_us(start) / 1e6);
+    }
+    neosd_app_use_write_behind(nullptr);
+
+    ok = ok && neosd_app_write_blocks(block, records, save);
+    printf("Logging %u records, %.0f us work each: %7.1f KiB/s, write-behind %7.1f KiB/s\n", (unsigned)records,
+        work_us, kib_s[0], kib_s[1]);
+    return ok;
+}
+
+#if FF_FS_READONLY == 0
+#if !FF_FS_NORTC
+// No RTC on the host model, a fixed timestamp keeps the image reproducible
+extern "C" DWORD get_fattime()
+{
+    return ((DWORD)(FF_NORTC_YEAR - 1980) << 25) | ((DWORD)FF_NORTC_MON << 21) | ((DWORD)FF_NORTC_MDAY << 16);
+}
+#endif
+
+// FatFs glue writes: Cached single sectors and write-behind, CTRL_SYNC is the barrier
+static bool disk_roundtrip(size_t sector, size_t count)
+{
+    static BYTE wbuf[16 * 512], rbuf[16 * 512], save[16 * 512];
+
+    bool ok = disk_initialize(0) == 0 && disk_read(0, save, sector, count) == RES_OK;
+    for (size_t i = 0; i < count * 512; i++)
+        wbuf[i] = (BYTE)(sector + i * 7);
+
+    ok = ok && disk_write(0, wbuf, sector, count) == RES_OK && disk_write(0, wbuf, sector + count, 1) == RES_OK;
+    ok = ok && disk_read(0, rbuf, sector, count) == RES_OK && memcmp(wbuf, rbuf, count * 512) == 0;
+    ok = ok && disk_ioctl(0, CTRL_SYNC, nullptr) == RES_OK;
+    ok = ok && neosd_app_read_blocks(sector, count, (uint32_t*)rbuf) && memcmp(wbuf, rbuf, count * 512) == 0;
+
+    ok = ok && disk_write(0, save, sector, count) == RES_OK && disk_ioctl(0, CTRL_SYNC, nullptr) == RES_OK;
+    printf("FatFs glue write %3u sector(s) at %u: %s\n", (unsigned)count, (unsigned)sector, ok ? "ok" : "FAILED");
+    return ok;
+}
+#endif
+
+static void throughput(size_t count)
+{
+    static uint32_t buf[64 * 128];
+    const size_t runs = 8;
+
+    uint64_t start = model->cycles();
+    uint64_t clocks = model->sd_clocks();
+    for (size_t i = 0; i < runs; i++)
+        neosd_app_read_blocks(i * count, count, buf);
+    double us = elapsed_us(start);
+
+    printf("Read %3u block(s): %8.1f us/block, %7.1f KiB/s, %6.1f SD clocks/block\n", (unsigned)count,
+        us / (runs * count), runs * count * 512 / 1024.0 / (us / 1e6),
+        (double)(model->sd_clocks() - clocks) / (runs * count));
+}
+
+#ifdef NEOSD_MULTI
+// Alternate single block stream reads between two controllers, both streams stay open
+static bool interleave(neosd_dev_t* const devs[2], size_t block, size_t count)
+{
+    static uint32_t wbuf[2][64 * 128], rbuf[2][64 * 128];
+
+    bool ok = true;
+    for (int d = 0; d < 2; d++)
+    {
+        for (size_t i = 0; i < count * 128; i++)
+            wbuf[d][i] = ((block + d) << 16) ^ (i * 0x9E3779B9);
+        neosd_select(devs[d]);
+        ok &= neosd_app_write_blocks(block, count, wbuf[d]);
+        neosd_app_stream_open(block);
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        for (int d = 0; d < 2; d++)
+        {
+            neosd_select(devs[d]);
+            ok = ok && neosd_app_stream_read(1, rbuf[d] + i * 128);
+        }
+    }
+
+    for (int d = 0; d < 2; d++)
+    {
+        neosd_select(devs[d]);
+        ok = neosd_app_stream_close() && ok;
+        ok = ok && memcmp(wbuf[d], rbuf[d], count * 512) == 0;
+    }
+    neosd_select(devs[0]);
+    printf("Interleaved %3u block(s) at %u on 2 controllers: %s\n", (unsigned)count, (unsigned)block,
+        ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// Write and read back through a striped device, check the chunk layout on the cards and
+// read through FatFs drive 1
+static bool stripe_roundtrip(neosd_stripe_t* stripe, size_t block, size_t count)
+{
+    static uint32_t wbuf[64 * 128], rbuf[64 * 128];
+
+    for (size_t i = 0; i < count * 128; i++)
+        wbuf[i] = (block << 16) ^ (i * 0x7F4A7C15);
+    bool ok = neosd_stripe_write(stripe, block, count, wbuf);
+    ok = ok && neosd_stripe_read(stripe, block, count, rbuf);
+    ok = ok && memcmp(wbuf, rbuf, count * 512) == 0;
+
+    for (size_t i = 0; ok && i < count; i++)
+    {
+        size_t chunk = (block + i) / NEOSD_STRIPE_CHUNK;
+        neosd_select(stripe->dev[chunk % NEOSD_STRIPE_WAYS]);
+        ok = neosd_app_read_block(chunk / NEOSD_STRIPE_WAYS * NEOSD_STRIPE_CHUNK + (block + i) % NEOSD_STRIPE_CHUNK,
+            rbuf) && memcmp(wbuf + i * 128, rbuf, 512) == 0;
+    }
+    neosd_select(&neosd_dev0);
+
+    disk_attach_stripe(1, stripe);
+    memset(rbuf, 0, sizeof(rbuf));
+    ok = ok && disk_read(1, (BYTE*)rbuf, block, count) == RES_OK && memcmp(wbuf, rbuf, count * 512) == 0;
+    ok = ok && disk_read(1, (BYTE*)rbuf, block + 1, 1) == RES_OK && memcmp(wbuf + 128, rbuf, 512) == 0;
+    neosd_select(&neosd_dev0);
+
+    printf("Striped %3u block(s) at %u on 2 controllers: %s\n", (unsigned)count, (unsigned)block, ok ? "ok" : "FAILED");
+    return ok;
+}
+#endif
+
+static uint32_t forward_hash;
+
+// f_forward callback, a count of 0 asks if the consumer is ready
+static UINT forward_fnv(const BYTE* data, UINT count)
+{
+    for (UINT i = 0; i < count; i++)
+        forward_hash = (forward_hash ^ data[i]) * 16777619u;
+    return count != 0 ? count : 1;
+}
+
+struct file_read_t
+{
+    size_t total;
+    uint32_t hash;
+    double kib_s;
+};
+
+// Read the rest of a file in 4 KiB f_reads into buf
+static bool read_file(FIL* fil, BYTE* buf, file_read_t* res)
+{
+    UINT br;
+    FRESULT fr;
+    res->total = 0;
+    res->hash = 2166136261u;
+    uint64_t start = model->cycles();
+    while ((fr = f_read(fil, buf, 4096, &br)) == FR_OK && br != 0)
+    {
+        // FNV-1a, to compare against the file on the host
+        for (UINT i = 0; i < br; i++)
+            res->hash = (res->hash ^ buf[i]) * 16777619u;
+        res->total += br;
+    }
+    res->kib_s = res->total / 1024.0 / (elapsed_us(start) / 1e6);
+    return fr == FR_OK;
+}
+
+static bool list_files(int drive)
+{
+    static FATFS fs[FF_VOLUMES];
+    DIR dir;
+    FILINFO fno;
+    char path[8 + sizeof(fno.fname)];
+
+    snprintf(path, sizeof(path), "%d:", drive);
+    if (f_mount(&fs[drive], path, 1) != FR_OK)
+    {
+        printf("Drive %d: No FAT filesystem\n", drive);
+        return true;
+    }
+
+    snprintf(path, sizeof(path), "%d:/", drive);
+    if (f_opendir(&dir, path) != FR_OK)
+        return false;
+
+    // One word more for a misaligned copy of the buffer
+    static uint32_t buf[4096 / 4 + 1];
+    while (f_readdir(&dir, &fno) == FR_OK && fno.fname[0] != 0)
+    {
+        if (fno.fattrib & AM_DIR)
+        {
+            printf("  %-12s <DIR>\n", fno.fname);
+            continue;
+        }
+
+        FIL fil;
+        snprintf(path, sizeof(path), "%d:/%s", drive, fno.fname);
+        if (f_open(&fil, path, FA_READ) != FR_OK)
+            return false;
+
+        // Aligned buffers take the word path, misaligned ones go through the bounce buffer. Files
+        // shorter than one f_read only fill the FatFs buffer, the second pass reads from the cache.
+        file_read_t aligned, unaligned;
+        bool same = read_file(&fil, (BYTE*)buf, &aligned) && f_lseek(&fil, 0) == FR_OK &&
+            read_file(&fil, (BYTE*)buf + 1, &unaligned) && unaligned.hash == aligned.hash;
+
+        // Again through f_forward, the data goes from the sector buffer to the hash
+        UINT bf = 0;
+        forward_hash = 2166136261u;
+        same = same && f_lseek(&fil, 0) == FR_OK && f_forward(&fil, forward_fnv, aligned.total, &bf) == FR_OK &&
+            bf == aligned.total && forward_hash == aligned.hash;
+        f_close(&fil);
+
+        printf("  %-12s %10u bytes, FNV-1a %08x, %7.1f KiB/s, unaligned ", fno.fname, (unsigned)aligned.total,
+            (unsigned)aligned.hash, aligned.kib_s);
+        if (aligned.total >= sizeof(buf) - 4)
+            printf("%7.1f KiB/s, %s\n", unaligned.kib_s, same ? "ok" : "FAILED");
+        else
+            printf("%7s KiB/s, %s\n", "-", same ? "ok" : "FAILED");
+        if (!same)
+            return false;
+    }
+    f_closedir(&dir);
+    return true;
+}
+
+#if FF_USE_MKFS
+struct fnv_sink_ctx
+{
+    uint32_t hash;
+    UINT left;
+};
+
+// disk_forward sink, hashes the bytes of each word up to the end of the file
+static void fnv_sink(void* user, uint32_t word)
+{
+    fnv_sink_ctx* ctx = (fnv_sink_ctx*)user;
+    for (int i = 0; i < 4 && ctx->left != 0; i++, ctx->left--)
+        ctx->hash = (ctx->hash ^ (BYTE)(word >> (8 * i))) * 16777619u;
+}
+
+// Format a drive and write files through FatFs, then read each back with an aligned and a
+// misaligned buffer (disk_bounce), f_forward and disk_forward, and compare against the hash
+// of what was written
+static bool make_fat(int drive, size_t sectors)
+{
+    static const struct { const char* name; UINT size; } files[] = {
+        {"SMALL.TXT", 100}, {"ODD.BIN", 3 * 4096 + 1001}, {"BIG.BIN", 96 * 1024 + 3 * 512 + 7}};
+    static uint32_t work[4096 / 4];
+    static FATFS fs;
+    char path[16];
+
+    disk_set_sectors(drive, sectors);
+    snprintf(path, sizeof(path), "%d:", drive);
+    MKFS_PARM opt = {FM_FAT | FM_SFD, 0, 0, 0, 0};
+    bool ok = f_mkfs(path, &opt, work, sizeof(work)) == FR_OK && f_mount(&fs, path, 1) == FR_OK;
+
+    for (const auto& file : files)
+    {
+        FIL fil;
+        snprintf(path, sizeof(path), "%d:/%s", drive, file.name);
+        ok = ok && f_open(&fil, path, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK;
+
+        // Odd f_write sizes mix partial sectors with whole ones from a misaligned buffer
+        uint32_t hash = 2166136261u;
+        for (UINT done = 0, bw = 0; ok && done < file.size; done += bw)
+        {
+            UINT n = file.size - done < 1531 + 2048 ? file.size - done : 1531 + 2048;
+            BYTE* data = (BYTE*)work + 1;
+            for (UINT i = 0; i < n; i++)
+            {
+                data[i] = (BYTE)((done + i) * 131 + ((done + i) >> 9) + drive);
+                hash = (hash ^ data[i]) * 16777619u;
+            }
+            ok = f_write(&fil, data, n, &bw) == FR_OK && bw == n;
+        }
+        ok = f_close(&fil) == FR_OK && ok;
+
+        file_read_t aligned, unaligned;
+        ok = ok && f_open(&fil, path, FA_READ) == FR_OK;
+        ok = ok && read_file(&fil, (BYTE*)work, &aligned) && f_lseek(&fil, 0) == FR_OK &&
+            read_file(&fil, (BYTE*)work + 3, &unaligned);
+        ok = ok && aligned.total == file.size && aligned.hash == hash && unaligned.total == file.size &&
+            unaligned.hash == hash;
+
+        // f_forward, and the word sink on the sectors of the file: Written in one go to a fresh
+        // volume, its clusters are contiguous
+        UINT bf = 0;
+        forward_hash = 2166136261u;
+        ok = ok && f_lseek(&fil, 0) == FR_OK && f_forward(&fil, forward_fnv, file.size, &bf) == FR_OK &&
+            bf == file.size && forward_hash == hash;
+        fnv_sink_ctx ctx = {2166136261u, file.size};
+        LBA_t sector = fs.database + (LBA_t)fs.csize * (fil.obj.sclust - 2);
+        ok = ok && disk_forward(drive, sector, (file.size + 511) / 512, fnv_sink, &ctx) == RES_OK &&
+            ctx.hash == hash;
+        f_close(&fil);
+    }
+    f_unmount(path);
+
+    printf("Drive %d: Formatted %u sectors, %u files written and read back: %s\n", drive, (unsigned)sectors,
+        (unsigned)(sizeof(files) / sizeof(files[0])), ok ? "ok" : "FAILED");
+    return ok;
+}
+#endif
+
+int main(int argc, char** argv)
+{
+    const char* image = "sd.img";
+    const char* image1 = nullptr;
+    uint64_t size = 64;
+    uint32_t clk_mhz = 100, access = 4, crc_every = 0;
+    int prsc = -1, cdiv = 0;
+    bool d4 = true;
+    sd_card_model::timing_t timing;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "i:j:s:c:a:p:d:1n:b:e:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'i': image = optarg; break;
+            case 'j': image1 = optarg; break;
+            case 's': size = strtoull(optarg, nullptr, 0); break;
+            case 'c': clk_mhz = strtoul(optarg, nullptr, 0); break;
+            case 'a': access = strtoul(optarg, nullptr, 0); break;
+            case 'p': prsc = strtol(optarg, nullptr, 0); break;
+            case 'd': cdiv = strtol(optarg, nullptr, 0); break;
+            case '1': d4 = false; break;
+            case 'n': timing.nac = strtoul(optarg, nullptr, 0); break;
+            case 'b': timing.busy = strtoul(optarg, nullptr, 0); break;
+            case 'e': crc_every = strtoul(optarg, nullptr, 0); break;
+            default:
+                fprintf(stderr, "Usage: %s [-i image] [-j second image] [-s MiB, new images] [-c MHz] [-a access cycles]\n"
+                    "    [-p prsc] [-d cdiv] [-1 for 1 bit mode] [-n N_AC clocks] [-b busy clocks]\n"
+                    "    [-e CRC error every n data blocks]\n", argv[0]);
+                return 2;
+        }
+    }
+
+#ifndef NEOSD_MULTI
+    if (image1 != nullptr)
+    {
+        fprintf(stderr, "-j needs a NEOSD_MULTI build\n");
+        return 2;
+    }
+#endif
+
+    sd_card_model card(image, size << 20, timing);
+    if (!card.ok())
+    {
+        fprintf(stderr, "Cannot open %s\n", image);
+        return 1;
+    }
+    neosd_model controller(card, clk_mhz * 1000000, access);
+    model = &controller;
+    neosd_host_attach(&controller);
+
+    // Identification at <= 400 kHz: 2 * 64 * (cdiv + 1) system clocks
+    neosd_version_t ver;
+    if (!neosd_setup(3, (clk_mhz * 1000000 - 1) / (2 * 64 * 400000), &ver))
+    {
+        printf("NEOSD: Controller not found\n");
+        return 1;
+    }
+    printf("NEOSD: Controller version %d.%d.%d, image %s: %llu blocks\n", ver.major, ver.minor, ver.patch,
+        image, (unsigned long long)card.blocks());
+
+    sd_card_t info;
+    SD_CODE code = neosd_app_card_init(&info, clk_mhz * 1000000);
+    if (code != NEOSD_OK)
+    {
+        printf("Card init failed: %d\n", code);
+        return 1;
+    }
+    printf("Card initialized: RCA %x, OCR %x, SCR %x %x, high speed %d\n", info.rca, (unsigned)info.ocr,
+        (unsigned)info.scr[1], (unsigned)info.scr[0], info.hs);
+
+    // The model has the FIFO of 0.5.0, test it like the word path
+    neosd_app_use_fifo(true);
+    if (!neosd_app_configure_datamode(d4, info.rca))
+    {
+        printf("Setting data mode failed\n");
+        return 1;
+    }
+    // Init selects the fastest clock, -p overrides it
+    if (prsc >= 0)
+        neosd_set_clock(prsc, cdiv, false);
+    printf("Data transfer: %s, %.2f MHz SD clock\n", d4 ? "4 bit" : "1 bit", neosd_get_clock_speed() / 1e6);
+
+    // Forwarded words cannot be taken back, so this runs before any CRC errors
+    bool ok = true;
+    size_t last = card.blocks() - 64;
+    ok &= forward(last + 5, 11);
+    ok &= stream_idle(last + 2);
+    ok &= autostop_busy(card, last + 6);
+    ok &= autostop_cmd13(card, last + 6);
+    card.inject_crc_errors(crc_every);
+
+    ok &= roundtrip(last, 1);
+    ok &= roundtrip(last + 3, 2);
+    ok &= roundtrip(last + 7, 9);
+    ok &= roundtrip(last, 64);
+    ok &= dma_roundtrip(last + 2, 13);
+    ok &= write_behind(last + 1, 1);
+    ok &= write_behind(last + 4, 23);
+#if FF_FS_READONLY == 0
+    ok &= disk_roundtrip(last + 9, 11);
+#endif
+
+    for (size_t count : {1, 8, 64})
+        throughput(count);
+    ok &= logging(last, 20);
+
+    ok &= list_files(0);
+
+#ifdef NEOSD_MULTI
+    // Second controller and card, drive 1. Timeouts keep running on the first one.
+    if (image1 != nullptr)
+    {
+        static sd_card_model card1(image1, size << 20, timing);
+        static neosd_model controller1(card1, clk_mhz * 1000000, access);
+        static neosd_dev_t dev1;
+        if (!card1.ok())
+        {
+            fprintf(stderr, "Cannot open %s\n", image1);
+            return 1;
+        }
+        neosd_host_attach(&controller1, 1);
+        neosd_dev_init(&dev1, &neosd_host_regs[1]);
+        neosd_select(&dev1);
+        disk_attach(1, &dev1);
+
+        sd_card_t info1;
+        ok &= neosd_setup(3, (clk_mhz * 1000000 - 1) / (2 * 64 * 400000), &ver) &&
+            neosd_app_card_init(&info1, clk_mhz * 1000000) == NEOSD_OK &&
+            neosd_app_configure_datamode(d4, info1.rca);
+        neosd_app_use_fifo(true);
+        printf("Second controller: %s, RCA %x, %.2f MHz SD clock\n", ok ? "initialized" : "FAILED",
+            info1.rca, neosd_get_clock_speed() / 1e6);
+
+        neosd_dev_t* const devs[2] = {&neosd_dev0, &dev1};
+        size_t last1 = (card.blocks() < card1.blocks() ? card.blocks() : card1.blocks()) - 64;
+        ok = ok && interleave(devs, last1, 1) && interleave(devs, last1 + 5, 9);
+        // Throughput of drive 1 in the time of its own controller
+        model = &controller1;
+#if FF_USE_MKFS
+        ok &= make_fat(1, card1.blocks());
+#endif
+        ok &= list_files(1);
+        model = &controller;
+        neosd_select(&neosd_dev0);
+
+        static neosd_stripe_t stripe;
+        neosd_stripe_init(&stripe, devs);
+        ok &= stripe_roundtrip(&stripe, 2 * last1 + 3, 1);
+        ok &= stripe_roundtrip(&stripe, 2 * last1 + 5, 37);
+    }
+#endif
+
+    const sd_card_model::stats_t& stats = card.stats();
+    printf("Card: %llu commands, %llu blocks read, %llu blocks written, %llu CRC errors, %llu injected\n",
+        (unsigned long long)stats.commands, (unsigned long long)stats.blocks_read,
+        (unsigned long long)stats.blocks_written, (unsigned long long)stats.crc_errors,
+        (unsigned long long)stats.injected);
+
+    neosd_link_stats_t link;
+    neosd_app_get_link_stats(&link);
+    printf("Driver: %u blocks, %u CRC errors, %u retries, %u failures, clock level %u (%.2f MHz)\n",
+        (unsigned)link.blocks, (unsigned)link.crc_errors, (unsigned)link.retries, (unsigned)link.failures,
+        link.clock_level, link.clock_hz / 1e6);
+
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+#include "neosd.h"
+#include "neorv32.h"
+
+static neosd_host_backend* neosd_host_backends[NEOSD_HOST_DEVICES];
+static neosd_host_backend* neosd_host_backend_ptr = nullptr;
+static uint64_t neosd_host_access_count = 0;
+// With several controllers, each access also lets time pass for the others
+static bool neosd_host_shared = false;
+static uint64_t neosd_host_now = 0;
+
+neosd_t neosd_host_regs[NEOSD_HOST_DEVICES] = {
+    neosd_t(0x000), neosd_t(0x100), neosd_t(0x200), neosd_t(0x300)
+};
+
+// System clock cycles of the CPU, read from controller 0
+static uint64_t neosd_host_cycles()
+{
+    if (!neosd_host_shared)
+        return neosd_host_backend_ptr->cycles();
+    neosd_host_backend_ptr->sync(neosd_host_now);
+    neosd_host_now = neosd_host_backend_ptr->cycles();
+    return neosd_host_now;
+}
+
+// Driver timeouts run on the virtual system clock of the backend
+static uint32_t neosd_host_ticks()
+{
+    return neosd_host_cycles();
+}
+
+static uint32_t neosd_host_hz()
+{
+    return neosd_host_backend_ptr->clock();
+}
+
+static const neosd_time_t neosd_host_time = {neosd_host_ticks, neosd_host_hz};
+
+/**********************************************************************//**
+* Attach the backend serving the register accesses of controller dev.
+**************************************************************************/
+void neosd_host_attach(neosd_host_backend* backend, unsigned dev)
+{
+    neosd_host_backends[dev] = backend;
+    neosd_host_shared |= dev != 0;
+    if (dev == 0)
+    {
+        neosd_host_backend_ptr = backend;
+        neosd_set_time_source(&neosd_host_time);
+    }
+}
+
+neosd_host_backend* neosd_host_get(unsigned dev)
+{
+    return neosd_host_backends[dev];
+}
+
+uint32_t neosd_host_read(uint32_t addr)
+{
+    neosd_host_backend* backend = neosd_host_backends[addr >> 8];
+    neosd_host_access_count++;
+    if (!neosd_host_shared)
+        return backend->read(addr & 0xFF);
+
+    backend->sync(neosd_host_now);
+    uint32_t data = backend->read(addr & 0xFF);
+    neosd_host_now = backend->sync(neosd_host_now);
+    return data;
+}
+
+void neosd_host_write(uint32_t addr, uint32_t data)
+{
+    neosd_host_backend* backend = neosd_host_backends[addr >> 8];
+    neosd_host_access_count++;
+    if (!neosd_host_shared)
+    {
+        backend->write(addr & 0xFF, data);
+        return;
+    }
+
+    backend->sync(neosd_host_now);
+    backend->write(addr & 0xFF, data);
+    neosd_host_now = backend->sync(neosd_host_now);
+}
+
+uint64_t neosd_host_accesses()
+{
+    return neosd_host_access_count;
+}
+
+extern "C" {
+    uint64_t neorv32_clint_time_get(void)
+    {
+        return neosd_host_cycles();
+    }
+
+    uint32_t neorv32_sysinfo_get_clk(void)
+    {
+        return neosd_host_backend_ptr->clock();
+    }
+
+    uint64_t neorv32_cpu_get_cycle(void)
+    {
+        return neosd_host_cycles();
+    }
+
+    uint64_t neorv32_cpu_get_instret(void)
+    {
+        return neosd_host_access_count;
+    }
+}
@@ -0,0 +1,808 @@
+#include "neosd_model.h"
+#include "neosd.h"
+
+#define NEOSD_MODEL_CTRL_RW ((1 << NEOSD_CTRL_RST) | (1 << NEOSD_CTRL_D4) | (1 << NEOSD_CTRL_FIFO) | \
+    (1 << NEOSD_CTRL_IDLE_SDCLK) | \
+    (0b111 << NEOSD_CTRL_PRSC0) | (1 << NEOSD_CTRL_HS) | (0b1111 << NEOSD_CTRL_CDIV0) | \
+    (0b11111 << NEOSD_CTRL_MASK_CMD_RESP))
+
+// Same as the RTL: Shift registers are filled MSB first, DATA is byte swapped
+static uint32_t bswap32(uint32_t v)
+{
+    return (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+}
+
+// out: Shift the CRC out instead of updating it
+static uint8_t crc7_bit(uint8_t crc, bool bit, bool out)
+{
+    bool fb = (((crc >> 6) & 1) ^ bit) && !out;
+    crc = (crc << 1) & 0x7F;
+    if (fb)
+        crc ^= 0x09;
+    return crc;
+}
+
+static uint16_t crc16_bit(uint16_t crc, bool bit)
+{
+    bool fb = ((crc >> 15) & 1) ^ bit;
+    crc <<= 1;
+    if (fb)
+        crc ^= 0x1021;
+    return crc;
+}
+
+// Bits readable in FLAGS
+#define NEOSD_MODEL_FLAGS ((1 << NEOSD_CTRL_CRCERR) | (1 << NEOSD_CTRL_RESP_CRCERR) | (0b11111 << NEOSD_CTRL_FLAG_CMD_RESP))
+
+neosd_model::neosd_model(sd_card_model& card, uint32_t clk_hz, uint32_t access_cycles, unsigned fifo_depth_log2) :
+    card(card), clk_hz(clk_hz), access_cycles(access_cycles), fifo_depth(1u << fifo_depth_log2),
+    fifo_depth_log2(fifo_depth_log2)
+{
+}
+
+bool neosd_model::fifo_mode() const
+{
+    return ctrl & (1 << NEOSD_CTRL_FIFO);
+}
+
+// FIFO mode DAT_DATA flag: At least watermark words to read, or free words to write
+bool neosd_model::flag_data_level() const
+{
+    size_t wm = fifo_wm == 0 ? 1 : fifo_wm;
+    if (fifo_write)
+        return fifo_depth - fifo.size() >= wm;
+    return fifo.size() >= wm;
+}
+
+// DMA request, single words in FIFO mode
+bool neosd_model::flag_data() const
+{
+    if (!fifo_mode())
+        return flag_dat_data;
+    if (fifo_write)
+        return fifo.size() < fifo_depth;
+    return !fifo.empty();
+}
+
+// STATUS register: CTRL without the configuration
+uint32_t neosd_model::status() const
+{
+    // Busy bits are named the other way round in neosd.h
+    return ((cmd.state != CMD_IDLE) << 12) | ((dat.state != DAT_IDLE) << 13) |
+        (crcerr << NEOSD_CTRL_CRCERR) | (resp_crcerr << NEOSD_CTRL_RESP_CRCERR) |
+        (flag_cmd_resp << NEOSD_CTRL_FLAG_CMD_RESP) |
+        ((fifo_mode() ? flag_data_level() : flag_dat_data) << NEOSD_CTRL_FLAG_DAT_DATA) |
+        (flag_cmd_done << NEOSD_CTRL_FLAG_CMD_DONE) | (flag_dat_done << NEOSD_CTRL_FLAG_DAT_DONE) |
+        (flag_blk_done << NEOSD_CTRL_FLAG_BLK_DONE);
+}
+
+// Write 1 to clear, CMD_RESP and DAT_DATA clear on data access only
+void neosd_model::clear_flags(uint32_t mask)
+{
+    crcerr &= !((mask >> NEOSD_CTRL_CRCERR) & 1);
+    resp_crcerr &= !((mask >> NEOSD_CTRL_RESP_CRCERR) & 1);
+    flag_cmd_done &= !((mask >> NEOSD_CTRL_FLAG_CMD_DONE) & 1);
+    flag_dat_done &= !((mask >> NEOSD_CTRL_FLAG_DAT_DONE) & 1);
+    flag_blk_done &= !((mask >> NEOSD_CTRL_FLAG_BLK_DONE) & 1);
+}
+
+uint32_t neosd_model::data_read()
+{
+    flag_dat_data = false;
+    if (!fifo_mode())
+        return bswap32(data_reg);
+    // Nothing to read while writing, an empty FIFO reads stale memory in the RTL
+    if (fifo_write || fifo.empty())
+        return 0;
+    uint32_t word = fifo.front();
+    fifo.pop_front();
+    return bswap32(word);
+}
+
+void neosd_model::data_write(uint32_t data)
+{
+    flag_dat_data = false;
+    if (!fifo_mode())
+    {
+        data_reg = bswap32(data);
+        data_pos = 0;
+    }
+    else if (fifo_write && fifo.size() < fifo_depth)
+    {
+        fifo.push_back(bswap32(data));
+    }
+}
+
+uint32_t neosd_model::read(uint32_t addr)
+{
+    now += access_cycles;
+    run();
+
+    switch (addr)
+    {
+        case 0x00:
+            // Version 0.5.0
+            return (NEOSD_MAGIC << NEOSD_INFO_MAGIC) | (fifo_depth_log2 << NEOSD_INFO_FIFO) |
+                (0 << NEOSD_INFO_MAJOR) | (5 << NEOSD_INFO_MINOR) | (0 << NEOSD_INFO_PATCH);
+        case 0x04:
+            return ctrl | status();
+        case 0x18:
+            return status();
+        case 0x1C:
+            return status() & NEOSD_MODEL_FLAGS;
+        case 0x20:
+            return blkcnt | (blkcnt_cmd12 << NEOSD_BLKCNT_AUTO_CMD12);
+        case 0x24:
+            return fifo.size() | ((uint32_t)fifo_wm << NEOSD_FIFO_WM_LSB);
+        case 0x10:
+            flag_cmd_resp = false;
+            return cmd_reg & 0xFFFFFFFF;
+        case 0x14:
+            return data_read();
+        default:
+            // CMDARG and CMD are write only
+            return 0;
+    }
+}
+
+void neosd_model::write(uint32_t addr, uint32_t data)
+{
+    now += access_cycles;
+    run();
+
+    switch (addr)
+    {
+        case 0x04:
+            ctrl = data & NEOSD_MODEL_CTRL_RW;
+            // Compatibility with 0.2.0 software: Flag and error bits written as 0 are cleared
+            clear_flags(~data);
+            break;
+        case 0x08:
+            cmd_reg = (cmd_reg & ~(0xFFFFFFFFULL << 8)) | ((uint64_t)data << 8);
+            cmdarg_pend = true;
+            break;
+        case 0x0C:
+        {
+            cmd_commit = (data >> NEOSD_CMD_COMMIT) & 1;
+            cmdarg_pend = false;
+            cmd_abrt = (data >> NEOSD_CMD_ABRT_DAT) & 1;
+            auto_crc = (data >> NEOSD_CMD_AUTO_CRC) & 1;
+            if (cmd_commit)
+                resp_crcerr = false;
+            dmode = (data >> NEOSD_CMD_DMODE0) & 0b11;
+            // A new read or write starts with an empty FIFO
+            if (cmd_commit && (dmode & 0b10))
+            {
+                fifo.clear();
+                fifo_write = dmode == NEOSD_DMODE_WRITE;
+            }
+            rmode = (data >> NEOSD_CMD_RMODE0) & 0b11;
+            // Start and transmission bit, index, CRC and end bit
+            uint64_t idx = (data >> NEOSD_CMD_IDX_LSB) & 0x3F;
+            uint64_t crc = (data >> NEOSD_CMD_CRC_LSB) & 0x7F;
+            cmd_reg = (cmd_reg & (0xFFFFFFFFULL << 8)) | (0b01ULL << 46) | (idx << 40) | (crc << 1) | 1;
+            break;
+        }
+        case 0x14:
+            data_write(data);
+            break;
+        case 0x1C:
+            clear_flags(data);
+            break;
+        case 0x20:
+            blkcnt = data & ((1u << (NEOSD_BLKCNT_COUNT_MSB + 1)) - 1);
+            blkcnt_cmd12 = (data >> NEOSD_BLKCNT_AUTO_CMD12) & 1;
+            autostop = false;
+            break;
+        case 0x24:
+            fifo_wm = data >> NEOSD_FIFO_WM_LSB;
+            break;
+        default:
+            break;
+    }
+}
+
+uint64_t neosd_model::cycles()
+{
+    // CLINT is a bus access as well
+    now += access_cycles;
+    run();
+    return now;
+}
+
+void neosd_model::delay(uint64_t cycles)
+{
+    now += cycles;
+    run();
+}
+
+uint64_t neosd_model::sync(uint64_t cycles)
+{
+    if (cycles > now)
+        delay(cycles - now);
+    return now;
+}
+
+bool neosd_model::irq() const
+{
+    bool dat_data = fifo_mode() ? flag_data_level() : flag_dat_data;
+    uint32_t flags = (flag_cmd_resp << 0) | (dat_data << 1) | (flag_cmd_done << 2) |
+        (flag_dat_done << 3) | (flag_blk_done << 4);
+    return (flags & (ctrl >> NEOSD_CTRL_MASK_CMD_RESP)) != 0;
+}
+
+uint32_t neosd_model::strobe_period() const
+{
+    static const uint32_t PRSC_LUT[8] = {2, 4, 8, 64, 128, 1024, 2048, 4096};
+    uint32_t cdiv = ((ctrl >> NEOSD_CTRL_CDIV0) & 0xF) + 1;
+    if (ctrl & (1 << NEOSD_CTRL_HS))
+        return 2 * cdiv;
+    return 2 * PRSC_LUT[(ctrl >> NEOSD_CTRL_PRSC0) & 0x7] * cdiv;
+}
+
+void neosd_model::dma_start(uint32_t* mem, size_t words, bool write)
+{
+    dma.mem = mem;
+    dma.words = words;
+    dma.write = write;
+    dma.ready = now;
+}
+
+void neosd_model::dma_stop()
+{
+    dma.words = 0;
+}
+
+void neosd_model::run()
+{
+    while (next_strobe <= now)
+    {
+        tick();
+
+        // DMA channel: Serves requests raised by this strobe, one bus access per word. Once its
+        // words are moved, further requests are left to the CPU.
+        while (dma.words != 0 && flag_data() && dma.ready <= next_strobe)
+        {
+            if (dma.write)
+                data_write(*dma.mem++);
+            else
+                *dma.mem++ = data_read();
+            dma.words--;
+            dma.moved++;
+            dma.ready = (dma.ready > next_strobe ? dma.ready : next_strobe) + access_cycles;
+        }
+        next_strobe += strobe_period();
+    }
+}
+
+// Value on the data lines driven by the controller
+uint8_t neosd_model::dat_visible() const
+{
+    bool d4 = ctrl & (1 << NEOSD_CTRL_D4);
+    switch (dat.omux)
+    {
+        case OMUX_ZERO:
+            return 0x0;
+        case OMUX_ONE:
+            return 0xF;
+        case OMUX_DATA:
+            // All units were shifted out, waiting for the next word
+            if (data_pos >= (d4 ? 8u : 32u))
+                return 0xF;
+            if (d4)
+                return (data_reg >> (28 - 4 * data_pos)) & 0xF;
+            return 0xE | ((data_reg >> (31 - data_pos)) & 1);
+        default:
+        {
+            uint8_t unit = 0;
+            for (int l = 0; l < (d4 ? 4 : 1); l++)
+                unit |= ((crc[l] >> (15 - crc_pos)) & 1) << l;
+            return d4 ? unit : 0xE | unit;
+        }
+    }
+}
+
+// Value on the command line driven by the controller
+bool neosd_model::cmd_visible() const
+{
+    if (auto_crc && cmd.state == CMD_WRITE && cmd.bit_counter >= 40 && cmd.bit_counter < 47)
+        return (cmd_crc >> 6) & 1;
+    return (cmd_reg >> 47) & 1;
+}
+
+/**********************************************************************//**
+* One clock strobe: Clock the card if the SD clock is enabled, then update
+* both FSMs from the sampled lines.
+**************************************************************************/
+void neosd_model::tick()
+{
+    bool idle_clk = ctrl & (1 << NEOSD_CTRL_IDLE_SDCLK);
+    bool en = (cmd.clk_req || dat.clk_req || idle_clk) && !(cmd.clk_stall || dat.clk_stall);
+
+    // Flags from the registered FSM outputs of the last strobe. The word completed at the last
+    // strobe is still in the data register.
+    if (dat.word && fifo_mode() && fifo.size() < fifo_depth)
+        fifo.push_back(data_reg);
+    if (dat.state == DAT_IDLE)
+        blkcnt_abrt = false;
+    if (dat.block_done)
+    {
+        flag_blk_done = true;
+        crcerr |= !dat.crc_ok;
+
+        // Block counter stops the data FSM right away or with CMD12
+        if (blkcnt != 0 && --blkcnt == 0)
+        {
+            if (blkcnt_cmd12)
+                autostop = true;
+            else
+                blkcnt_abrt = true;
+        }
+    }
+
+    // CMD12 once the command FSM is idle and CMD_DONE was acknowledged, R1b after writes. The
+    // direction is the latched one, a dataless command during the transfer overwrites dmode. A
+    // command of the CPU goes first once its CMDARG is written, the CMD12 stays pending.
+    if (autostop && cmd.state == CMD_IDLE && !flag_cmd_done && !cmd_commit && !cmdarg_pend)
+    {
+        autostop = false;
+        cmd_commit = cmd_abrt = auto_crc = true;
+        resp_crcerr = false;
+        rmode = NEOSD_RMODE_SHORT;
+        dmode = fifo_write ? NEOSD_DMODE_BUSY : NEOSD_DMODE_NONE;
+        cmd_reg = (0b01ULL << 46) | (12ULL << 40) | 1;
+    }
+    if (cmd.resp_done)
+        resp_crcerr |= cmd_crc != 0;
+
+    if (en)
+    {
+        bool d4 = ctrl & (1 << NEOSD_CTRL_D4);
+        uint8_t dat_oe = dat.dat_oe ? (d4 ? 0xF : 0x1) : 0x0;
+        uint8_t dat_o = dat_visible();
+        card.clock(cmd.cmd_oe, cmd_visible(), dat_oe, dat_o);
+
+        cmd_line = cmd.cmd_oe ? cmd_visible() : card.cmd();
+        dat_line = (dat_o & dat_oe) | (card.dat() & ~dat_oe);
+    }
+
+    bool cmd_idle = cmd.state == CMD_IDLE;
+    bool cmd_resp = cmd.state == CMD_REGOUT;
+    bool dat_idle = dat.state == DAT_IDLE;
+    bool dat_data = dat.state == DAT_REGOUT || dat.state == DAT_WRITE_REGIN;
+
+    bool start_dat = cmd.start_dat;
+    tick_cmd(en);
+    tick_dat(en, start_dat);
+
+    if (ctrl & (1 << NEOSD_CTRL_RST))
+    {
+        cmd = {};
+        dat = {};
+        blkcnt = 0;
+        autostop = false;
+        cmdarg_pend = false;
+        blkcnt_abrt = false;
+        fifo.clear();
+    }
+    cmd_commit = false;
+
+    // Edge triggered flags
+    if (!cmd_idle && cmd.state == CMD_IDLE)
+        flag_cmd_done = true;
+    if (!cmd_resp && cmd.state == CMD_REGOUT)
+        flag_cmd_resp = true;
+    if (!dat_idle && dat.state == DAT_IDLE)
+        flag_dat_done = true;
+    if (!dat_data && (dat.state == DAT_REGOUT || dat.state == DAT_WRITE_REGIN) && !fifo_mode())
+        flag_dat_data = true;
+}
+
+void neosd_model::tick_cmd(bool en)
+{
+    auto next = cmd;
+    next.start_dat = false;
+    next.resp_done = false;
+
+    // Count response bits up to the end bit, R2 CRC starts after the reserved bits
+    bool shift = en && cmd.clk_req;
+    bool resp_start = cmd.state == CMD_WAIT_RESP && (cmd_reg & 0b11) == 0;
+    bool rx_shift = shift && (cmd.rx || resp_start);
+    unsigned rx_first = rmode == NEOSD_RMODE_LONG ? 6 : 0;
+    unsigned rx_end = rmode == NEOSD_RMODE_LONG ? 133 : 45;
+    if (resp_start)
+        next.rx = true;
+    if (rx_shift && cmd.rx_counter != rx_end)
+    {
+        next.rx_counter++;
+        next.resp_done = cmd.rx_counter == rx_end - 1;
+    }
+
+    // CRC7 over the command bits, shifted out in bits 40..46, or over the response
+    if (cmd.state == CMD_IDLE || (cmd.state == CMD_WAIT_RESP && !resp_start))
+        cmd_crc = 0;
+    else if (cmd.state == CMD_WRITE && shift && cmd.bit_counter < 47)
+        cmd_crc = crc7_bit(cmd_crc, (cmd_reg >> 47) & 1, cmd.bit_counter >= 40);
+    else if (cmd.state != CMD_WRITE && rx_shift && cmd.rx_counter >= rx_first && cmd.rx_counter < rx_end)
+        cmd_crc = crc7_bit(cmd_crc, cmd_line, false);
+
+    switch (cmd.state)
+    {
+        case CMD_IDLE:
+            if (cmd_commit)
+            {
+                next.state = CMD_WRITE;
+                next.bit_counter = 0;
+                next.cmd_oe = true;
+                next.clk_req = true;
+                next.rx = false;
+                next.rx_counter = 0;
+            }
+            break;
+        case CMD_WRITE:
+            if (!en)
+                break;
+            if (cmd.bit_counter == 47)
+            {
+                next.bit_counter = 0;
+                next.cmd_oe = false;
+                if (dmode == NEOSD_DMODE_READ)
+                    next.start_dat = true;
+
+                if (rmode == NEOSD_RMODE_SHORT)
+                {
+                    next.word_counter = 2;
+                    next.bit_counter = 19;
+                    next.state = CMD_WAIT_RESP;
+                }
+                else if (rmode == NEOSD_RMODE_LONG)
+                {
+                    next.word_counter = 5;
+                    next.bit_counter = 27;
+                    next.state = CMD_WAIT_RESP;
+                }
+                else
+                {
+                    next.state = CMD_TAIL;
+                }
+            }
+            else
+            {
+                next.bit_counter++;
+            }
+            break;
+        case CMD_WAIT_RESP:
+            if ((cmd_reg & 0b11) == 0)
+                next.state = CMD_READ_RESP;
+            break;
+        case CMD_READ_RESP:
+            if (!en)
+                break;
+            if (cmd.bit_counter == 31)
+            {
+                next.bit_counter = 0;
+                next.word_counter--;
+                next.clk_stall = true;
+                next.state = CMD_REGOUT;
+            }
+            else
+            {
+                next.bit_counter++;
+            }
+            break;
+        case CMD_REGOUT:
+            if (!flag_cmd_resp)
+            {
+                next.clk_stall = false;
+                next.state = CMD_READ_RESP;
+                if (next.word_counter == 0)
+                {
+                    if (dmode == NEOSD_DMODE_WRITE || dmode == NEOSD_DMODE_BUSY)
+                        next.start_dat = true;
+                    next.state = CMD_TAIL;
+                }
+            }
+            break;
+        case CMD_TAIL:
+            if (!en)
+                break;
+            if (cmd.bit_counter == 7)
+            {
+                next.clk_req = false;
+                next.state = CMD_IDLE;
+            }
+            else
+            {
+                next.bit_counter++;
+            }
+            break;
+    }
+
+    if (en && cmd.clk_req)
+        cmd_reg = ((cmd_reg << 1) | cmd_line) & 0xFFFFFFFFFFFFULL;
+    cmd = next;
+}
+
+void neosd_model::tick_dat(bool en, bool start)
+{
+    bool d4 = ctrl & (1 << NEOSD_CTRL_D4);
+    bool fifo_en = fifo_mode();
+    auto next = dat;
+    next.block_done = false;
+    next.word = false;
+
+    switch (dat.state)
+    {
+        case DAT_IDLE:
+            if (!start)
+                break;
+            if (dmode == NEOSD_DMODE_READ)
+            {
+                next.clk_req = true;
+                next.rnw = true;
+                next.state = DAT_WAIT_BLOCK;
+            }
+            else if (dmode == NEOSD_DMODE_BUSY)
+            {
+                next.clk_req = true;
+                next.state = DAT_WAIT_BUSY;
+            }
+            else if (dmode == NEOSD_DMODE_WRITE)
+            {
+                next.write_start = true;
+                next.rnw = false;
+                next.clk_req = true;
+                next.clk_stall = true;
+                next.state = DAT_WRITE_REGIN;
+            }
+            break;
+        case DAT_WAIT_BLOCK:
+            if (en && (dat_line & 1) == 0)
+            {
+                next.state = DAT_READ_BLOCK;
+                next.bit_counter = 0;
+                next.word_counter = 128;
+                crc[0] = crc[1] = crc[2] = crc[3] = 0;
+            }
+            break;
+        case DAT_READ_BLOCK:
+        case DAT_READ_CRC:
+            if (!en)
+                break;
+            for (int l = 0; l < (d4 ? 4 : 1); l++)
+                crc[l] = crc16_bit(crc[l], (dat_line >> l) & 1);
+
+            if (dat.state == DAT_READ_CRC)
+            {
+                if (dat.bit_counter == 15)
+                {
+                    next.clk_stall = true;
+                    next.state = DAT_READ_FINISH;
+                }
+                else
+                {
+                    next.bit_counter++;
+                }
+                break;
+            }
+
+            data_reg = d4 ? (data_reg << 4) | (dat_line & 0xF) : (data_reg << 1) | (dat_line & 1);
+            if (dat.bit_counter == (d4 ? 7u : 31u))
+            {
+                next.bit_counter = 0;
+                next.word_counter--;
+                if (fifo_en && fifo.size() < fifo_depth)
+                {
+                    // The FIFO takes the word at the next strobe, no need to stall
+                    next.word = true;
+                    if (dat.word_counter == 1)
+                        next.state = DAT_READ_CRC;
+                }
+                else
+                {
+                    next.clk_stall = true;
+                    next.state = DAT_REGOUT;
+                }
+            }
+            else
+            {
+                next.bit_counter++;
+            }
+            break;
+        case DAT_REGOUT:
+            if (fifo_en ? fifo.size() < fifo_depth : !flag_dat_data)
+            {
+                if (fifo_en)
+                    fifo.push_back(data_reg);
+                next.clk_stall = false;
+                next.bit_counter = 0;
+                next.state = next.word_counter == 0 ? DAT_READ_CRC : DAT_READ_BLOCK;
+            }
+            break;
+        case DAT_READ_FINISH:
+            next.bit_counter = 0;
+            next.clk_stall = false;
+            next.crc_ok = (crc[0] | crc[1] | crc[2] | crc[3]) == 0;
+            next.block_done = true;
+            next.state = DAT_WAIT_BLOCK;
+            break;
+        case DAT_TAIL:
+            if (!en)
+                break;
+            if (dat.bit_counter == 7)
+            {
+                next.clk_req = false;
+                next.state = DAT_IDLE;
+            }
+            else
+            {
+                next.bit_counter++;
+            }
+            break;
+        case DAT_WAIT_BUSY:
+            if (en && (dat_line & 1) == 1)
+            {
+                next.state = DAT_TAIL;
+                next.bit_counter = 0;
+            }
+            break;
+        case DAT_WRITE_REGIN:
+            if (fifo_en ? !fifo.empty() : !flag_dat_data)
+            {
+                if (fifo_en)
+                {
+                    data_reg = fifo.front();
+                    data_pos = 0;
+                    fifo.pop_front();
+                }
+                next.clk_stall = false;
+                next.bit_counter = 0;
+                if (dat.write_start)
+                {
+                    next.omux = OMUX_ZERO;
+                    next.dat_oe = true;
+                    next.state = DAT_WRITE_START;
+                }
+                else
+                {
+                    next.state = DAT_WRITE_DATA;
+                }
+            }
+            break;
+        case DAT_WRITE_START:
+            if (!en)
+                break;
+            next.state = DAT_WRITE_DATA;
+            next.write_start = false;
+            next.omux = OMUX_DATA;
+            next.word_counter = 128;
+            crc[0] = crc[1] = crc[2] = crc[3] = 0;
+            break;
+        case DAT_WRITE_DATA:
+        {
+            if (!en)
+                break;
+            // The CRC takes the bits actually put on the lines
+            uint8_t unit = dat_visible();
+            for (int l = 0; l < (d4 ? 4 : 1); l++)
+                crc[l] = crc16_bit(crc[l], (unit >> l) & 1);
+            data_pos++;
+
+            if (dat.bit_counter == (d4 ? 7u : 31u))
+            {
+                next.bit_counter = 0;
+                next.word_counter--;
+                if (dat.word_counter == 1)
+                {
+                    next.omux = OMUX_CRC;
+                    crc_pos = 0;
+                    next.state = DAT_WRITE_CRC;
+                }
+                else if (fifo_en && !fifo.empty())
+                {
+                    // Load the next word instead of shifting, no need to stall
+                    data_reg = fifo.front();
+                    data_pos = 0;
+                    fifo.pop_front();
+                }
+                else
+                {
+                    next.clk_stall = true;
+                    next.state = DAT_WRITE_REGIN;
+                }
+            }
+            else
+            {
+                next.bit_counter++;
+            }
+            break;
+        }
+        case DAT_WRITE_CRC:
+            if (!en)
+                break;
+            if (dat.bit_counter == 15)
+            {
+                next.bit_counter = 0;
+                next.omux = OMUX_ONE;
+                next.state = DAT_WRITE_STOP;
+            }
+            else
+            {
+                crc_pos++;
+                next.bit_counter++;
+            }
+            break;
+        case DAT_WRITE_STOP:
+            if (!en)
+                break;
+            next.state = DAT_WRITE_CHECK_CRC;
+            next.dat_oe = false;
+            break;
+        case DAT_WRITE_CHECK_CRC:
+            if (!en)
+                break;
+            if (dat.bit_counter == 6)
+            {
+                next.bit_counter = 0;
+                next.write_start = true;
+                // Start bit, then token 010 in the samples before the end bit
+                next.crc_ok = ((token >> 1) & 0b111) == 0b010;
+                next.state = DAT_WRITE_BUSY;
+            }
+            else
+            {
+                next.bit_counter++;
+            }
+            token = (token << 1) | (dat_line & 1);
+            break;
+        case DAT_WRITE_BUSY:
+            if (en && (dat_line & 1) == 1)
+            {
+                next.block_done = true;
+                next.state = DAT_WRITE_TAIL;
+            }
+            break;
+        case DAT_WRITE_TAIL:
+            if (!en)
+                break;
+            if (dat.bit_counter == 7)
+            {
+                next.bit_counter = 0;
+                next.clk_stall = true;
+                next.state = DAT_WRITE_REGIN;
+            }
+            else
+            {
+                next.bit_counter++;
+            }
+            break;
+    }
+
+    // Abort, but never a busy wait
+    if (dat.state != DAT_IDLE && dat.state != DAT_TAIL && dat.state != DAT_WAIT_BUSY && (cmd_abrt || blkcnt_abrt))
+    {
+        next.clk_stall = false;
+        next.bit_counter = 0;
+        next.state = DAT_TAIL;
+    }
+
+    dat = next;
+}
+
+// The DATA register passed to start selects the model, stop uses the selected controller
+static neosd_model* neosd_model_at(const neosd_reg_t* reg)
+{
+    return static_cast<neosd_model*>(neosd_host_get(reg->address() >> 8));
+}
+
+static void neosd_model_dma_start(neosd_reg_t* reg, uint32_t* mem, size_t words, bool write)
+{
+    neosd_model_at(reg)->dma_start(mem, words, write);
+}
+
+static void neosd_model_dma_stop()
+{
+    neosd_model_at(&NEOSD->DATA)->dma_stop();
+}
+
+const neosd_dma_t neosd_model_dma = {neosd_model_dma_start, neosd_model_dma_stop};
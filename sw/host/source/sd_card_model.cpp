@@ -0,0 +1,577 @@
+#include "sd_card_model.h"
+
+#include <string.h>
+#include <unistd.h>
+
+// 4.10.1 Card Status
+enum {
+    SD_STATUS_OUT_OF_RANGE = 31,
+    SD_STATUS_COM_CRC_ERROR = 23,
+    SD_STATUS_ILLEGAL_COMMAND = 22,
+    SD_STATUS_CURRENT_STATE = 9,
+    SD_STATUS_READY_FOR_DATA = 8,
+    SD_STATUS_APP_CMD = 5
+};
+
+// CRC7 over whole bytes, most significant bit first
+static uint8_t crc7(const uint8_t* data, size_t length)
+{
+    uint8_t crc = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        for (int j = 7; j >= 0; j--)
+        {
+            bool fb = ((crc >> 6) ^ (data[i] >> j)) & 1;
+            crc = (crc << 1) & 0x7F;
+            if (fb)
+                crc ^= 0x09;
+        }
+    }
+    return crc;
+}
+
+// CRC16 (CCITT) of a single data line, one bit at a time
+static uint16_t crc16_bit(uint16_t crc, bool bit)
+{
+    bool fb = ((crc >> 15) & 1) ^ bit;
+    crc <<= 1;
+    if (fb)
+        crc ^= 0x1021;
+    return crc;
+}
+
+sd_card_model::sd_card_model(const char* image, uint64_t size, const timing_t& timing) :
+    size(size), timing(timing)
+{
+    file = fopen(image, "r+b");
+    if (file != nullptr)
+    {
+        fseeko(file, 0, SEEK_END);
+        this->size = ftello(file);
+    }
+    else
+    {
+        file = fopen(image, "w+b");
+        if (file != nullptr && ftruncate(fileno(file), size) != 0)
+        {
+            fclose(file);
+            file = nullptr;
+        }
+    }
+}
+
+sd_card_model::~sd_card_model()
+{
+    if (file != nullptr)
+        fclose(file);
+}
+
+void sd_card_model::read_image(uint64_t block, uint8_t* data)
+{
+    memset(data, 0, 512);
+    fseeko(file, block * 512, SEEK_SET);
+    if (fread(data, 1, 512, file) != 512)
+        clearerr(file);
+}
+
+void sd_card_model::write_image(uint64_t block, const uint8_t* data)
+{
+    fseeko(file, block * 512, SEEK_SET);
+    fwrite(data, 1, 512, file);
+    fflush(file);
+}
+
+void sd_card_model::clock(bool cmd_oe, bool cmd_o, uint8_t dat_oe, uint8_t dat_o)
+{
+    stat.clocks++;
+
+    // Command receiver: Start bit, then 47 bits
+    if (!cmd_oe)
+    {
+        cmd_bits = 0;
+    }
+    else if (cmd_bits != 0 || !cmd_o)
+    {
+        cmd_shift = (cmd_shift << 1) | cmd_o;
+        if (++cmd_bits == 48)
+        {
+            cmd_bits = 0;
+
+            uint8_t frame[5];
+            for (int i = 0; i < 5; i++)
+                frame[i] = cmd_shift >> (40 - 8 * i);
+
+            if ((frame[0] & 0x40) == 0 || crc7(frame, 5) != ((cmd_shift >> 1) & 0x7F))
+            {
+                status_err |= (1 << SD_STATUS_COM_CRC_ERROR);
+                stat.crc_errors++;
+            }
+            else
+            {
+                stat.commands++;
+                command(frame[0] & 0x3F, cmd_shift >> 8);
+            }
+        }
+    }
+
+    // Data receiver
+    if (dat_oe & 1)
+        receive(dat_o);
+    else
+        wr_rx = false;
+
+    // Data transmitter
+    if (rd_active && dat_queue.empty())
+    {
+        // Past the end, the card waits for CMD12
+        if (rd_block >= blocks())
+        {
+            status_err |= (1 << SD_STATUS_OUT_OF_RANGE);
+        }
+        else
+        {
+            uint8_t data[512];
+            read_image(rd_block++, data);
+            queue_block(data, 512, inject_crc());
+            stat.blocks_read++;
+            // rd_left 0: Until CMD12
+            if (rd_left != 0 && --rd_left == 0)
+                rd_active = false;
+        }
+    }
+    if ((state == DATA && !rd_active && dat_queue.empty()) || (state == PRG && dat_queue.empty()))
+        state = TRAN;
+
+    cmd_out = true;
+    if (!cmd_queue.empty())
+    {
+        cmd_out = cmd_queue.front();
+        cmd_queue.pop_front();
+    }
+
+    dat_out = 0xF;
+    if (!dat_queue.empty())
+    {
+        dat_out = dat_queue.front();
+        dat_queue.pop_front();
+    }
+}
+
+/**********************************************************************//**
+* Handle a received command. Unsupported or illegal commands get no response.
+**************************************************************************/
+void sd_card_model::command(uint8_t idx, uint32_t arg)
+{
+    bool acmd = app_cmd;
+    app_cmd = false;
+
+    if (idx == 0)
+    {
+        state = IDLE;
+        ready = false;
+        d4 = false;
+        hs = false;
+        rca = 0;
+        acmd41_calls = 0;
+        block_count = 0;
+        rd_active = false;
+        wr_active = false;
+        dat_queue.clear();
+        return;
+    }
+
+    if (acmd)
+    {
+        switch (idx)
+        {
+            case 6:
+                if (state != TRAN)
+                    break;
+                d4 = (arg & 0x3) == 0x2;
+                respond_r1(idx, false);
+                return;
+            case 23:
+                if (state != TRAN)
+                    break;
+                respond_r1(idx, false);
+                return;
+            case 41:
+            {
+                if (state != IDLE)
+                    break;
+                // Inquiry does not start initialization
+                if ((arg & 0x00FFFF00) != 0 && ++acmd41_calls >= timing.acmd41)
+                    ready = true;
+                uint32_t ocr = 0x00FF8000 | (ready ? (1u << 31) | (1u << 30) : 0);
+                // R3 has no CRC
+                for (unsigned i = 0; i < timing.ncr; i++)
+                    cmd_queue.push_back(true);
+                uint64_t r3 = (0x3FULL << 40) | ((uint64_t)ocr << 8) | 0xFF;
+                for (int i = 47; i >= 0; i--)
+                    cmd_queue.push_back((r3 >> i) & 1);
+                if (ready)
+                    state = READY;
+                return;
+            }
+            case 51:
+            {
+                if (state != TRAN)
+                    break;
+                respond_r1(idx, false);
+                // SD 3.0, 1 and 4 bit bus, CMD23 support
+                static const uint8_t scr[8] = {0x02, 0x35, 0x80, 0x02, 0x00, 0x00, 0x00, 0x00};
+                queue_block(scr, sizeof(scr));
+                state = DATA;
+                return;
+            }
+            default:
+                // Same as the standard command
+                break;
+        }
+    }
+
+    switch (idx)
+    {
+        case 2:
+        {
+            if (state != READY)
+                break;
+            uint8_t cid[16] = {0x4E, 'N', 'S', 'M', 'O', 'D', 'E', 'L', 0x10, 0x12, 0x34, 0x56, 0x78, 0x01, 0x9A, 0x00};
+            cid[15] = (crc7(cid, 15) << 1) | 1;
+            respond_long(cid);
+            state = IDENT;
+            return;
+        }
+        case 3:
+        {
+            if (state != IDENT && state != STBY)
+                break;
+            rca = 0x1234;
+            uint32_t st = (status_err & 0x00C80000) | (state << SD_STATUS_CURRENT_STATE) | (1 << SD_STATUS_READY_FOR_DATA);
+            uint32_t r6 = ((st >> 8) & 0xC000) | ((st >> 6) & 0x2000) | (st & 0x1FFF);
+            respond(idx, (rca << 16) | r6);
+            status_err = 0;
+            state = STBY;
+            return;
+        }
+        case 6:
+        {
+            if (state != TRAN)
+                break;
+            respond_r1(idx, false);
+            // 4.3.10 SWITCH_FUNC status: Group 1 supports default and high speed, the
+            // other groups only their default function. Requests of 0xF keep the current
+            // function, the result of unsupported ones is 0xF.
+            uint8_t sw[64] = {};
+            sw[1] = 100;
+            for (int g = 0; g < 6; g++)
+                sw[13 - 2 * g] = 0x01;
+            sw[13] |= 0x02;
+            for (int g = 0; g < 6; g++)
+            {
+                uint8_t fn = (arg >> (4 * g)) & 0xF;
+                if (fn == 0xF)
+                    fn = g == 0 && hs;
+                else if (fn > (g == 0 ? 1 : 0))
+                    fn = 0xF;
+                sw[16 - g / 2] |= fn << (4 * (g % 2));
+            }
+            sw[17] = 1;
+            uint8_t fn1 = sw[16] & 0xF;
+            if ((arg >> 31) && fn1 != 0xF)
+                hs = fn1 == 1;
+            queue_block(sw, sizeof(sw));
+            state = DATA;
+            return;
+        }
+        case 7:
+            if ((arg >> 16) != rca || rca == 0)
+            {
+                // Deselect, no response
+                if (state == TRAN)
+                    state = STBY;
+                return;
+            }
+            if (state != STBY && state != TRAN)
+                break;
+            respond_r1(idx, false);
+            state = TRAN;
+            return;
+        case 8:
+            if (state != IDLE)
+                break;
+            respond(idx, arg & 0xFFF);
+            return;
+        case 9:
+        {
+            if (state != STBY)
+                break;
+            // CSD version 2.0
+            uint32_t c_size = blocks() / 1024 - 1;
+            uint8_t csd[16] = {0x40, 0x0E, 0x00, 0x32, 0x5B, 0x59, 0x00, (uint8_t)((c_size >> 16) & 0x3F),
+                (uint8_t)(c_size >> 8), (uint8_t)c_size, 0x7F, 0x80, 0x0A, 0x40, 0x00, 0x00};
+            csd[15] = (crc7(csd, 15) << 1) | 1;
+            respond_long(csd);
+            return;
+        }
+        case 12:
+            if (state == DATA)
+            {
+                // Transmission stops 2 clocks after the end bit
+                respond_r1(idx, false);
+                while (dat_queue.size() > 2)
+                    dat_queue.pop_back();
+                rd_active = false;
+                return;
+            }
+            if (state == RCV)
+            {
+                respond_r1(idx, true);
+                wr_active = false;
+                wr_rx = false;
+                state = PRG;
+                return;
+            }
+            break;
+        case 13:
+            if (state < STBY)
+                break;
+            respond_r1(idx, false);
+            return;
+        case 16:
+            if (state != TRAN)
+                break;
+            respond_r1(idx, false);
+            return;
+        case 17:
+        case 18:
+            if (state != TRAN)
+                break;
+            if (arg >= blocks())
+            {
+                status_err |= (1 << SD_STATUS_OUT_OF_RANGE);
+                respond_r1(idx, false);
+                return;
+            }
+            respond_r1(idx, false);
+            rd_active = true;
+            rd_block = arg;
+            rd_left = idx == 17 ? 1 : block_count;
+            block_count = 0;
+            state = DATA;
+            return;
+        case 23:
+            if (state != TRAN)
+                break;
+            block_count = arg;
+            respond_r1(idx, false);
+            return;
+        case 24:
+        case 25:
+            if (state != TRAN)
+                break;
+            if (arg >= blocks())
+            {
+                status_err |= (1 << SD_STATUS_OUT_OF_RANGE);
+                respond_r1(idx, false);
+                return;
+            }
+            respond_r1(idx, false);
+            wr_active = true;
+            wr_rx = false;
+            wr_discard = false;
+            wr_block = arg;
+            wr_left = idx == 24 ? 1 : block_count;
+            block_count = 0;
+            state = RCV;
+            return;
+        case 55:
+            app_cmd = true;
+            respond_r1(idx, false);
+            return;
+        default:
+            break;
+    }
+
+    status_err |= (1 << SD_STATUS_ILLEGAL_COMMAND);
+}
+
+void sd_card_model::respond(uint8_t idx, uint32_t payload)
+{
+    uint8_t frame[6] = {idx, (uint8_t)(payload >> 24), (uint8_t)(payload >> 16), (uint8_t)(payload >> 8), (uint8_t)payload, 0};
+    frame[5] = (crc7(frame, 5) << 1) | 1;
+
+    for (unsigned i = 0; i < timing.ncr; i++)
+        cmd_queue.push_back(true);
+    for (int i = 0; i < 48; i++)
+        cmd_queue.push_back((frame[i / 8] >> (7 - i % 8)) & 1);
+}
+
+void sd_card_model::respond_long(const uint8_t* reg)
+{
+    for (unsigned i = 0; i < timing.ncr; i++)
+        cmd_queue.push_back(true);
+    // Start bit, transmission bit, reserved 111111
+    for (int i = 0; i < 8; i++)
+        cmd_queue.push_back(i >= 2);
+    for (int i = 0; i < 128; i++)
+        cmd_queue.push_back((reg[i / 8] >> (7 - i % 8)) & 1);
+}
+
+/**********************************************************************//**
+* R1 reports the state the card was in when receiving the command. Error
+* bits are cleared by reporting them.
+**************************************************************************/
+void sd_card_model::respond_r1(uint8_t idx, bool busy)
+{
+    uint32_t status = status_err | (state << SD_STATUS_CURRENT_STATE) |
+        (1 << SD_STATUS_READY_FOR_DATA) | (app_cmd << SD_STATUS_APP_CMD);
+    status_err = 0;
+    respond(idx, status);
+
+    if (busy)
+    {
+        dat_queue.clear();
+        queue_busy(timing.ncr + 48 + timing.busy);
+    }
+}
+
+void sd_card_model::queue_busy(unsigned clocks)
+{
+    for (unsigned i = 0; i < clocks; i++)
+        dat_queue.push_back(0xE);
+}
+
+/**********************************************************************//**
+* Whether the next data block gets a CRC error, see inject_crc_errors.
+**************************************************************************/
+bool sd_card_model::inject_crc()
+{
+    if (crc_every == 0 || ++crc_count < crc_every)
+        return false;
+    crc_count = 0;
+    stat.injected++;
+    return true;
+}
+
+/**********************************************************************//**
+* Queue a data block: Start bit, data, CRC16 per line and end bit.
+**************************************************************************/
+void sd_card_model::queue_block(const uint8_t* data, size_t length, bool bad_crc)
+{
+    for (unsigned i = 0; i < timing.nac; i++)
+        dat_queue.push_back(0xF);
+
+    uint16_t crc[4] = {0};
+    dat_queue.push_back(d4 ? 0x0 : 0xE);
+    for (size_t i = 0; i < length; i++)
+    {
+        if (d4)
+        {
+            for (int n = 1; n >= 0; n--)
+            {
+                uint8_t unit = (data[i] >> (4 * n)) & 0xF;
+                for (int l = 0; l < 4; l++)
+                    crc[l] = crc16_bit(crc[l], (unit >> l) & 1);
+                dat_queue.push_back(unit);
+            }
+        }
+        else
+        {
+            for (int b = 7; b >= 0; b--)
+            {
+                bool bit = (data[i] >> b) & 1;
+                crc[0] = crc16_bit(crc[0], bit);
+                dat_queue.push_back(0xE | bit);
+            }
+        }
+    }
+
+    if (bad_crc)
+        crc[0] ^= 1;
+    for (int b = 15; b >= 0; b--)
+    {
+        if (d4)
+        {
+            uint8_t unit = 0;
+            for (int l = 0; l < 4; l++)
+                unit |= ((crc[l] >> b) & 1) << l;
+            dat_queue.push_back(unit);
+        }
+        else
+        {
+            dat_queue.push_back(0xE | ((crc[0] >> b) & 1));
+        }
+    }
+    dat_queue.push_back(0xF);
+}
+
+/**********************************************************************//**
+* Receive one clock of a written block. After the end bit, the CRC status
+* token and busy are sent.
+**************************************************************************/
+void sd_card_model::receive(uint8_t dat)
+{
+    if (!wr_rx)
+    {
+        if ((dat & 1) == 0 && state == RCV && wr_active)
+        {
+            wr_rx = true;
+            wr_units.clear();
+        }
+        return;
+    }
+
+    wr_units.push_back(dat);
+    size_t data_units = d4 ? 1024 : 4096;
+    if (wr_units.size() < data_units + 17)
+        return;
+    wr_rx = false;
+
+    bool crc_ok = true;
+    for (int l = 0; l < (d4 ? 4 : 1); l++)
+    {
+        uint16_t crc = 0;
+        for (size_t i = 0; i < data_units + 16; i++)
+            crc = crc16_bit(crc, (wr_units[i] >> l) & 1);
+        crc_ok &= crc == 0;
+    }
+
+    if (!crc_ok)
+        stat.crc_errors++;
+    else if (inject_crc())
+        crc_ok = false;
+
+    // 4.3.4: After a CRC error, the following blocks of a multiple block write are discarded
+    if (!crc_ok)
+        wr_discard = true;
+    if (!wr_discard)
+    {
+        uint8_t data[512] = {0};
+        for (size_t i = 0; i < data_units; i++)
+        {
+            if (d4)
+                data[i / 2] |= (wr_units[i] & 0xF) << (i % 2 ? 0 : 4);
+            else
+                data[i / 8] |= (wr_units[i] & 1) << (7 - i % 8);
+        }
+        write_image(wr_block++, data);
+        stat.blocks_written++;
+    }
+
+    // Token starts 2 clocks after the end bit: 010 accepted, 101 CRC error
+    uint8_t token = crc_ok ? 0b010 : 0b101;
+    dat_queue.push_back(0xF);
+    dat_queue.push_back(0xF);
+    dat_queue.push_back(0xE);
+    for (int b = 2; b >= 0; b--)
+        dat_queue.push_back(0xE | ((token >> b) & 1));
+    dat_queue.push_back(0xF);
+    queue_busy(timing.busy);
+
+    if (wr_left != 0 && --wr_left == 0)
+    {
+        wr_active = false;
+        state = PRG;
+    }
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "neosd.h"
+#include "neosd_app.h"
+#include "neosd_stripe.h"
+#include "neosd_model.h"
+#include "neorv32.h"
+
+/*
+* Striping benchmark (NEOSD_MULTI): Two controller and card models on one
+* virtual CPU, register accesses to either one let time pass for both.
+* Transfers BENCH_BLOCKS blocks on one controller with the blocking API and
+* striped over both, then prints KiB/s for each SD clock. Returns non-zero if
+* a transfer failed or striped data does not read back.
+*/
+
+#define BENCH_CLK_HZ 100000000
+#define BENCH_ACCESS 4
+#define BENCH_BLOCKS 64
+#define BENCH_RUNS 4
+
+static uint32_t wbuf[BENCH_BLOCKS * 128], rbuf[BENCH_BLOCKS * 128];
+
+static uint32_t kib_s(uint64_t cycles)
+{
+    return (uint32_t)((uint64_t)BENCH_RUNS * BENCH_BLOCKS * BENCH_CLK_HZ / 2 / cycles);
+}
+
+static uint64_t measure(const neosd_stripe_t* stripe, bool write, bool* ok)
+{
+    uint64_t start = neorv32_cpu_get_cycle();
+    for (int i = 0; i < BENCH_RUNS; i++)
+    {
+        if (stripe == nullptr)
+            *ok &= write ? neosd_app_write_blocks(0, BENCH_BLOCKS, wbuf) : neosd_app_read_blocks(0, BENCH_BLOCKS, rbuf);
+        else
+            *ok &= write ? neosd_stripe_write(stripe, 0, BENCH_BLOCKS, wbuf) : neosd_stripe_read(stripe, 0, BENCH_BLOCKS, rbuf);
+    }
+    return neorv32_cpu_get_cycle() - start;
+}
+
+int main()
+{
+    static sd_card_model card0("build/stripe0.img", 64 << 20, sd_card_model::timing_t());
+    static sd_card_model card1("build/stripe1.img", 64 << 20, sd_card_model::timing_t());
+    static neosd_model controller0(card0, BENCH_CLK_HZ, BENCH_ACCESS);
+    static neosd_model controller1(card1, BENCH_CLK_HZ, BENCH_ACCESS);
+    static neosd_dev_t dev1;
+    if (!card0.ok() || !card1.ok())
+    {
+        fprintf(stderr, "Cannot open images\n");
+        return 1;
+    }
+    neosd_host_attach(&controller0, 0);
+    neosd_host_attach(&controller1, 1);
+    neosd_dev_init(&dev1, &neosd_host_regs[1]);
+
+    neosd_dev_t* const devs[2] = {&neosd_dev0, &dev1};
+    bool ok = true;
+    for (neosd_dev_t* dev : devs)
+    {
+        neosd_version_t ver;
+        sd_card_t info;
+        neosd_select(dev);
+        ok &= neosd_setup(3, (BENCH_CLK_HZ - 1) / (2 * 64 * 400000), &ver) &&
+            neosd_app_card_init(&info, BENCH_CLK_HZ) == NEOSD_OK && neosd_app_configure_datamode(true, info.rca);
+        neosd_app_use_fifo(true);
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Card init failed\n");
+        return 1;
+    }
+
+    neosd_stripe_t stripe;
+    neosd_stripe_init(&stripe, devs);
+    for (size_t i = 0; i < BENCH_BLOCKS * 128; i++)
+        wbuf[i] = i * 0x9E3779B9;
+
+    // HS: 2 * (cdiv + 1) system clocks per SD clock
+    printf("sd_khz,dir,blocks,single_kib_s,stripe_kib_s,gain\n");
+    for (int cdiv : {0, 1, 3, 7})
+    {
+        for (neosd_dev_t* dev : devs)
+        {
+            neosd_select(dev);
+            neosd_set_clock(0, cdiv, true);
+        }
+        neosd_select(&neosd_dev0);
+
+        for (bool write : {true, false})
+        {
+            uint64_t single = measure(nullptr, write, &ok);
+            uint64_t striped = measure(&stripe, write, &ok);
+            printf("%u,%s,%u,%u,%u,%.2f\n", (unsigned)(BENCH_CLK_HZ / 1000 / (2 * (cdiv + 1))), write ? "write" : "read",
+                BENCH_BLOCKS, kib_s(single), kib_s(striped), (double)single / striped);
+        }
+        ok &= memcmp(wbuf, rbuf, sizeof(wbuf)) == 0;
+    }
+
+    printf(ok ? "# PASS\n" : "# FAIL\n");
+    return ok ? 0 : 1;
+}
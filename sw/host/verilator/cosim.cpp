@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "neosd.h"
+#include "neosd_app.h"
+#include "neosd_rtl.h"
+#include "verilated.h"
+
+/*
+* Runs the driver on the Verilated RTL with the SD card model and reports
+* system clock cycles per 512 byte block for each bus width and clock setting.
+*/
+
+static neosd_rtl* rtl;
+static uint32_t buf[8 * 128];
+
+// System clock cycles per block for one transfer of count blocks
+static uint64_t measure(bool write, size_t count, bool* ok)
+{
+    uint64_t start = rtl->cycles();
+    if (write)
+        *ok &= count == 1 ? neosd_app_write_block(0, buf) : neosd_app_write_blocks(0, count, buf);
+    else
+        *ok &= count == 1 ? neosd_app_read_block(0, buf) : neosd_app_read_blocks(0, count, buf);
+    return (rtl->cycles() - start) / count;
+}
+
+int main(int argc, char** argv)
+{
+    const char* image = "cosim.img";
+    uint32_t clk_mhz = 100, access = 4;
+    int max_prsc = 7;
+    size_t count = 8;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "i:c:a:P:n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'i': image = optarg; break;
+            case 'c': clk_mhz = strtoul(optarg, nullptr, 0); break;
+            case 'a': access = strtoul(optarg, nullptr, 0); break;
+            case 'P': max_prsc = strtol(optarg, nullptr, 0); break;
+            case 'n': count = strtoul(optarg, nullptr, 0); break;
+            default:
+                fprintf(stderr, "Usage: %s [-i image] [-c MHz] [-a access cycles] [-P max prsc] [-n blocks <= 8]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (count < 2 || count > 8)
+        count = 8;
+
+    Verilated::commandArgs(argc, argv);
+    sd_card_model::timing_t timing;
+    sd_card_model card(image, 64 << 20, timing);
+    if (!card.ok())
+    {
+        fprintf(stderr, "Cannot open %s\n", image);
+        return 1;
+    }
+    neosd_rtl controller(card, clk_mhz * 1000000, access);
+    rtl = &controller;
+    neosd_host_attach(&controller);
+
+    neosd_version_t ver;
+    if (!neosd_setup(3, (clk_mhz * 1000000 - 1) / (2 * 64 * 400000), &ver))
+    {
+        fprintf(stderr, "NEOSD: Controller not found\n");
+        return 1;
+    }
+
+    sd_card_t info;
+    SD_CODE code = neosd_app_card_init(&info, clk_mhz * 1000000);
+    if (code != NEOSD_OK)
+    {
+        fprintf(stderr, "Card init failed: %d\n", code);
+        return 1;
+    }
+
+    for (size_t i = 0; i < sizeof(buf) / sizeof(buf[0]); i++)
+        buf[i] = i * 0x01010101;
+
+    // One row per setting, HS: 2 * (cdiv + 1) system clocks per SD clock
+    static const uint32_t PRSC_LUT[8] = {2, 4, 8, 64, 128, 1024, 2048, 4096};
+    printf("bus,prsc,cdiv,hs,sd_khz,read_1,read_%u,write_1,write_%u\n", (unsigned)count, (unsigned)count);
+    bool ok = true;
+    for (bool d4 : {false, true})
+    {
+        ok &= neosd_app_configure_datamode(d4, info.rca);
+        for (int setting = -2; setting <= max_prsc; setting++)
+        {
+            bool hs = setting < 0;
+            int prsc = hs ? 0 : setting;
+            int cdiv = hs ? setting + 2 : 0;
+            neosd_set_clock(prsc, cdiv, hs);
+
+            uint32_t div = (hs ? 2 : 2 * PRSC_LUT[prsc]) * (cdiv + 1);
+            uint64_t r1 = measure(false, 1, &ok);
+            uint64_t rn = measure(false, count, &ok);
+            uint64_t w1 = measure(true, 1, &ok);
+            uint64_t wn = measure(true, count, &ok);
+            printf("%s,%d,%d,%d,%u,%llu,%llu,%llu,%llu\n", d4 ? "D4" : "D1", prsc, cdiv, hs,
+                (unsigned)(clk_mhz * 1000 / div), (unsigned long long)r1, (unsigned long long)rn,
+                (unsigned long long)w1, (unsigned long long)wn);
+            fflush(stdout);
+        }
+    }
+
+    if (!ok || card.stats().crc_errors != 0)
+    {
+        fprintf(stderr, "Transfer failed\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include "neosd_rtl.h"
+#include "Vneosd.h"
+#include "verilated.h"
+
+neosd_rtl::neosd_rtl(sd_card_model& card, uint32_t clk_hz, uint32_t access_cycles) :
+    top(new Vneosd), card(card), clk_hz(clk_hz), access_cycles(access_cycles)
+{
+    top->clk_i = 0;
+    top->rstn_i = 0;
+    top->wb_stb_i = 0;
+    top->wb_cyc_i = 0;
+    top->wb_we_i = 0;
+    top->sd_cmd_i = 1;
+    top->sd_dat_i = 0xF;
+    for (int i = 0; i < 4; i++)
+        step();
+    top->rstn_i = 1;
+    step();
+}
+
+neosd_rtl::~neosd_rtl()
+{
+    top->final();
+    delete top;
+}
+
+/**********************************************************************//**
+* One system clock. Lines not driven by the RTL are driven by the card or
+* pulled up.
+**************************************************************************/
+void neosd_rtl::step()
+{
+    top->clk_i = 0;
+    top->eval();
+    top->clk_i = 1;
+    top->eval();
+    now++;
+
+    bool sd_clk = top->sd_clk_o;
+    if (sd_clk_last && !sd_clk)
+        card.clock(top->sd_cmd_oe, top->sd_cmd_o, top->sd_dat_oe, top->sd_dat_o);
+    sd_clk_last = sd_clk;
+
+    top->sd_cmd_i = top->sd_cmd_oe ? top->sd_cmd_o : card.cmd();
+    top->sd_dat_i = ((top->sd_dat_o & top->sd_dat_oe) | (card.dat() & ~top->sd_dat_oe)) & 0xF;
+}
+
+// Single Wishbone cycle, the RTL acknowledges with one cycle latency
+uint32_t neosd_rtl::bus(uint32_t addr, uint32_t data, bool we)
+{
+    for (uint32_t i = 0; i < access_cycles; i++)
+        step();
+
+    top->wb_adr_i = addr;
+    top->wb_dat_i = data;
+    top->wb_we_i = we;
+    top->wb_sel_i = 0xF;
+    top->wb_stb_i = 1;
+    top->wb_cyc_i = 1;
+    do
+    {
+        step();
+        top->wb_stb_i = 0;
+    } while (!top->wb_ack_o);
+
+    uint32_t result = top->wb_dat_o;
+    top->wb_cyc_i = 0;
+    top->wb_we_i = 0;
+    return result;
+}
+
+uint32_t neosd_rtl::read(uint32_t addr)
+{
+    return bus(addr, 0, false);
+}
+
+void neosd_rtl::write(uint32_t addr, uint32_t data)
+{
+    bus(addr, data, true);
+}
+
+uint64_t neosd_rtl::cycles()
+{
+    // CLINT is a bus access as well
+    for (uint32_t i = 0; i < access_cycles; i++)
+        step();
+    return now;
+}
+
+void neosd_rtl::delay(uint64_t cycles)
+{
+    for (uint64_t i = 0; i < cycles; i++)
+        step();
+}
+
+bool neosd_rtl::irq() const
+{
+    return top->irq_o;
+}
+
+bool neosd_rtl::flag_data() const
+{
+    return top->flag_data_o;
+}
@@ -3,6 +3,11 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#ifdef NEOSD_HOST
+    // Host build: Registers are provided by a behavioral model, see sw/host
+    #include "neosd_host.h"
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -11,19 +16,30 @@ extern "C" {
         #define NEOSD_BASE   (0xFFD20000U)
     #endif
 
-    typedef volatile struct __attribute__((packed,aligned(4))) {
+#ifndef NEOSD_HOST
+    typedef volatile uint32_t neosd_reg_t;
+
+    typedef volatile struct __attribute__((packed,aligned(4))) neosd_regs {
         uint32_t INFO;
         uint32_t CTRL;
         uint32_t CMDARG;
         uint32_t CMD;
         uint32_t RESP;
         uint32_t DATA;
+        uint32_t STATUS;
+        uint32_t FLAGS;
+        uint32_t BLKCNT;
+        uint32_t FIFO;
     } neosd_t;
 
+    #define NEOSD_DEV0_REGS ((neosd_t*) (NEOSD_BASE))
+#endif
+
     enum NEOSD_INFO {
         NEOSD_INFO_PATCH         =  0,
         NEOSD_INFO_MINOR         =  4,
         NEOSD_INFO_MAJOR         =  8,
+        NEOSD_INFO_FIFO          =  12,
         NEOSD_INFO_MAGIC         =  16,
     };
 
@@ -32,6 +48,7 @@ extern "C" {
     enum NEOSD_CTRL {
         NEOSD_CTRL_RST           =  0,
         NEOSD_CTRL_D4            =  1,
+        NEOSD_CTRL_FIFO          =  2,
         NEOSD_CTRL_IDLE_SDCLK    =  3,
         NEOSD_CTRL_PRSC0         =  4,
         NEOSD_CTRL_PRSC1         =  5,
@@ -44,6 +61,7 @@ extern "C" {
         NEOSD_CTRL_DAT_BUSY      =  12,
         NEOSD_CTRL_CMD_BUSY      =  13,
         NEOSD_CTRL_CRCERR        =  14,
+        NEOSD_CTRL_RESP_CRCERR   =  15,
         
         NEOSD_CTRL_FLAG_CMD_RESP =  16,
         NEOSD_CTRL_FLAG_DAT_DATA =  17,
@@ -61,6 +79,7 @@ extern "C" {
     enum NEOSD_CMD {
         NEOSD_CMD_COMMIT          =  0,
         NEOSD_CMD_ABRT_DAT        =  1,
+        NEOSD_CMD_AUTO_CRC        =  2,
         
         NEOSD_CMD_DMODE0          =  4,
         NEOSD_CMD_DMODE1          =  5,
@@ -73,6 +92,19 @@ extern "C" {
         NEOSD_CMD_IDX_MSB         =  29
     };
 
+    enum NEOSD_BLKCNT {
+        NEOSD_BLKCNT_COUNT_LSB    =  0,
+        NEOSD_BLKCNT_COUNT_MSB    =  23,
+        NEOSD_BLKCNT_AUTO_CMD12   =  31
+    };
+
+    enum NEOSD_FIFO {
+        NEOSD_FIFO_LEVEL_LSB      =  0,
+        NEOSD_FIFO_LEVEL_MSB      =  15,
+        NEOSD_FIFO_WM_LSB         =  16,
+        NEOSD_FIFO_WM_MSB         =  31
+    };
+
     enum NEOSD_RMODE {
         NEOSD_RMODE_NONE          =  0,
         NEOSD_RMODE_SHORT         =  1,
@@ -122,8 +154,6 @@ extern "C" {
         NEOSD_TIMEOUT = 4
     };
 
-    #define NEOSD ((neosd_t*) (NEOSD_BASE))
-
     // 4.9 Responses
     typedef struct __attribute__((packed)) {
         bool _ebit: 1;
@@ -204,6 +234,9 @@ extern "C" {
 
     // Low-level helper functions
     uint8_t neosd_crc7(const uint8_t* data, size_t length);
+    uint8_t neosd_crc7_bitwise(const uint8_t* data, size_t length);
+    uint8_t neosd_crc7_nibble(const uint8_t* data, size_t length);
+    uint8_t neosd_crc7_table(const uint8_t* data, size_t length);
     uint8_t neosd_cmd_crc(uint8_t cmd_idx, uint32_t cmd_arg);
     uint8_t neosd_rshort_crc(neosd_rshort_t* data);
     bool neosd_rshort_check(neosd_rshort_t* data);
@@ -214,21 +247,210 @@ extern "C" {
         uint8_t major, minor, patch;
     } neosd_version_t;
 
+    // DMA hook: Move one word between DATA and memory whenever flag_data_o is set.
+    // The request is level sensitive and cleared by the DATA access.
+    typedef struct {
+        // Start moving words, write: memory to DATA register
+        void (*start)(neosd_reg_t* reg, uint32_t* mem, size_t words, bool write);
+        // Cancel a started transfer
+        void (*stop)();
+    } neosd_dma_t;
+
+    // Time source for timeouts: Free-running 32 bit tick counter and its rate. The
+    // default counts mcycle at the system clock.
+    typedef struct {
+        uint32_t (*ticks)();
+        uint32_t (*hz)();
+    } neosd_time_t;
+
+    // Timeout as a tick deadline, see neosd_deadline_ms
+    typedef struct {
+        uint32_t start;
+        uint32_t ticks;
+    } neosd_deadline_t;
+
+    typedef struct {
+        union {
+            struct __attribute__((packed)) {
+                uint8_t _dummy : 1;
+                uint8_t crc : 7;
+                uint16_t mdt : 12;
+                uint8_t _dummy2 : 4;
+                uint32_t psn;
+                uint8_t prv;
+                char pnm[5];
+                char oid[2];
+                uint8_t mid;
+            };
+            uint32_t _raw[4];
+        };
+    } cid_reg_t;
+
+    typedef struct {
+        uint8_t ccs: 1;
+        uint8_t uhs2: 1;
+        uint8_t s18a: 1;
+        uint8_t hs: 1; // Switched to high speed in card init
+        uint32_t ocr;
+        cid_reg_t cid; // FIXME: Also get CSR?
+        uint16_t rca;
+        uint32_t scr[2]; // scr[1] holds bits 63:32
+        uint8_t cmd_support;
+    } sd_card_t;
+
+    // Data link state, reset by card init
+    typedef struct {
+        uint32_t blocks;      // Transferred blocks, including retries
+        uint32_t crc_errors;  // Blocks with CRC errors
+        uint32_t retries;     // Blocks transferred again
+        uint32_t failures;    // Blocks still bad after NEOSD_CRC_RETRIES
+        uint8_t clock_level;  // 0: Card init clock, up to NEOSD_CLOCK_LEVELS
+        uint32_t clock_hz;    // Current SD clock
+    } neosd_link_stats_t;
+
+    struct neosd_xfer;
+
+    // One controller and its card. All driver functions work on the selected device, see
+    // neosd_select. Create devices with neosd_dev_init, neosd_dev0 is the one at NEOSD_BASE.
+    typedef struct neosd_device {
+        neosd_t* regs;
+
+        // Controller features, set by neosd_setup
+        bool auto_crc;        // Generates command CRCs and checks response CRCs (0.2.0 and later)
+        bool status_regs;     // STATUS and write-1-to-clear FLAGS registers (0.3.0 and later)
+        bool blkcnt;          // Block counter with automatic stop (0.4.0 and later)
+        size_t fifo_words;    // Data FIFO words, 0 without FIFO (0.5.0 and later)
+        const neosd_dma_t* dma;
+
+        // Card, set by neosd_app_card_init
+        sd_card_t card;
+        uint32_t clk_hz;      // System clock in Hz, 0 before card init
+        bool cmd23;           // Multi-block transfers use CMD23 SET_BLOCK_COUNT
+        bool cmd23_support;
+        bool cmd6_support;    // CMD6 SWITCH_FUNC, from SCR
+        bool fifo_on;         // CPU transfers use FIFO mode, off by default, see neosd_app_use_fifo
+
+        // Internal: CRC error accounting and clock backoff (neosd_app.cpp)
+        struct {
+            neosd_link_stats_t stats;
+            uint32_t max_hz;  // SD clock of level 0, 0 until card init completes
+            uint32_t errors;  // CRC errors since the last clean period
+            uint32_t clean;   // Blocks without CRC errors in a row
+        } link;
+
+        // Internal: Open-ended CMD18 transfer kept alive between neosd_app_stream_read calls
+        struct {
+            bool active;
+            bool reopen;      // CMD18 is only sent again by the next read, see neosd_app_stream_read
+            bool cmd_done;
+            size_t next;
+            neosd_res_t resp;
+            uint32_t* rptr;
+        } stream;
+
+        // Internal: Write-behind, the last block of the last write is still in its busy phase
+        struct {
+            uint32_t* copy;   // Data of the pending block for a retry, nullptr: Write-behind off
+            bool pending;
+            bool fifo;
+            bool failed;      // A completed write-behind failed, reported by neosd_app_write_sync
+            size_t count;     // Blocks of the pending write, accounted once it is done
+            size_t block;     // The pending block
+        } behind;
+
+        // Internal: Interrupt driven transfer owning the controller (neosd_irq.cpp)
+        struct neosd_xfer* volatile xfer;
+    } neosd_dev_t;
+
+    extern neosd_dev_t neosd_dev0;
+
+#ifdef NEOSD_MULTI
+    // Several controllers: Registers and state are reached through the selected device
+    extern neosd_dev_t* neosd_dev;
+    #define NEOSD (neosd_dev->regs)
+
+    void neosd_dev_init(neosd_dev_t* dev, neosd_t* regs);
+    void neosd_select(neosd_dev_t* dev);
+#else
+    // Single controller: Constant register and state addresses, no indirection
+    #define neosd_dev (&neosd_dev0)
+    #define NEOSD NEOSD_DEV0_REGS
+#endif
+
+    // Read a register only for its side effect, e.g. to acknowledge a data word
+    static inline void neosd_discard(uint32_t) {}
+
+    /**********************************************************************//**
+    * Busy, error and flag bits at their NEOSD_CTRL positions.
+    **************************************************************************/
+    static inline uint32_t neosd_status()
+    {
+        if (neosd_dev->status_regs)
+            return NEOSD->STATUS;
+        return NEOSD->CTRL;
+    }
+
+    /**********************************************************************//**
+    * Clear flag and error bits (NEOSD_CTRL positions). With the FLAGS
+    * register this is a single store and cannot lose flags raised by the
+    * controller in the meantime. NEOSD_CTRL_FLAG_CMD_RESP and
+    * NEOSD_CTRL_FLAG_DAT_DATA are cleared by RESP / DATA access only.
+    **************************************************************************/
+    static inline void neosd_ack(uint32_t flags)
+    {
+        if (neosd_dev->status_regs)
+            NEOSD->FLAGS = flags;
+        else
+            NEOSD->CTRL &= ~flags;
+    }
+
+    /**********************************************************************//**
+    * Read-modify-write of the CTRL configuration and interrupt masks. A CTRL
+    * write clears the error and flag bits written as 0, so from 0.3.0 on they
+    * are written as 1 to keep flags raised between the read and the write.
+    **************************************************************************/
+    static inline void neosd_ctrl_modify(uint32_t clear, uint32_t set)
+    {
+        uint32_t ctrl = (NEOSD->CTRL & ~clear) | set;
+        if (neosd_dev->status_regs)
+            ctrl |= (0b11 << NEOSD_CTRL_CRCERR) | (0b11111 << NEOSD_CTRL_FLAG_CMD_RESP);
+        NEOSD->CTRL = ctrl;
+    }
+
+    /**********************************************************************//**
+    * Words in the data FIFO. Only valid in FIFO mode, see neosd_set_fifo.
+    **************************************************************************/
+    static inline size_t neosd_fifo_level()
+    {
+        return NEOSD->FIFO & 0xFFFF;
+    }
+
     // Generic driver functions
     bool neosd_setup(int prsc, int cdiv, neosd_version_t* ver);
     uint32_t neosd_get_clock_speed();
     void neosd_set_clock(int prsc, int cdiv, bool hs);
+    uint32_t neosd_set_clock_max(uint32_t clk_hz, uint32_t max_hz);
     void neosd_begin_reset();
     void neosd_end_reset();
     void neosd_set_idle_clk(bool active);
     int neosd_busy();
+    void neosd_set_dma(const neosd_dma_t* dma);
+    const neosd_dma_t* neosd_get_dma();
+    bool neosd_set_block_count(size_t count, bool cmd12);
+    size_t neosd_fifo_size();
+    bool neosd_set_fifo(bool enable, size_t watermark);
 
     // Command functions
     void neosd_cmd_commit(SD_CMD_IDX cmd, uint32_t arg, NEOSD_RMODE rmode, NEOSD_DMODE dmode, bool stopDAT = false);
+    void neosd_cmd_commit_word(uint32_t word, uint32_t arg);
 
     // Blocking functions (neosd_block.cpp)
     void neosd_reset();
     uint64_t neosd_clint_time_get_ms();
+    void neosd_set_time_source(const neosd_time_t* time);
+    neosd_deadline_t neosd_deadline_ms(uint32_t ms);
+    void neosd_deadline_restart(neosd_deadline_t* deadline);
+    bool neosd_deadline_expired(const neosd_deadline_t* deadline);
     void neosd_wait_idle();
     bool neosd_cmd_wait_res(neosd_res_t* res, uint32_t rtimeout);
     SD_CODE neosd_acmd_commit(SD_CMD_IDX acmd, uint32_t arg, NEOSD_RMODE rmode, NEOSD_DMODE dmode, sd_status_t* status, size_t rca, uint32_t rtimeout);
@@ -237,4 +459,36 @@ extern "C" {
 
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
+
+#ifdef __cplusplus
+    // CRC7 of data bits bit..0, MSB first. Compile-time counterpart of neosd_crc7.
+    constexpr uint8_t neosd_crc7_bits(uint64_t data, int bit, uint8_t crc = 0)
+    {
+        return bit < 0 ? crc : neosd_crc7_bits(data, bit - 1,
+            ((crc << 1) & 0x7F) ^ ((((crc >> 6) ^ (data >> bit)) & 1) ? 0x09 : 0x00));
+    }
+
+    /**********************************************************************//**
+    * CMD register word including the CRC, as written by neosd_cmd_commit.
+    **************************************************************************/
+    constexpr uint32_t neosd_cmd_word(SD_CMD_IDX cmd, uint32_t arg, NEOSD_RMODE rmode, NEOSD_DMODE dmode,
+        bool stopDAT = false)
+    {
+        return (1u << NEOSD_CMD_COMMIT) | ((uint32_t)dmode << NEOSD_CMD_DMODE0) |
+            ((uint32_t)rmode << NEOSD_CMD_RMODE0) | ((uint32_t)cmd << NEOSD_CMD_IDX_LSB) |
+            (stopDAT ? (1u << NEOSD_CMD_ABRT_DAT) : 0) |
+            ((uint32_t)neosd_crc7_bits(((uint64_t)(0x40 | cmd) << 32) | arg, 39) << NEOSD_CMD_CRC_LSB);
+    }
+
+    /**********************************************************************//**
+    * Commit a command with constant argument. The CMD register word is
+    * computed at compile time.
+    **************************************************************************/
+    template <SD_CMD_IDX cmd, uint32_t arg, NEOSD_RMODE rmode, NEOSD_DMODE dmode, bool stopDAT = false>
+    inline void neosd_cmd_commit_const()
+    {
+        constexpr uint32_t word = neosd_cmd_word(cmd, arg, rmode, dmode, stopDAT);
+        neosd_cmd_commit_word(word, arg);
+    }
+#endif
@@ -9,37 +9,61 @@ extern "C" {
 #endif
 
     #define NEOSD_CMD_TIMEOUT 100
+    // Multi-block writes of at least this many blocks pre-erase using ACMD23
+    #define NEOSD_PREERASE_BLOCKS 8
+    // Blocks with CRC errors are transferred again up to this many times
+    #define NEOSD_CRC_RETRIES 3
+    // Failed blocks of one multi-block read retried one by one, the rest is read again
+    #define NEOSD_CRC_MAX_FAILED 8
+    // The SD clock steps down one level after this many CRC errors without a clean period,
+    // and back up after this many blocks without CRC errors
+    #define NEOSD_CRC_BACKOFF_ERRORS 4
+    #define NEOSD_CRC_CLEAN_BLOCKS 1024
+    // Each level halves the SD clock selected by card init
+    #define NEOSD_CLOCK_LEVELS 6
 
-    typedef struct {
-        union {
-            struct __attribute__((packed)) {
-                uint8_t _dummy : 1;
-                uint8_t crc : 7;
-                uint16_t mdt : 12;
-                uint8_t _dummy2 : 4;
-                uint32_t psn;
-                uint8_t prv;
-                char pnm[5];
-                char oid[2];
-                uint8_t mid;
-            };
-            uint32_t _raw[4];
-        };
-    } cid_reg_t;
-
-    typedef struct {
-        uint8_t ccs: 1;
-        uint8_t uhs2: 1;
-        uint8_t s18a: 1;
-        uint32_t ocr;
-        cid_reg_t cid; // FIXME: Also get CSR?
-        uint16_t rca;
-    } sd_card_t;
-
-
-    SD_CODE neosd_app_card_init(sd_card_t* info);
+    // 5.6 SCR register: CMD_SUPPORT bits
+    enum {
+        SD_SCR_CMD20 = 0,
+        SD_SCR_CMD23 = 1,
+        SD_SCR_CMD48 = 2,
+        SD_SCR_CMD58 = 3
+    };
+
+    // 4.10.1 Card Status: CURRENT_STATE, the card is in PRG while programming written blocks
+    enum {
+        SD_STATUS_CURRENT_STATE = 9,
+        SD_STATE_TRAN = 4,
+        SD_STATE_PRG = 7
+    };
+
+    SD_CODE neosd_app_card_init(sd_card_t* info, uint32_t clk_hz);
     bool neosd_app_configure_datamode(bool d4mode, uint16_t rca);
+    bool neosd_app_use_cmd23(bool enable);
+    bool neosd_app_use_fifo(bool enable);
+    bool neosd_app_switch_hs(uint32_t clk_hz);
+    void neosd_app_get_link_stats(neosd_link_stats_t* stats);
     bool neosd_app_read_block(size_t block, uint32_t* buf);
+    bool neosd_app_read_blocks(size_t block, size_t count, uint32_t* buf);
+    bool neosd_app_write_block(size_t block, const uint32_t* buf);
+    bool neosd_app_write_blocks(size_t block, size_t count, const uint32_t* buf);
+
+    // Write-behind: Writes return before the card finished programming their last block
+    bool neosd_app_use_write_behind(uint32_t* copy);
+    bool neosd_app_write_pending();
+    bool neosd_app_write_sync();
+    SD_CODE neosd_app_card_status(sd_status_t* status);
+
+    // Consumer of streamed data words, the first data byte is in bits 7:0
+    typedef void (*neosd_sink_t)(void* user, uint32_t word);
+
+    // Open-ended CMD18 read stream. Other transfers close an open stream first.
+    void neosd_app_stream_open(size_t block);
+    bool neosd_app_stream_read(size_t count, uint32_t* buf);
+    bool neosd_app_stream_sink(size_t count, neosd_sink_t sink, void* user);
+    bool neosd_app_stream_close();
+    bool neosd_app_stream_active();
+    size_t neosd_app_stream_next();
     
 #ifdef __cplusplus
 }
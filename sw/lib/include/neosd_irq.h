@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "neosd.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    enum NEOSD_XFER_STATE {
+        NEOSD_XFER_IDLE           =  0,
+        // Command was committed, waiting for response
+        NEOSD_XFER_CMD            =  1,
+        // Transferring data blocks
+        NEOSD_XFER_DATA           =  2,
+        // Last block done, waiting for stop command / busy and controller idle
+        NEOSD_XFER_STOP           =  3,
+        NEOSD_XFER_DONE           =  4,
+        NEOSD_XFER_ERROR          =  5
+    };
+
+    typedef struct neosd_xfer neosd_xfer_t;
+    typedef void (*neosd_xfer_cb_t)(neosd_xfer_t* xfer);
+
+    // A single transfer: One command, optionally followed by data blocks and a stop
+    struct neosd_xfer {
+        // Request
+        SD_CMD_IDX cmd;
+        uint32_t arg;
+        NEOSD_RMODE rmode;
+        NEOSD_DMODE dmode;
+        // Data for NEOSD_DMODE_READ / NEOSD_DMODE_WRITE, 128 words per block
+        uint32_t* buf;
+        size_t blocks;
+        // Send CMD12 after the last block. Otherwise only the data FSM is stopped.
+        bool stop;
+        // Called from interrupt context after the transfer is done
+        neosd_xfer_cb_t callback;
+        void* user;
+
+        // Result, response of the last command (CMD12 if stop was sent)
+        neosd_res_t resp;
+        volatile NEOSD_XFER_STATE state;
+        bool crc_ok;
+
+        // Internal
+        uint32_t* rptr;
+        uint32_t* dptr;
+        uint32_t* dend;
+        size_t blocks_done;
+        bool cmd_pending;
+    };
+
+    // Transfer setup helpers
+    void neosd_xfer_cmd(neosd_xfer_t* xfer, SD_CMD_IDX cmd, uint32_t arg, NEOSD_RMODE rmode, NEOSD_DMODE dmode);
+    void neosd_xfer_read(neosd_xfer_t* xfer, size_t block, size_t count, uint32_t* buf);
+    void neosd_xfer_write(neosd_xfer_t* xfer, size_t block, size_t count, const uint32_t* buf);
+
+    // Interrupt driven transfers (neosd_irq.cpp)
+    bool neosd_irq_submit(neosd_xfer_t* xfer, neosd_xfer_cb_t callback, void* user);
+    void neosd_irq_handler();
+#ifdef NEOSD_MULTI
+    void neosd_irq_dev_handler(neosd_dev_t* dev);
+#endif
+    bool neosd_irq_busy();
+    void neosd_irq_abort();
+    NEOSD_XFER_STATE neosd_irq_wait(neosd_xfer_t* xfer);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "neosd.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef NEOSD_MULTI
+    // Controllers of a striped device
+    #ifndef NEOSD_STRIPE_WAYS
+        #define NEOSD_STRIPE_WAYS 2
+    #endif
+    // Consecutive blocks on one controller before the next one follows, power of 2
+    #ifndef NEOSD_STRIPE_CHUNK
+        #define NEOSD_STRIPE_CHUNK 8
+    #endif
+
+    // Several cards as one block device: Chunk c is block (c / NEOSD_STRIPE_WAYS) *
+    // NEOSD_STRIPE_CHUNK of controller c % NEOSD_STRIPE_WAYS. The controllers have to be
+    // initialized with neosd_app_card_init and in the same data mode.
+    typedef struct neosd_stripe {
+        neosd_dev_t* dev[NEOSD_STRIPE_WAYS];
+    } neosd_stripe_t;
+
+    // Striped transfers (neosd_stripe.cpp)
+    void neosd_stripe_init(neosd_stripe_t* stripe, neosd_dev_t* const* devs);
+    bool neosd_stripe_read(const neosd_stripe_t* stripe, size_t block, size_t count, uint32_t* buf);
+    bool neosd_stripe_write(const neosd_stripe_t* stripe, size_t block, size_t count, const uint32_t* buf);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -5,4 +5,5 @@ APP_INC += -I $(NEOSD_HOME)/sw/lib/include
 APP_SRC += $(NEOSD_HOME)/sw/lib/source/neosd_block.cpp \
     $(NEOSD_HOME)/sw/lib/source/neosd_dbg.cpp \
     $(NEOSD_HOME)/sw/lib/source/neosd_app.cpp \
+    $(NEOSD_HOME)/sw/lib/source/neosd_irq.cpp \
 	$(NEOSD_HOME)/sw/lib/source/neosd.cpp
\ No newline at end of file
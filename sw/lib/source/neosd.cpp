@@ -1,4 +1,5 @@
 #include "neosd.h"
+#include "neorv32.h"
 
 extern "C" {
     /*
@@ -7,13 +8,41 @@ extern "C" {
     */
     #define CRC7_POLY 0x89
 
+    neosd_dev_t neosd_dev0 = {NEOSD_DEV0_REGS};
+#ifdef NEOSD_MULTI
+    neosd_dev_t* neosd_dev = &neosd_dev0;
+
     /**********************************************************************//**
-    * Get CRC7 according to SD standard.
+    * Setup the state of a controller at regs. Select it and call neosd_setup
+    * before using it.
+    **************************************************************************/
+    void neosd_dev_init(neosd_dev_t* dev, neosd_t* regs)
+    {
+        *dev = {};
+        dev->regs = regs;
+    }
+
+    /**********************************************************************//**
+    * Select the controller all following driver calls work on.
+    *
+    * @note Interrupt handlers of other controllers must restore the
+    * selection, see neosd_irq_dev_handler.
+    **************************************************************************/
+    void neosd_select(neosd_dev_t* dev)
+    {
+        neosd_dev = dev;
+    }
+#endif
+    // System clocks per prescaler tick, indexed by CTRL PRSC
+    static const uint16_t NEOSD_PRSC_LUT[8] = {2, 4, 8, 64, 128, 1024, 2048, 4096};
+
+    /**********************************************************************//**
+    * Get CRC7 according to SD standard, one bit per iteration.
     *
     * @note This implementation processes data from the most-significant byte
     * (data[length -1]) first.
     **************************************************************************/
-    uint8_t neosd_crc7(const uint8_t* data, size_t length)
+    uint8_t neosd_crc7_bitwise(const uint8_t* data, size_t length)
     {
         uint8_t crc = 0;
         for (size_t i = 0; i < length; i++)
@@ -31,6 +60,74 @@ extern "C" {
         return crc >> 1;
     }
 
+    // CRC register after shifting in 8 bits of i, kept left aligned as crc << 1
+    static const uint8_t neosd_crc7_lut[256] = {
+        0x00, 0x12, 0x24, 0x36, 0x48, 0x5A, 0x6C, 0x7E, 0x90, 0x82, 0xB4, 0xA6, 0xD8, 0xCA, 0xFC, 0xEE,
+        0x32, 0x20, 0x16, 0x04, 0x7A, 0x68, 0x5E, 0x4C, 0xA2, 0xB0, 0x86, 0x94, 0xEA, 0xF8, 0xCE, 0xDC,
+        0x64, 0x76, 0x40, 0x52, 0x2C, 0x3E, 0x08, 0x1A, 0xF4, 0xE6, 0xD0, 0xC2, 0xBC, 0xAE, 0x98, 0x8A,
+        0x56, 0x44, 0x72, 0x60, 0x1E, 0x0C, 0x3A, 0x28, 0xC6, 0xD4, 0xE2, 0xF0, 0x8E, 0x9C, 0xAA, 0xB8,
+        0xC8, 0xDA, 0xEC, 0xFE, 0x80, 0x92, 0xA4, 0xB6, 0x58, 0x4A, 0x7C, 0x6E, 0x10, 0x02, 0x34, 0x26,
+        0xFA, 0xE8, 0xDE, 0xCC, 0xB2, 0xA0, 0x96, 0x84, 0x6A, 0x78, 0x4E, 0x5C, 0x22, 0x30, 0x06, 0x14,
+        0xAC, 0xBE, 0x88, 0x9A, 0xE4, 0xF6, 0xC0, 0xD2, 0x3C, 0x2E, 0x18, 0x0A, 0x74, 0x66, 0x50, 0x42,
+        0x9E, 0x8C, 0xBA, 0xA8, 0xD6, 0xC4, 0xF2, 0xE0, 0x0E, 0x1C, 0x2A, 0x38, 0x46, 0x54, 0x62, 0x70,
+        0x82, 0x90, 0xA6, 0xB4, 0xCA, 0xD8, 0xEE, 0xFC, 0x12, 0x00, 0x36, 0x24, 0x5A, 0x48, 0x7E, 0x6C,
+        0xB0, 0xA2, 0x94, 0x86, 0xF8, 0xEA, 0xDC, 0xCE, 0x20, 0x32, 0x04, 0x16, 0x68, 0x7A, 0x4C, 0x5E,
+        0xE6, 0xF4, 0xC2, 0xD0, 0xAE, 0xBC, 0x8A, 0x98, 0x76, 0x64, 0x52, 0x40, 0x3E, 0x2C, 0x1A, 0x08,
+        0xD4, 0xC6, 0xF0, 0xE2, 0x9C, 0x8E, 0xB8, 0xAA, 0x44, 0x56, 0x60, 0x72, 0x0C, 0x1E, 0x28, 0x3A,
+        0x4A, 0x58, 0x6E, 0x7C, 0x02, 0x10, 0x26, 0x34, 0xDA, 0xC8, 0xFE, 0xEC, 0x92, 0x80, 0xB6, 0xA4,
+        0x78, 0x6A, 0x5C, 0x4E, 0x30, 0x22, 0x14, 0x06, 0xE8, 0xFA, 0xCC, 0xDE, 0xA0, 0xB2, 0x84, 0x96,
+        0x2E, 0x3C, 0x0A, 0x18, 0x66, 0x74, 0x42, 0x50, 0xBE, 0xAC, 0x9A, 0x88, 0xF6, 0xE4, 0xD2, 0xC0,
+        0x1C, 0x0E, 0x38, 0x2A, 0x54, 0x46, 0x70, 0x62, 0x8C, 0x9E, 0xA8, 0xBA, 0xC4, 0xD6, 0xE0, 0xF2
+    };
+
+    /**********************************************************************//**
+    * Get CRC7 according to SD standard, one table lookup per byte.
+    **************************************************************************/
+    uint8_t neosd_crc7_table(const uint8_t* data, size_t length)
+    {
+        uint8_t crc = 0;
+        for (size_t i = 0; i < length; i++)
+            crc = neosd_crc7_lut[crc ^ data[length - 1 - i]];
+
+        return crc >> 1;
+    }
+
+    // The first 16 entries of neosd_crc7_lut: 4 bits shifted in
+    static const uint8_t neosd_crc7_nibble_lut[16] = {
+        0x00, 0x12, 0x24, 0x36, 0x48, 0x5A, 0x6C, 0x7E, 0x90, 0x82, 0xB4, 0xA6, 0xD8, 0xCA, 0xFC, 0xEE
+    };
+
+    /**********************************************************************//**
+    * Get CRC7 according to SD standard, two lookups in a 16 byte table per byte.
+    **************************************************************************/
+    uint8_t neosd_crc7_nibble(const uint8_t* data, size_t length)
+    {
+        uint8_t crc = 0;
+        for (size_t i = 0; i < length; i++)
+        {
+            crc ^= data[length - 1 - i];
+            crc = (uint8_t)(crc << 4) ^ neosd_crc7_nibble_lut[crc >> 4];
+            crc = (uint8_t)(crc << 4) ^ neosd_crc7_nibble_lut[crc >> 4];
+        }
+
+        return crc >> 1;
+    }
+
+    /**********************************************************************//**
+    * Get CRC7 according to SD standard. Uses the 256 byte table unless
+    * NEOSD_CRC7_NIBBLE or NEOSD_CRC7_BITWISE select a smaller variant.
+    **************************************************************************/
+    uint8_t neosd_crc7(const uint8_t* data, size_t length)
+    {
+#if defined(NEOSD_CRC7_BITWISE)
+        return neosd_crc7_bitwise(data, length);
+#elif defined(NEOSD_CRC7_NIBBLE)
+        return neosd_crc7_nibble(data, length);
+#else
+        return neosd_crc7_table(data, length);
+#endif
+    }
+
     /**********************************************************************//**
     * Get CRC7 for a command with index cmd_idx and data cmd_arg.
     **************************************************************************/
@@ -60,9 +157,12 @@ extern "C" {
     * Validate CRC7 for a short response.
     *
     * @note According to SD specification, neosd_r3_t does not have a crc.
+    * @note With hardware CRC support, this checks the last received response.
     **************************************************************************/
     bool neosd_rshort_check(neosd_rshort_t* data)
     {
+        if (neosd_dev->auto_crc)
+            return (neosd_status() & (1 << NEOSD_CTRL_RESP_CRCERR)) == 0;
         return neosd_rshort_crc(data) == data->crc;
     }
 
@@ -73,6 +173,8 @@ extern "C" {
 
     bool neosd_rlong_check(neosd_r2_t* data)
     {
+        if (neosd_dev->auto_crc)
+            return (neosd_status() & (1 << NEOSD_CTRL_RESP_CRCERR)) == 0;
         return neosd_rlong_crc(data) == (data->reg0 & 0x7F);
     }
 
@@ -81,7 +183,7 @@ extern "C" {
     **************************************************************************/
     bool neosd_setup(int prsc, int cdiv, neosd_version_t* ver)
     {
-        auto info = NEOSD->INFO;
+        uint32_t info = NEOSD->INFO;
 
         if ((info >> NEOSD_INFO_MAGIC) != NEOSD_MAGIC)
             return false;
@@ -89,6 +191,10 @@ extern "C" {
         ver->major = (info >> NEOSD_INFO_MAJOR) & 0xF;
         ver->minor = (info >> NEOSD_INFO_MINOR) & 0xF;
         ver->patch = (info >> NEOSD_INFO_PATCH) & 0xF;
+        neosd_dev->auto_crc = ver->major > 0 || ver->minor >= 2;
+        neosd_dev->status_regs = ver->major > 0 || ver->minor >= 3;
+        neosd_dev->blkcnt = ver->major > 0 || ver->minor >= 4;
+        neosd_dev->fifo_words = ver->major > 0 || ver->minor >= 5 ? 1u << ((info >> NEOSD_INFO_FIFO) & 0xF) : 0;
 
         // setup prsc and cdiv
         NEOSD->CTRL = (prsc << NEOSD_CTRL_PRSC0) | (cdiv << NEOSD_CTRL_CDIV0);
@@ -98,24 +204,22 @@ extern "C" {
     /**********************************************************************//**
     * Get configured clock speed in Hz.
     *
+    * @note Uses the system clock passed to neosd_app_card_init, or
+    * neorv32_sysinfo_get_clk() before the first card init.
+    *
     * @return Actual configured SD clock speed in Hz.
     **************************************************************************/
     uint32_t neosd_get_clock_speed(void)
     {
-        return 0;
+        uint32_t ctrl = NEOSD->CTRL;
+        uint32_t prsc_sel  = (ctrl >> NEOSD_CTRL_PRSC0) & 0x7;
+        uint32_t clock_div = (ctrl >> NEOSD_CTRL_CDIV0) & 0xf;
 
-    // FIXME: Implement and test
-    #if 0
-        const uint16_t PRSC_LUT[8] = {2, 4, 8, 64, 128, 1024, 2048, 4096};
+        // HS bypasses the prescaler
+        uint32_t tmp = (ctrl & (1 << NEOSD_CTRL_HS) ? 2 : 2 * NEOSD_PRSC_LUT[prsc_sel]) * (1 + clock_div);
 
-        uint32_t ctrl = NEORV32_SPI->CTRL;
-        uint32_t prsc_sel  = (ctrl >> SPI_CTRL_PRSC0) & 0x7;
-        uint32_t clock_div = (ctrl >> SPI_CTRL_CDIV0) & 0xf;
-    
-        uint32_t tmp = 2 * PRSC_LUT[prsc_sel] * (1 + clock_div);
-    
-        return neorv32_sysinfo_get_clk() / tmp;
-    #endif
+        uint32_t clk_hz = neosd_dev->clk_hz != 0 ? neosd_dev->clk_hz : neorv32_sysinfo_get_clk();
+        return clk_hz / tmp;
     }
 
     /**********************************************************************//**
@@ -126,10 +230,46 @@ extern "C" {
     **************************************************************************/
     void neosd_set_clock(int prsc, int cdiv, bool hs)
     {
-        uint32_t ctrl = NEOSD->CTRL;
-        ctrl &= ~((0b111 << NEOSD_CTRL_PRSC0) | (0b1111 << NEOSD_CTRL_CDIV0) | (0b1 << NEOSD_CTRL_HS));
-        ctrl |= (prsc << NEOSD_CTRL_PRSC0) | (cdiv << NEOSD_CTRL_CDIV0) | (hs << NEOSD_CTRL_HS);
-        NEOSD->CTRL = ctrl;
+        neosd_ctrl_modify((0b111 << NEOSD_CTRL_PRSC0) | (0b1111 << NEOSD_CTRL_CDIV0) | (0b1 << NEOSD_CTRL_HS),
+            (prsc << NEOSD_CTRL_PRSC0) | (cdiv << NEOSD_CTRL_CDIV0) | (hs << NEOSD_CTRL_HS));
+    }
+
+    /**********************************************************************//**
+    * Set the fastest clock setting with an SD clock of at most max_hz.
+    *
+    * @param clk_hz System clock in Hz.
+    * @param max_hz Highest allowed SD clock in Hz.
+    * @return Resulting SD clock speed in Hz. If even the slowest setting is too
+    * fast, the slowest setting is used.
+    **************************************************************************/
+    uint32_t neosd_set_clock_max(uint32_t clk_hz, uint32_t max_hz)
+    {
+        int prsc = 7, cdiv = 15;
+        bool hs = false;
+        uint32_t div = 2 * NEOSD_PRSC_LUT[7] * 16;
+
+        // HS: 2 * (cdiv + 1) system clocks per SD clock, otherwise 2 * PRSC_LUT[prsc] * (cdiv + 1)
+        for (int setting = -1; setting < 8; setting++)
+        {
+            uint32_t base = setting < 0 ? 2 : 2 * NEOSD_PRSC_LUT[setting];
+            for (int c = 0; c < 16; c++)
+            {
+                if ((uint64_t)max_hz * base * (c + 1) < clk_hz)
+                    continue;
+                // Higher cdiv values are only slower
+                if (base * (c + 1) < div)
+                {
+                    prsc = setting < 0 ? 0 : setting;
+                    cdiv = c;
+                    hs = setting < 0;
+                    div = base * (c + 1);
+                }
+                break;
+            }
+        }
+
+        neosd_set_clock(prsc, cdiv, hs);
+        return clk_hz / div;
     }
 
     /**********************************************************************//**
@@ -138,9 +278,9 @@ extern "C" {
     void neosd_set_idle_clk(bool active)
     {
         if (active)
-            NEOSD->CTRL |= (1 << NEOSD_CTRL_IDLE_SDCLK);
+            neosd_ctrl_modify(0, 1 << NEOSD_CTRL_IDLE_SDCLK);
         else
-            NEOSD->CTRL &= ~(1 << NEOSD_CTRL_IDLE_SDCLK);
+            neosd_ctrl_modify(1 << NEOSD_CTRL_IDLE_SDCLK, 0);
     }
 
     /**********************************************************************//**
@@ -151,7 +291,7 @@ extern "C" {
     **************************************************************************/
     void neosd_begin_reset()
     {
-        NEOSD->CTRL |= (1 << NEOSD_CTRL_RST);
+        neosd_ctrl_modify(0, 1 << NEOSD_CTRL_RST);
     }
 
     /**********************************************************************//**
@@ -162,7 +302,7 @@ extern "C" {
     **************************************************************************/
     void neosd_end_reset()
     {
-        NEOSD->CTRL &= ~(1 << NEOSD_CTRL_RST);
+        neosd_ctrl_modify(1 << NEOSD_CTRL_RST, 0);
     }
 
     /**********************************************************************//**
@@ -179,7 +319,76 @@ extern "C" {
     **************************************************************************/
     int neosd_busy()
     {
-        return (NEOSD->CTRL & ((1 << NEOSD_CTRL_CMD_BUSY) | (1 << NEOSD_CTRL_DAT_BUSY))) >> NEOSD_CTRL_DAT_BUSY;
+        return (neosd_status() & ((1 << NEOSD_CTRL_CMD_BUSY) | (1 << NEOSD_CTRL_DAT_BUSY))) >> NEOSD_CTRL_DAT_BUSY;
+    }
+
+    /**********************************************************************//**
+    * Use a DMA engine for data transfers. Pass nullptr to use the CPU again.
+    *
+    * @note The DMA engine must be triggered by flag_data_o.
+    **************************************************************************/
+    void neosd_set_dma(const neosd_dma_t* dma)
+    {
+        neosd_dev->dma = dma;
+    }
+
+    /**********************************************************************//**
+    * Get the DMA engine used for data transfers or nullptr.
+    **************************************************************************/
+    const neosd_dma_t* neosd_get_dma()
+    {
+        return neosd_dev->dma;
+    }
+
+    /**********************************************************************//**
+    * Arm the hardware block counter for the next data transfer: After count
+    * blocks, the controller stops the data FSM and with cmd12 sends
+    * STOP_TRANSMISSION (R1b after writes) itself. The CMD12 is sent once
+    * CMD_DONE of the transfer command was acknowledged. Its response still
+    * has to be read. A command whose CMDARG is written before that goes
+    * first, the CMD12 follows once its CMD_DONE was acknowledged. Commands
+    * written after the acknowledge may collide with the CMD12.
+    *
+    * @returns false if the controller has no block counter or count is too
+    * large. The caller has to stop the transfer then.
+    **************************************************************************/
+    bool neosd_set_block_count(size_t count, bool cmd12)
+    {
+        if (!neosd_dev->blkcnt || count >= (1u << (NEOSD_BLKCNT_COUNT_MSB + 1)))
+            return false;
+        NEOSD->BLKCNT = count | (cmd12 ? (1u << NEOSD_BLKCNT_AUTO_CMD12) : 0);
+        return true;
+    }
+
+    /**********************************************************************//**
+    * Get the size of the data FIFO in words, 0 if there is none.
+    **************************************************************************/
+    size_t neosd_fifo_size()
+    {
+        return neosd_dev->fifo_words;
+    }
+
+    /**********************************************************************//**
+    * Switch FIFO mode, only while the data FSM is idle. In FIFO mode, the
+    * controller moves words between the card and the FIFO without stalling
+    * the SD clock. DATA reads pop and writes push words and
+    * NEOSD_CTRL_FLAG_DAT_DATA is set while at least watermark words can be
+    * read (or written, for write transfers). Words are only lost if the
+    * FIFO is empty on reads or full on writes, check neosd_fifo_level.
+    *
+    * @returns false if the controller has no FIFO.
+    **************************************************************************/
+    bool neosd_set_fifo(bool enable, size_t watermark)
+    {
+        if (neosd_dev->fifo_words == 0)
+            return false;
+
+        NEOSD->FIFO = watermark << NEOSD_FIFO_WM_LSB;
+        if (enable)
+            neosd_ctrl_modify(0, 1 << NEOSD_CTRL_FIFO);
+        else
+            neosd_ctrl_modify(1 << NEOSD_CTRL_FIFO, 0);
+        return true;
     }
 
     /**********************************************************************//**
@@ -188,10 +397,18 @@ extern "C" {
     void neosd_cmd_commit(SD_CMD_IDX cmd, uint32_t arg, NEOSD_RMODE rmode, NEOSD_DMODE dmode, bool stopDAT)
     {
         uint32_t stopBit = stopDAT ? (1 << NEOSD_CMD_ABRT_DAT) : 0;
-        NEOSD->CMDARG = arg;
-        NEOSD->CMD = (1 << NEOSD_CMD_COMMIT) | (dmode << NEOSD_CMD_DMODE0) |
+        uint32_t crc = neosd_dev->auto_crc ? (1 << NEOSD_CMD_AUTO_CRC) : (neosd_cmd_crc(cmd, arg) << NEOSD_CMD_CRC_LSB);
+        neosd_cmd_commit_word((1 << NEOSD_CMD_COMMIT) | (dmode << NEOSD_CMD_DMODE0) |
             (rmode << NEOSD_CMD_RMODE0) | (cmd << NEOSD_CMD_IDX_LSB) |
-            stopBit |
-            (neosd_cmd_crc(cmd, arg) << NEOSD_CMD_CRC_LSB);
+            stopBit | crc, arg);
+    }
+
+    /**********************************************************************//**
+    * Commit a complete CMD register word, see neosd_cmd_word.
+    **************************************************************************/
+    void neosd_cmd_commit_word(uint32_t word, uint32_t arg)
+    {
+        NEOSD->CMDARG = arg;
+        NEOSD->CMD = word;
     }
 }
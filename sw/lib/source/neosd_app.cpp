@@ -1,24 +1,267 @@
 #include "neosd_app.h"
 #include "neosd_dbg.h"
+#include <string.h>
 
 extern "C" {
 
+    // Hand the data words of count blocks to the DMA engine, if there is one
+    static bool neosd_app_dma_start(const uint32_t* buf, size_t count, bool write)
+    {
+        const neosd_dma_t* dma = neosd_get_dma();
+        if (dma == nullptr)
+            return false;
+
+        dma->start(&NEOSD->DATA, (uint32_t*)buf, 128 * count, write);
+        return true;
+    }
+
+    // Use FIFO mode for a transfer the CPU moves the data for. The polling loops take all
+    // words at once, so any word is enough to start a burst.
+    static bool neosd_app_fifo_start()
+    {
+        return neosd_dev->fifo_on && neosd_get_dma() == nullptr && neosd_set_fifo(true, 1);
+    }
+
+    // FIFO mode: Read all words in the FIFO. Words past dend belong to the block after the
+    // last one and are dropped.
+    static uint32_t* neosd_app_fifo_read(uint32_t* dptr, const uint32_t* dend)
+    {
+        size_t level = neosd_fifo_level();
+        for (; level != 0 && dptr != dend; level--)
+            *(dptr++) = NEOSD->DATA;
+        for (; level != 0; level--)
+            neosd_discard(NEOSD->DATA);
+        return dptr;
+    }
+
+    // Read the rest of a block up to bend, once the command response is done. Only waits for
+    // the data flag or the FIFO level, block done and CRC status are left to the caller. Stops
+    // early if the transfer ended.
+    static uint32_t* neosd_app_drain(uint32_t* dptr, const uint32_t* bend, bool fifo)
+    {
+        if (!fifo)
+        {
+            while (dptr != bend)
+            {
+                uint32_t irq;
+                while (!((irq = neosd_status()) & ((1 << NEOSD_CTRL_FLAG_DAT_DATA) | (1 << NEOSD_CTRL_FLAG_DAT_DONE)))) {}
+                if (!(irq & (1 << NEOSD_CTRL_FLAG_DAT_DATA)))
+                    break;
+                *(dptr++) = NEOSD->DATA;
+            }
+            return dptr;
+        }
+
+        while (dptr != bend)
+        {
+            size_t level = neosd_fifo_level();
+            if (level == 0)
+            {
+                if (neosd_status() & (1 << NEOSD_CTRL_FLAG_DAT_DONE))
+                    break;
+                continue;
+            }
+            if (level > (size_t)(bend - dptr))
+                level = bend - dptr;
+
+            // Back-to-back reads, the FIFO holds level words
+            for (; level >= 4; level -= 4)
+            {
+                dptr[0] = NEOSD->DATA;
+                dptr[1] = NEOSD->DATA;
+                dptr[2] = NEOSD->DATA;
+                dptr[3] = NEOSD->DATA;
+                dptr += 4;
+            }
+            for (; level != 0; level--)
+                *(dptr++) = NEOSD->DATA;
+        }
+        return dptr;
+    }
+
+    // Word mode drain passing each word to sink instead of storing it, see neosd_app_drain.
+    // Returns the number of words read so far.
+    static size_t neosd_app_drain_sink(size_t words, size_t bend, neosd_sink_t sink, void* user)
+    {
+        while (words != bend)
+        {
+            uint32_t irq;
+            while (!((irq = neosd_status()) & ((1 << NEOSD_CTRL_FLAG_DAT_DATA) | (1 << NEOSD_CTRL_FLAG_DAT_DONE)))) {}
+            if (!(irq & (1 << NEOSD_CTRL_FLAG_DAT_DATA)))
+                break;
+            sink(user, NEOSD->DATA);
+            words++;
+        }
+        return words;
+    }
+
+    // End of the block dptr points into, for buffers of whole blocks starting at buf
+    static const uint32_t* neosd_app_block_end(const uint32_t* buf, const uint32_t* dptr)
+    {
+        return dptr + (128 - (dptr - buf) % 128);
+    }
+
+    // FIFO mode: Fill the FIFO, up to dend
+    static const uint32_t* neosd_app_fifo_write(const uint32_t* dptr, const uint32_t* dend)
+    {
+        size_t room = neosd_fifo_size() - neosd_fifo_level();
+        for (; room != 0 && dptr != dend; room--)
+            NEOSD->DATA = *(dptr++);
+        return dptr;
+    }
+
+    // Read the first words of the data block of a committed read command, then abort the
+    // rest. For registers and status blocks shorter than the 512 bytes the controller expects.
+    static bool neosd_app_read_short(uint32_t* data, size_t count)
+    {
+        neosd_res_t resp;
+        uint32_t* rptr = &resp._raw[4];
+        size_t words = 0;
+        bool cmd_done = false, aborted = false;
+
+        // R1 and data
+        while (true)
+        {
+            uint32_t irq = neosd_status();
+
+            if (irq & (1 << NEOSD_CTRL_FLAG_CMD_RESP))
+                *(rptr--) = NEOSD->RESP;
+
+            if (irq & (1 << NEOSD_CTRL_FLAG_CMD_DONE))
+            {
+                neosd_ack(1 << NEOSD_CTRL_FLAG_CMD_DONE);
+                NEOSD_DEBUG_R1(&resp.rshort);
+                cmd_done = true;
+            }
+
+            // The controller always reads 512 byte blocks, so keep draining until the abort
+            if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DATA))
+            {
+                if (words < count)
+                    data[words++] = NEOSD->DATA;
+                else
+                    neosd_discard(NEOSD->DATA);
+            }
+
+            // Writing CMD also loads the command shift register, so wait for the response first
+            if (words == count && cmd_done && !aborted)
+            {
+                NEOSD->CMD = (1 << NEOSD_CMD_ABRT_DAT);
+                aborted = true;
+            }
+
+            if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DONE))
+            {
+                neosd_ack((1 << NEOSD_CTRL_FLAG_DAT_DONE) | (1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR));
+                break;
+            }
+        }
+
+        if (!neosd_rshort_check(&resp.rshort))
+        {
+            NEOSD_DEBUG_MSG("NEOSD: CRC invalid\n");
+            return false;
+        }
+        return words == count;
+    }
+
+    // Select a clock level. Only call this while the controller is idle.
+    static void neosd_app_link_level(uint8_t level)
+    {
+        neosd_dev->link.stats.clock_level = level;
+        neosd_set_clock_max(neosd_dev->clk_hz, neosd_dev->link.max_hz >> level);
+        neosd_dev->link.errors = 0;
+        neosd_dev->link.clean = 0;
+        NEOSD_DEBUG_MSG("NEOSD: Clock level %u, %u Hz\n", level, neosd_get_clock_speed());
+    }
+
+    // Account a finished transfer: Step the clock down after NEOSD_CRC_BACKOFF_ERRORS CRC
+    // errors, and back up after NEOSD_CRC_CLEAN_BLOCKS blocks without errors.
+    static void neosd_app_link_account(size_t blocks, size_t errors)
+    {
+        neosd_dev->link.stats.blocks += blocks;
+        neosd_dev->link.stats.crc_errors += errors;
+        if (neosd_dev->link.max_hz == 0)
+            return;
+
+        uint8_t level = neosd_dev->link.stats.clock_level;
+        if (errors != 0)
+        {
+            neosd_dev->link.clean = 0;
+            neosd_dev->link.errors += errors;
+            if (neosd_dev->link.errors >= NEOSD_CRC_BACKOFF_ERRORS && level < NEOSD_CLOCK_LEVELS)
+                neosd_app_link_level(level + 1);
+        }
+        else if ((neosd_dev->link.clean += blocks) >= NEOSD_CRC_CLEAN_BLOCKS)
+        {
+            if (level > 0)
+                neosd_app_link_level(level - 1);
+            neosd_dev->link.errors = 0;
+            neosd_dev->link.clean = 0;
+        }
+    }
+
+    static void neosd_app_write_complete();
+
+    // ACMD51: SEND_SCR. The SCR is transferred as an 8 byte data block.
+    static bool neosd_app_read_scr(uint16_t rca, uint32_t* scr)
+    {
+        sd_status_t status;
+        uint32_t data[2];
+
+        if (neosd_acmd_commit((SD_CMD_IDX)51, 0, NEOSD_RMODE_SHORT, NEOSD_DMODE_READ, &status, rca, NEOSD_CMD_TIMEOUT) != NEOSD_OK)
+            return false;
+        NEOSD_DEBUG_MSG("NEOSD: Sent ACMD51\n");
+
+        if (!neosd_app_read_short(data, 2))
+            return false;
+
+        // Data is transferred MSB first
+        scr[1] = __builtin_bswap32(data[0]);
+        scr[0] = __builtin_bswap32(data[1]);
+        return true;
+    }
+
+    // CMD6: SWITCH_FUNC. Returns the 64 byte switch function status, byte 0 first.
+    static bool neosd_app_switch_func(uint32_t arg, uint8_t* status)
+    {
+        uint32_t data[16];
+
+        neosd_cmd_commit((SD_CMD_IDX)6, arg, NEOSD_RMODE_SHORT, NEOSD_DMODE_READ);
+        NEOSD_DEBUG_MSG("NEOSD: Sent CMD6 %x\n", arg);
+
+        if (!neosd_app_read_short(data, 16))
+            return false;
+
+        // The first data byte is in bits 7:0 of each word
+        for (size_t i = 0; i < 64; i++)
+            status[i] = data[i / 4] >> (8 * (i % 4));
+        return true;
+    }
+
     // Implements Figure 4-2 from Physical Layer Simplified Specification Version 9.10
+    // Identification runs at <= 400 kHz, transfers at the fastest clock the card allows
+    // for a system clock of clk_hz. The selected device keeps a copy of info.
     // TODO: Revisit spec and finalize this
-    SD_CODE neosd_app_card_init(sd_card_t* info)
+    SD_CODE neosd_app_card_init(sd_card_t* info, uint32_t clk_hz)
     {
         neosd_res_t resp;
         sd_status_t status;
         *info = {};
+        neosd_dev->clk_hz = clk_hz;
+        neosd_dev->link.max_hz = 0;
+
+        // 6.6.6 Bus timing: f_OD up to 400 kHz in identification mode
+        neosd_set_clock_max(clk_hz, 400000);
 
         // Reset card with CMD0
         // No response expected on this command
-        neosd_cmd_commit(SD_CMD0, 0, NEOSD_RMODE_NONE, NEOSD_DMODE_NONE);
+        neosd_cmd_commit_const<SD_CMD0, 0, NEOSD_RMODE_NONE, NEOSD_DMODE_NONE>();
         neosd_cmd_wait_res(&resp, NEOSD_CMD_TIMEOUT);
         NEOSD_DEBUG_MSG("NEOSD: Sent CMD0\n");
 
         // Now send CMD8
-        neosd_cmd_commit(SD_CMD8, (0b0001 << 8) | (0xA4), NEOSD_RMODE_SHORT, NEOSD_DMODE_NONE);
+        neosd_cmd_commit_const<SD_CMD8, (0b0001 << 8) | (0xA4), NEOSD_RMODE_SHORT, NEOSD_DMODE_NONE>();
         NEOSD_DEBUG_MSG("NEOSD: Sent CMD8\n");
         if (neosd_cmd_wait_res(&resp, NEOSD_CMD_TIMEOUT))
         {
@@ -60,13 +303,13 @@ extern "C" {
             
 
             // Now do the initialization ACMD41. 4.2.3.1 Initialization Command (ACMD41)
-            uint64_t timeout = neosd_clint_time_get_ms() + 1000;
+            neosd_deadline_t deadline = neosd_deadline_ms(1000);
             // FIXME: Voltage switch not supported for now in driver, always using 3.3V
             uint32_t acmd41_arg = (1 << SD_ACMD41_HCS) | (1 << SD_ACMD41_XPC) | (0 << SD_ACMD41_S18R) | (1 << 20); //3.3V
             NEOSD_DEBUG_MSG("NEOSD: acmd41_arg=%x\n", acmd41_arg);
             while (true)
             {
-                if (neosd_clint_time_get_ms() > timeout)
+                if (neosd_deadline_expired(&deadline))
                 {
                     NEOSD_DEBUG_MSG("NEOSD: Card was returning busy for more than 1s\n");
                     return NEOSD_TIMEOUT;
@@ -131,7 +374,7 @@ extern "C" {
         */
 
         // Now send CMD2
-        neosd_cmd_commit(SD_CMD2, 0, NEOSD_RMODE_LONG, NEOSD_DMODE_NONE);
+        neosd_cmd_commit_const<SD_CMD2, 0, NEOSD_RMODE_LONG, NEOSD_DMODE_NONE>();
         NEOSD_DEBUG_MSG("NEOSD: Sent CMD2\n");
         if (!neosd_cmd_wait_res(&resp, NEOSD_CMD_TIMEOUT))
         {
@@ -154,7 +397,7 @@ extern "C" {
         // 5.2 CID register
 
         // Now send CMD3
-        neosd_cmd_commit(SD_CMD3, 0, NEOSD_RMODE_SHORT, NEOSD_DMODE_NONE);
+        neosd_cmd_commit_const<SD_CMD3, 0, NEOSD_RMODE_SHORT, NEOSD_DMODE_NONE>();
         NEOSD_DEBUG_MSG("NEOSD: Sent CMD3\n");
         if (!neosd_cmd_wait_res(&resp, NEOSD_CMD_TIMEOUT))
         {
@@ -186,12 +429,14 @@ extern "C" {
         }
         NEOSD_DEBUG_R1(&resp.rshort);
 
+        // Transfer state: Default speed allows 25 MHz, CMD6 can raise this below
+        neosd_set_clock_max(clk_hz, 25000000);
+
         // Do CMD42 to unlock here, but not supported for now
-        // CMD6: Could select some adiditonal things...
 
     
         // CMD16 Set block length
-        neosd_cmd_commit((SD_CMD_IDX)16, 512, NEOSD_RMODE_SHORT, NEOSD_DMODE_NONE);
+        neosd_cmd_commit_const<(SD_CMD_IDX)16, 512, NEOSD_RMODE_SHORT, NEOSD_DMODE_NONE>();
 
         NEOSD_DEBUG_MSG("NEOSD: Sent CMD16\n");
         if (!neosd_cmd_wait_res(&resp, NEOSD_CMD_TIMEOUT))
@@ -201,13 +446,113 @@ extern "C" {
         }
         NEOSD_DEBUG_R1(&resp.rshort);
 
+        // 5.6 SCR register: Check for optional command support
+        if (!neosd_app_read_scr(info->rca, info->scr))
+        {
+            NEOSD_DEBUG_MSG("NEOSD: Reading SCR failed\n");
+            return NEOSD_INCOMPAT_CARD;
+        }
+        info->cmd_support = info->scr[1] & 0xF;
+        neosd_dev->cmd23_support = info->cmd_support & (1 << SD_SCR_CMD23);
+        neosd_dev->cmd23 = neosd_dev->cmd23_support;
+        // SD_SPEC 1 and later (version 1.10) support CMD6
+        neosd_dev->cmd6_support = ((info->scr[1] >> 24) & 0xF) >= 1;
+        NEOSD_DEBUG_MSG("NEOSD: SCR=%x %x, CMD23: %d\n", info->scr[1], info->scr[0], neosd_dev->cmd23);
+
+        info->hs = neosd_app_switch_hs(clk_hz);
+        NEOSD_DEBUG_MSG("NEOSD: SD clock %u Hz\n", neosd_get_clock_speed());
+
+        // Clock backoff steps down from the clock selected here
+        neosd_dev->link = {};
+        neosd_dev->link.max_hz = info->hs ? 50000000 : 25000000;
 
+        neosd_dev->card = *info;
         return NEOSD_OK;
     }
 
+    /**********************************************************************//**
+    * Select CMD23 or CMD12 to end multi-block transfers. CMD23 is only used if
+    * the card supports it. Returns whether CMD23 is used.
+    **************************************************************************/
+    bool neosd_app_use_cmd23(bool enable)
+    {
+        neosd_dev->cmd23 = enable && neosd_dev->cmd23_support;
+        return neosd_dev->cmd23;
+    }
+
+    /**********************************************************************//**
+    * Select FIFO mode or one word per flag for transfers without DMA. FIFO
+    * mode is only used if the controller has a FIFO. Returns whether FIFO
+    * mode is used.
+    *
+    * @note Off by default: The FIFO of 0.5.0 has not been verified in
+    * simulation or synthesis yet.
+    **************************************************************************/
+    bool neosd_app_use_fifo(bool enable)
+    {
+        neosd_dev->fifo_on = enable && neosd_fifo_size() != 0;
+        return neosd_dev->fifo_on;
+    }
+
+    /**********************************************************************//**
+    * Switch the card to High-Speed (SDR25) with CMD6 and raise the SD clock to
+    * the fastest setting of at most 50 MHz for a system clock of clk_hz.
+    * Returns false and keeps the clock if the card does not support it.
+    **************************************************************************/
+    bool neosd_app_switch_hs(uint32_t clk_hz)
+    {
+        // 4.3.10 Switch Function Status: Group 1 support bits 415:400 (byte 13 bit 1:
+        // function 1), group 1 result 379:376 (byte 16 bits 3:0), group 1 busy 287:272
+        // (byte 29 bit 1). Arguments select function 1 in group 1 and keep the others.
+        const uint32_t SWITCH_CHECK = 0x00FFFFF1, SWITCH_SET = 0x80FFFFF1;
+        uint8_t status[64];
+
+        if (!neosd_dev->cmd6_support)
+            return false;
+        neosd_app_stream_close();
+        neosd_app_write_complete();
+
+        for (int retry = 0; ; retry++)
+        {
+            if (!neosd_app_switch_func(SWITCH_CHECK, status))
+                return false;
+            if ((status[13] & 0x2) == 0 || (status[16] & 0xF) != 1)
+            {
+                NEOSD_DEBUG_MSG("NEOSD: High speed not supported\n");
+                return false;
+            }
+            if ((status[29] & 0x2) == 0)
+                break;
+            if (retry == NEOSD_CMD_TIMEOUT)
+            {
+                NEOSD_DEBUG_MSG("NEOSD: High speed function busy\n");
+                return false;
+            }
+        }
+
+        if (!neosd_app_switch_func(SWITCH_SET, status) || (status[16] & 0xF) != 1)
+            return false;
+
+        // The card switches within 8 clocks after the status block, which the abort already covers
+        neosd_set_clock_max(clk_hz, 50000000);
+        NEOSD_DEBUG_MSG("NEOSD: Switched to high speed\n");
+        return true;
+    }
+
+    /**********************************************************************//**
+    * Get the CRC error counts and the current clock level.
+    **************************************************************************/
+    void neosd_app_get_link_stats(neosd_link_stats_t* stats)
+    {
+        *stats = neosd_dev->link.stats;
+        stats->clock_hz = neosd_get_clock_speed();
+    }
+
     bool neosd_app_configure_datamode(bool d4mode, uint16_t rca)
     {
         neosd_res_t resp;
+        neosd_app_stream_close();
+        neosd_app_write_complete();
 
         // ACMD6 SET_BUS_WIDTH 10=4 bit, 00=1 bit
         size_t arg = d4mode ? 0b10 : 0b00;
@@ -224,56 +569,814 @@ extern "C" {
         NEOSD_DEBUG_R1(&resp.rshort);
 
         if (d4mode)
-            NEOSD->CTRL |= (1 << NEOSD_CTRL_D4);
+            neosd_ctrl_modify(0, 1 << NEOSD_CTRL_D4);
         else
-            NEOSD->CTRL &= ~(1 << NEOSD_CTRL_D4);
+            neosd_ctrl_modify(1 << NEOSD_CTRL_D4, 0);
 
         return true;
     }
 
-    bool neosd_app_read_block(size_t block, uint32_t* buf)
+    static bool neosd_app_retry_block(size_t block, uint32_t* buf, bool write);
+
+    // CMD17 transfer, returns false on a CRC error
+    static bool neosd_app_read_single(size_t block, uint32_t* buf)
     {
         neosd_res_t resp;
+        bool fifo = neosd_app_fifo_start();
 
         // CMD17: READ_SINGLE_BLOCK
         neosd_cmd_commit((SD_CMD_IDX)17, block, NEOSD_RMODE_SHORT, NEOSD_DMODE_READ);
         NEOSD_DEBUG_MSG("NEOSD: Sent CMD17\n");
 
+        bool dma = neosd_app_dma_start(buf, 1, false);
         uint32_t* rptr = &resp._raw[4];
         uint32_t* dptr = &buf[0];
+        const uint32_t* dend = &buf[128];
+        bool crc_ok = true, cmd_done = false;
 
         // R1 and maybe data
         while (true)
         {
-            auto irq = NEOSD->CTRL;
+            uint32_t irq = neosd_status();
 
             if (irq & (1 << NEOSD_CTRL_FLAG_CMD_RESP))
                 *(rptr--) = NEOSD->RESP;
 
             if (irq & (1 << NEOSD_CTRL_FLAG_CMD_DONE))
             {
-                NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_CMD_DONE);
+                neosd_ack(1 << NEOSD_CTRL_FLAG_CMD_DONE);
                 NEOSD_DEBUG_R1(&resp.rshort);
+                cmd_done = true;
             }
 
-            if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DATA))
-                *(dptr++) = NEOSD->DATA;
+            if ((irq & (1 << NEOSD_CTRL_FLAG_DAT_DATA)) && !dma)
+            {
+                if (cmd_done && dptr != dend)
+                    dptr = neosd_app_drain(dptr, dend, fifo);
+                else if (fifo)
+                    dptr = neosd_app_fifo_read(dptr, dend);
+                else
+                    *(dptr++) = NEOSD->DATA;
+            }
 
             if (irq & (1 << NEOSD_CTRL_FLAG_BLK_DONE))
             {
-                NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_BLK_DONE);
+                if (irq & (1 << NEOSD_CTRL_CRCERR))
+                    crc_ok = false;
+                neosd_ack(irq & ((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR)));
                 NEOSD->CMD = (1 << NEOSD_CMD_ABRT_DAT);
             }
 
             if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DONE))
             {
-                NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_DAT_DONE);
+                neosd_ack(1 << NEOSD_CTRL_FLAG_DAT_DONE);
+                // The block is done before the CPU took all of its words
+                if (fifo)
+                {
+                    neosd_app_fifo_read(dptr, dend);
+                    neosd_set_fifo(false, 1);
+                }
                 break;
             }
         }
 
-        // FIXME: return CRC flag...
         // FIXME: Wait for controller IDLE
+        return crc_ok;
+    }
+
+    bool neosd_app_read_block(size_t block, uint32_t* buf)
+    {
+        neosd_app_stream_close();
+        neosd_app_write_complete();
+
+        bool crc_ok = neosd_app_read_single(block, buf);
+        neosd_app_link_account(1, !crc_ok);
+        return crc_ok || neosd_app_retry_block(block, buf, false);
+    }
+
+    bool neosd_app_read_blocks(size_t block, size_t count, uint32_t* buf)
+    {
+        neosd_res_t resp;
+        neosd_app_stream_close();
+        neosd_app_write_complete();
+
+        // CMD23 can only announce up to 65535 blocks, use CMD12 otherwise
+        bool predefined = neosd_dev->cmd23 && count <= 0xFFFF;
+        if (predefined)
+        {
+            // CMD23: SET_BLOCK_COUNT
+            neosd_cmd_commit((SD_CMD_IDX)23, count, NEOSD_RMODE_SHORT, NEOSD_DMODE_NONE);
+            NEOSD_DEBUG_MSG("NEOSD: Sent CMD23\n");
+            if (!neosd_cmd_wait_res(&resp, NEOSD_CMD_TIMEOUT))
+            {
+                NEOSD_DEBUG_MSG("NEOSD: No response\n");
+                return false;
+            }
+            NEOSD_DEBUG_R1(&resp.rshort);
+        }
+
+        // Let the controller stop the transfer after the last block, independent of CPU latency
+        bool autostop = neosd_set_block_count(count, !predefined);
+        bool fifo = neosd_app_fifo_start();
+
+        // CMD18: READ_MULTIPLE_BLOCK
+        neosd_cmd_commit((SD_CMD_IDX)18, block, NEOSD_RMODE_SHORT, NEOSD_DMODE_READ);
+        NEOSD_DEBUG_MSG("NEOSD: Sent CMD18\n");
+
+        bool dma = neosd_app_dma_start(buf, count, false);
+        uint32_t* rptr = &resp._raw[4];
+        uint32_t* dptr = &buf[0];
+        const uint32_t* dend = &buf[128 * count];
+        size_t blocks = 0, errors = 0;
+        bool cmd_done = false;
+        // Blocks with CRC errors. After NEOSD_CRC_MAX_FAILED of them, the rest is read again.
+        size_t failed[NEOSD_CRC_MAX_FAILED];
+        size_t rest = count;
+
+        // R1 and data
+        while (true)
+        {
+            uint32_t irq = neosd_status();
+
+            // Once the stop was sent, the command flags belong to CMD12. The controller sends it
+            // only after CMD_DONE of CMD18 was acknowledged.
+            if (autostop ? !cmd_done : blocks != count)
+            {
+                if (irq & (1 << NEOSD_CTRL_FLAG_CMD_RESP))
+                    *(rptr--) = NEOSD->RESP;
+
+                if (irq & (1 << NEOSD_CTRL_FLAG_CMD_DONE))
+                {
+                    neosd_ack(1 << NEOSD_CTRL_FLAG_CMD_DONE);
+                    NEOSD_DEBUG_R1(&resp.rshort);
+                    cmd_done = true;
+                }
+            }
+
+            // A block is only done after all its words were read. So handle this first: The
+            // same flags snapshot can already contain the first word of the next block.
+            if (irq & (1 << NEOSD_CTRL_FLAG_BLK_DONE))
+            {
+                if ((irq & (1 << NEOSD_CTRL_CRCERR)) && blocks < rest)
+                {
+                    if (errors < NEOSD_CRC_MAX_FAILED)
+                        failed[errors++] = blocks;
+                    else
+                        rest = blocks;
+                }
+                neosd_ack(irq & ((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR)));
+
+                if (++blocks == count && !autostop)
+                {
+                    if (predefined)
+                    {
+                        // Card stops on its own, only the data FSM needs to know
+                        NEOSD->CMD = (1 << NEOSD_CMD_ABRT_DAT);
+                    }
+                    else
+                    {
+                        // CMD12: STOP_TRANSMISSION, also aborts the data FSM
+                        neosd_cmd_commit_const<(SD_CMD_IDX)12, 0, NEOSD_RMODE_SHORT, NEOSD_DMODE_NONE, true>();
+                        NEOSD_DEBUG_MSG("NEOSD: Sent CMD12\n");
+                    }
+                }
+            }
+
+            if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DATA))
+            {
+                // Words of the block following the last one are discarded. Before that,
+                // the DMA engine owns the data register. The FIFO can be up to its size
+                // behind the block count.
+                if (dma)
+                {
+                    if (blocks == count)
+                        neosd_discard(NEOSD->DATA);
+                }
+                else if (cmd_done && dptr != dend)
+                    dptr = neosd_app_drain(dptr, neosd_app_block_end(buf, dptr), fifo);
+                else if (fifo)
+                    dptr = neosd_app_fifo_read(dptr, dend);
+                else if (blocks == count)
+                    neosd_discard(NEOSD->DATA);
+                else
+                    *(dptr++) = NEOSD->DATA;
+            }
+
+            if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DONE))
+            {
+                neosd_ack(1 << NEOSD_CTRL_FLAG_DAT_DONE);
+                if (fifo)
+                {
+                    neosd_app_fifo_read(dptr, dend);
+                    neosd_set_fifo(false, 1);
+                }
+                break;
+            }
+        }
+
+        if (!predefined)
+        {
+            // R1 of the stop command
+            if (!neosd_cmd_wait_res(&resp, NEOSD_CMD_TIMEOUT))
+            {
+                NEOSD_DEBUG_MSG("NEOSD: No response\n");
+                return false;
+            }
+            NEOSD_DEBUG_R1(&resp.rshort);
+        }
+
+        neosd_app_link_account(count, errors + (rest != count));
+        bool ok = true;
+        for (size_t i = 0; i < errors; i++)
+            ok &= neosd_app_retry_block(block + failed[i], &buf[128 * failed[i]], false);
+        if (rest != count)
+        {
+            ok &= neosd_app_retry_block(block + rest, &buf[128 * rest], false);
+            if (rest + 1 != count)
+                ok &= neosd_app_read_blocks(block + rest + 1, count - rest - 1, &buf[128 * (rest + 1)]);
+        }
+        return ok;
+    }
+
+    // Data phase of CMD24 / CMD25, after the command was committed. Blocks are only done after
+    // the card released busy, so the block counter can still be armed here. failed returns the
+    // first block with a CRC error, or count. The card discards all blocks after it.
+    // With behind, returns once the last block is with the controller and the blocks before
+    // it are done, the write is then pending, see neosd_app_write_complete.
+    static bool neosd_app_write_data(size_t block, size_t count, const uint32_t* buf, bool cmd12, size_t* failed,
+        bool behind)
+    {
+        neosd_res_t resp;
+
+        bool autostop = neosd_set_block_count(count, cmd12);
+        // The data FSM only starts after the command was sent, so FIFO mode is still in time
+        bool fifo = neosd_app_fifo_start();
+        bool dma = neosd_app_dma_start(buf, count, true);
+        uint32_t* rptr = &resp._raw[4];
+        const uint32_t* dptr = &buf[0];
+        const uint32_t* dend = &buf[128 * count];
+        size_t blocks = 0;
+        bool cmd_done = false;
+        *failed = count;
+        // Only the block counter stops the transfer without the CPU and without CMD12
+        behind = behind && autostop && !cmd12 && !dma;
+
+        // R1 and data
+        while (true)
+        {
+            uint32_t irq = neosd_status();
+
+            // Once the stop was sent, the command flags belong to CMD12. The controller sends it
+            // only after CMD_DONE of CMD25 was acknowledged.
+            if (autostop ? !cmd_done : blocks != count)
+            {
+                if (irq & (1 << NEOSD_CTRL_FLAG_CMD_RESP))
+                    *(rptr--) = NEOSD->RESP;
+
+                if (irq & (1 << NEOSD_CTRL_FLAG_CMD_DONE))
+                {
+                    neosd_ack(1 << NEOSD_CTRL_FLAG_CMD_DONE);
+                    NEOSD_DEBUG_R1(&resp.rshort);
+                    cmd_done = true;
+                }
+            }
+
+            // Block is done after the card released busy. Handle this before data, so the
+            // request for the block after the last one is never acknowledged without abort.
+            if (irq & (1 << NEOSD_CTRL_FLAG_BLK_DONE))
+            {
+                if ((irq & (1 << NEOSD_CTRL_CRCERR)) && *failed == count)
+                    *failed = blocks;
+                neosd_ack(irq & ((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR)));
+
+                if (++blocks == count && !autostop)
+                {
+                    if (cmd12)
+                    {
+                        // CMD12: STOP_TRANSMISSION, card is busy while programming
+                        neosd_cmd_commit_const<(SD_CMD_IDX)12, 0, NEOSD_RMODE_SHORT, NEOSD_DMODE_BUSY, true>();
+                        NEOSD_DEBUG_MSG("NEOSD: Sent CMD12\n");
+                    }
+                    else
+                    {
+                        NEOSD->CMD = (1 << NEOSD_CMD_ABRT_DAT);
+                    }
+                }
+            }
+
+            if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DATA))
+            {
+                if (dma)
+                {
+                    // Only the request after the last block is left to the CPU
+                    if (blocks == count)
+                        neosd_discard(NEOSD->DATA);
+                }
+                else if (fifo)
+                {
+                    // The controller waits for data after the last block, nothing to acknowledge
+                    if (dptr != dend)
+                        dptr = neosd_app_fifo_write(dptr, dend);
+                }
+                else if (dptr != dend)
+                    NEOSD->DATA = *(dptr++);
+                else
+                    neosd_discard(NEOSD->DATA);
+            }
+
+            if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DONE))
+            {
+                neosd_ack(1 << NEOSD_CTRL_FLAG_DAT_DONE);
+                if (fifo)
+                    neosd_set_fifo(false, 1);
+                break;
+            }
+
+            if (behind && cmd_done && dptr == dend && blocks + 1 == count && *failed == count)
+            {
+                neosd_dev->behind.pending = true;
+                neosd_dev->behind.fifo = fifo;
+                neosd_dev->behind.count = count;
+                neosd_dev->behind.block = block + count - 1;
+                memcpy(neosd_dev->behind.copy, dend - 128, 512);
+                return true;
+            }
+        }
+
+        if (!cmd12)
+            return true;
+
+        // R1b of the stop command, then the data FSM waits for busy
+        if (!neosd_cmd_wait_res(&resp, NEOSD_CMD_TIMEOUT))
+        {
+            NEOSD_DEBUG_MSG("NEOSD: No response\n");
+            return false;
+        }
+        NEOSD_DEBUG_R1(&resp.rshort);
+
+        neosd_wait_idle();
+        neosd_ack(1 << NEOSD_CTRL_FLAG_DAT_DONE);
+
         return true;
     }
+
+    // CMD24 transfer, returns false on a CRC error
+    static bool neosd_app_write_single(size_t block, const uint32_t* buf, bool behind)
+    {
+        size_t failed;
+
+        // CMD24: WRITE_BLOCK
+        neosd_cmd_commit((SD_CMD_IDX)24, block, NEOSD_RMODE_SHORT, NEOSD_DMODE_WRITE);
+        NEOSD_DEBUG_MSG("NEOSD: Sent CMD24\n");
+
+        return neosd_app_write_data(block, 1, buf, false, &failed, behind) && failed == 1;
+    }
+
+    // Transfer a block with a CRC error again, up to NEOSD_CRC_RETRIES times
+    static bool neosd_app_retry_block(size_t block, uint32_t* buf, bool write)
+    {
+        for (int i = 0; i < NEOSD_CRC_RETRIES; i++)
+        {
+            NEOSD_DEBUG_MSG("NEOSD: Retry block %u\n", block);
+            neosd_dev->link.stats.retries++;
+            bool crc_ok = write ? neosd_app_write_single(block, buf, false) : neosd_app_read_single(block, buf);
+            neosd_app_link_account(1, !crc_ok);
+            if (crc_ok)
+                return true;
+        }
+        neosd_dev->link.stats.failures++;
+        return false;
+    }
+
+    bool neosd_app_write_block(size_t block, const uint32_t* buf)
+    {
+        neosd_app_stream_close();
+        neosd_app_write_complete();
+
+        bool crc_ok = neosd_app_write_single(block, buf, neosd_dev->behind.copy != nullptr);
+        if (neosd_dev->behind.pending)
+            return true;
+        neosd_app_link_account(1, !crc_ok);
+        return crc_ok || neosd_app_retry_block(block, (uint32_t*)buf, true);
+    }
+
+    bool neosd_app_write_blocks(size_t block, size_t count, const uint32_t* buf)
+    {
+        neosd_res_t resp;
+
+        if (count == 1)
+            return neosd_app_write_block(block, buf);
+        neosd_app_stream_close();
+        neosd_app_write_complete();
+
+        if (count >= NEOSD_PREERASE_BLOCKS)
+        {
+            // ACMD23: SET_WR_BLK_ERASE_COUNT
+            sd_status_t status;
+            uint32_t erase = count > 0x7FFFFF ? 0x7FFFFF : count;
+            if (neosd_acmd_commit((SD_CMD_IDX)23, erase, NEOSD_RMODE_SHORT, NEOSD_DMODE_NONE, &status, neosd_dev->card.rca, NEOSD_CMD_TIMEOUT) != NEOSD_OK)
+                return false;
+            NEOSD_DEBUG_MSG("NEOSD: Sent ACMD23\n");
+            if (!neosd_cmd_wait_res(&resp, NEOSD_CMD_TIMEOUT))
+            {
+                NEOSD_DEBUG_MSG("NEOSD: No response\n");
+                return false;
+            }
+            NEOSD_DEBUG_R1(&resp.rshort);
+        }
+
+        // CMD23 can only announce up to 65535 blocks, use CMD12 otherwise
+        bool predefined = neosd_dev->cmd23 && count <= 0xFFFF;
+        if (predefined)
+        {
+            // CMD23: SET_BLOCK_COUNT
+            neosd_cmd_commit((SD_CMD_IDX)23, count, NEOSD_RMODE_SHORT, NEOSD_DMODE_NONE);
+            NEOSD_DEBUG_MSG("NEOSD: Sent CMD23\n");
+            if (!neosd_cmd_wait_res(&resp, NEOSD_CMD_TIMEOUT))
+            {
+                NEOSD_DEBUG_MSG("NEOSD: No response\n");
+                return false;
+            }
+            NEOSD_DEBUG_R1(&resp.rshort);
+        }
+
+        // CMD25: WRITE_MULTIPLE_BLOCK
+        neosd_cmd_commit((SD_CMD_IDX)25, block, NEOSD_RMODE_SHORT, NEOSD_DMODE_WRITE);
+        NEOSD_DEBUG_MSG("NEOSD: Sent CMD25\n");
+
+        size_t failed;
+        if (!neosd_app_write_data(block, count, buf, !predefined, &failed, neosd_dev->behind.copy != nullptr))
+            return false;
+        // A pending write is accounted once it is done, the clock must not change before
+        if (neosd_dev->behind.pending)
+            return true;
+        neosd_app_link_account(count, failed != count);
+        if (failed == count)
+            return true;
+
+        // Write the failed block again, then the discarded ones after it
+        if (!neosd_app_retry_block(block + failed, (uint32_t*)&buf[128 * failed], true))
+            return false;
+        return failed + 1 == count || neosd_app_write_blocks(block + failed + 1, count - failed - 1, &buf[128 * (failed + 1)]);
+    }
+
+    // Wait until the card programmed the pending block of a write-behind, then account the
+    // write and retry the block on a CRC error.
+    static void neosd_app_write_complete()
+    {
+        if (!neosd_dev->behind.pending)
+            return;
+        neosd_dev->behind.pending = false;
+
+        bool crc_ok = true;
+        while (true)
+        {
+            uint32_t irq = neosd_status();
+
+            if (irq & (1 << NEOSD_CTRL_FLAG_BLK_DONE))
+            {
+                if (irq & (1 << NEOSD_CTRL_CRCERR))
+                    crc_ok = false;
+                neosd_ack(irq & ((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR)));
+            }
+
+            // The block counter stops the transfer, a request for more data gets nothing
+            if ((irq & (1 << NEOSD_CTRL_FLAG_DAT_DATA)) && !neosd_dev->behind.fifo)
+                neosd_discard(NEOSD->DATA);
+
+            if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DONE))
+            {
+                neosd_ack(1 << NEOSD_CTRL_FLAG_DAT_DONE);
+                if (neosd_dev->behind.fifo)
+                    neosd_set_fifo(false, 1);
+                break;
+            }
+        }
+
+        neosd_app_link_account(neosd_dev->behind.count, !crc_ok);
+        if (!crc_ok && !neosd_app_retry_block(neosd_dev->behind.block, neosd_dev->behind.copy, true))
+            neosd_dev->behind.failed = true;
+    }
+
+    /**********************************************************************//**
+    * Let writes return as soon as the controller has the data of their last
+    * block, while the card still programs it. The next transfer waits for the
+    * card, or call neosd_app_write_sync. That block is kept in copy (128
+    * words) to retry it on a CRC error, so the write buffer is free on return.
+    * Dataless commands like neosd_app_card_status do not wait. Pass nullptr
+    * to turn write-behind off.
+    *
+    * Needs the block counter, call after neosd_setup. Writes with CMD12 (no
+    * CMD23) or DMA always complete before returning. Returns whether
+    * write-behind is used.
+    **************************************************************************/
+    bool neosd_app_use_write_behind(uint32_t* copy)
+    {
+        neosd_dev->behind.copy = neosd_dev->blkcnt ? copy : nullptr;
+        return neosd_dev->behind.copy != nullptr;
+    }
+
+    /**********************************************************************//**
+    * Check without waiting if the card still programs a write-behind block.
+    **************************************************************************/
+    bool neosd_app_write_pending()
+    {
+        return neosd_dev->behind.pending && !(neosd_status() & (1 << NEOSD_CTRL_FLAG_DAT_DONE));
+    }
+
+    /**********************************************************************//**
+    * Barrier for write-behind: Wait until all written blocks are programmed.
+    *
+    * @returns false if a write-behind block failed since the last call, also
+    * if another transfer already waited for it.
+    **************************************************************************/
+    bool neosd_app_write_sync()
+    {
+        neosd_app_write_complete();
+        bool ok = !neosd_dev->behind.failed;
+        neosd_dev->behind.failed = false;
+        return ok;
+    }
+
+    /**********************************************************************//**
+    * Get the card status with CMD13 SEND_STATUS. The command has no data, so
+    * it runs while the card programs a write-behind block, the state is
+    * SD_STATE_PRG then.
+    **************************************************************************/
+    SD_CODE neosd_app_card_status(sd_status_t* status)
+    {
+        neosd_res_t resp;
+        neosd_app_stream_close();
+
+        // CMD13: SEND_STATUS
+        neosd_cmd_commit((SD_CMD_IDX)13, neosd_dev->card.rca << 16, NEOSD_RMODE_SHORT, NEOSD_DMODE_NONE);
+        NEOSD_DEBUG_MSG("NEOSD: Sent CMD13\n");
+        if (!neosd_cmd_wait_res(&resp, NEOSD_CMD_TIMEOUT))
+        {
+            NEOSD_DEBUG_MSG("NEOSD: No response\n");
+            return NEOSD_TIMEOUT;
+        }
+        NEOSD_DEBUG_R1(&resp.rshort);
+
+        if (!neosd_rshort_check(&resp.rshort))
+            return NEOSD_CRC_ERR;
+        status->_raw = resp.rshort.r1.status;
+        return NEOSD_OK;
+    }
+
+    /**********************************************************************//**
+    * Start an open-ended CMD18 transfer at block.
+    *
+    * The card keeps sending blocks until neosd_app_stream_close. In between
+    * neosd_app_stream_read calls, the controller stalls the SD clock as soon
+    * as the first word of the next block was received, so the stream can stay
+    * open for an arbitrary time.
+    **************************************************************************/
+    void neosd_app_stream_open(size_t block)
+    {
+        neosd_app_stream_close();
+        neosd_app_write_complete();
+
+        // CMD18: READ_MULTIPLE_BLOCK, without CMD23
+        neosd_cmd_commit((SD_CMD_IDX)18, block, NEOSD_RMODE_SHORT, NEOSD_DMODE_READ);
+        NEOSD_DEBUG_MSG("NEOSD: Sent CMD18 (stream)\n");
+
+        neosd_dev->stream.active = true;
+        neosd_dev->stream.reopen = false;
+        neosd_dev->stream.cmd_done = false;
+        neosd_dev->stream.next = block;
+        neosd_dev->stream.rptr = &neosd_dev->stream.resp._raw[4];
+    }
+
+    /**********************************************************************//**
+    * Read the next count blocks of an open stream.
+    **************************************************************************/
+    bool neosd_app_stream_read(size_t count, uint32_t* buf)
+    {
+        if (!neosd_dev->stream.active)
+            return false;
+        if (neosd_dev->stream.reopen)
+            neosd_app_stream_open(neosd_dev->stream.next);
+
+        bool dma = neosd_app_dma_start(buf, count, false);
+        uint32_t* dptr = &buf[0];
+        size_t blocks = 0, errors = 0;
+        size_t failed[NEOSD_CRC_MAX_FAILED];
+        size_t rest = count;
+
+        while (blocks != count)
+        {
+            uint32_t irq = neosd_status();
+
+            if (!neosd_dev->stream.cmd_done)
+            {
+                if (irq & (1 << NEOSD_CTRL_FLAG_CMD_RESP))
+                    *(neosd_dev->stream.rptr--) = NEOSD->RESP;
+
+                if (irq & (1 << NEOSD_CTRL_FLAG_CMD_DONE))
+                {
+                    neosd_ack(1 << NEOSD_CTRL_FLAG_CMD_DONE);
+                    NEOSD_DEBUG_R1(&neosd_dev->stream.resp.rshort);
+                    neosd_dev->stream.cmd_done = true;
+                }
+            }
+
+            // Words of the next block stay in the controller for the next call
+            if (irq & (1 << NEOSD_CTRL_FLAG_BLK_DONE))
+            {
+                if ((irq & (1 << NEOSD_CTRL_CRCERR)) && blocks < rest)
+                {
+                    if (errors < NEOSD_CRC_MAX_FAILED)
+                        failed[errors++] = blocks;
+                    else
+                        rest = blocks;
+                }
+                neosd_ack(irq & ((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR)));
+
+                if (++blocks == count)
+                    break;
+            }
+
+            if ((irq & (1 << NEOSD_CTRL_FLAG_DAT_DATA)) && !dma)
+            {
+                if (neosd_dev->stream.cmd_done)
+                    dptr = neosd_app_drain(dptr, neosd_app_block_end(buf, dptr), false);
+                else
+                    *(dptr++) = NEOSD->DATA;
+            }
+        }
+
+        size_t first = neosd_dev->stream.next;
+        neosd_dev->stream.next += count;
+        if (errors == 0)
+        {
+            // The clock can only change while the stream is closed
+            neosd_dev->link.stats.blocks += count;
+            return true;
+        }
+
+        // Retries need the command line, so close the stream. The next read opens it again,
+        // the next block may be past the end of the card.
+        bool ok = neosd_app_stream_close();
+        neosd_app_link_account(count, errors + (rest != count));
+        for (size_t i = 0; i < errors; i++)
+            ok &= neosd_app_retry_block(first + failed[i], &buf[128 * failed[i]], false);
+        if (rest != count)
+        {
+            ok &= neosd_app_retry_block(first + rest, &buf[128 * rest], false);
+            if (rest + 1 != count)
+                ok &= neosd_app_read_blocks(first + rest + 1, count - rest - 1, &buf[128 * (rest + 1)]);
+        }
+        neosd_dev->stream.active = true;
+        neosd_dev->stream.reopen = true;
+        return ok;
+    }
+
+    /**********************************************************************//**
+    * Read the next count blocks of an open stream and pass each data word to
+    * sink as it is read from DATA, e.g. straight into a peripheral FIFO. The
+    * data never goes through a buffer.
+    *
+    * @note Words are passed on before the CRC of their block is checked. A
+    * block with CRC error fails the call and is not passed on again.
+    **************************************************************************/
+    bool neosd_app_stream_sink(size_t count, neosd_sink_t sink, void* user)
+    {
+        if (!neosd_dev->stream.active)
+            return false;
+        if (neosd_dev->stream.reopen)
+            neosd_app_stream_open(neosd_dev->stream.next);
+
+        size_t blocks = 0, words = 0, errors = 0;
+        while (blocks != count)
+        {
+            uint32_t irq = neosd_status();
+
+            if (!neosd_dev->stream.cmd_done)
+            {
+                if (irq & (1 << NEOSD_CTRL_FLAG_CMD_RESP))
+                    *(neosd_dev->stream.rptr--) = NEOSD->RESP;
+
+                if (irq & (1 << NEOSD_CTRL_FLAG_CMD_DONE))
+                {
+                    neosd_ack(1 << NEOSD_CTRL_FLAG_CMD_DONE);
+                    NEOSD_DEBUG_R1(&neosd_dev->stream.resp.rshort);
+                    neosd_dev->stream.cmd_done = true;
+                }
+            }
+
+            // Words of the next block stay in the controller for the next call
+            if (irq & (1 << NEOSD_CTRL_FLAG_BLK_DONE))
+            {
+                if (irq & (1 << NEOSD_CTRL_CRCERR))
+                    errors++;
+                neosd_ack(irq & ((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR)));
+
+                if (++blocks == count)
+                    break;
+            }
+
+            if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DATA))
+            {
+                if (neosd_dev->stream.cmd_done)
+                    words = neosd_app_drain_sink(words, (words / 128 + 1) * 128, sink, user);
+                else
+                {
+                    sink(user, NEOSD->DATA);
+                    words++;
+                }
+            }
+        }
+
+        neosd_dev->stream.next += count;
+        if (errors == 0)
+        {
+            neosd_dev->link.stats.blocks += count;
+            return true;
+        }
+
+        // The data is gone, only the clock backoff applies. It needs the stream closed.
+        neosd_app_stream_close();
+        neosd_app_link_account(count, errors);
+        neosd_dev->stream.active = true;
+        neosd_dev->stream.reopen = true;
+        return false;
+    }
+
+    /**********************************************************************//**
+    * Stop an open stream using CMD12. Does nothing if no stream is open.
+    **************************************************************************/
+    bool neosd_app_stream_close()
+    {
+        if (!neosd_dev->stream.active)
+            return true;
+        neosd_dev->stream.active = false;
+        if (neosd_dev->stream.reopen)
+            return true;
+
+        neosd_res_t resp;
+        bool stopped = false;
+
+        while (true)
+        {
+            uint32_t irq = neosd_status();
+
+            // The CMD18 response has to be finished before the command line is free for CMD12
+            if (!neosd_dev->stream.cmd_done)
+            {
+                if (irq & (1 << NEOSD_CTRL_FLAG_CMD_RESP))
+                    *(neosd_dev->stream.rptr--) = NEOSD->RESP;
+
+                if (irq & (1 << NEOSD_CTRL_FLAG_CMD_DONE))
+                {
+                    neosd_ack(1 << NEOSD_CTRL_FLAG_CMD_DONE);
+                    neosd_dev->stream.cmd_done = true;
+                }
+            }
+
+            if (neosd_dev->stream.cmd_done && !stopped)
+            {
+                // CMD12: STOP_TRANSMISSION, also aborts the data FSM
+                neosd_cmd_commit_const<(SD_CMD_IDX)12, 0, NEOSD_RMODE_SHORT, NEOSD_DMODE_NONE, true>();
+                NEOSD_DEBUG_MSG("NEOSD: Sent CMD12 (stream)\n");
+                stopped = true;
+            }
+
+            // Discard everything read ahead
+            if (irq & (1 << NEOSD_CTRL_FLAG_BLK_DONE))
+                neosd_ack(irq & ((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR)));
+
+            if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DATA))
+                neosd_discard(NEOSD->DATA);
+
+            if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DONE))
+            {
+                neosd_ack(1 << NEOSD_CTRL_FLAG_DAT_DONE);
+                break;
+            }
+        }
+
+        // R1 of the stop command
+        if (!neosd_cmd_wait_res(&resp, NEOSD_CMD_TIMEOUT))
+        {
+            NEOSD_DEBUG_MSG("NEOSD: No response\n");
+            return false;
+        }
+        NEOSD_DEBUG_R1(&resp.rshort);
+
+        return true;
+    }
+
+    bool neosd_app_stream_active()
+    {
+        return neosd_dev->stream.active;
+    }
+
+    /**********************************************************************//**
+    * Get the block the next neosd_app_stream_read will start with.
+    **************************************************************************/
+    size_t neosd_app_stream_next()
+    {
+        return neosd_dev->stream.next;
+    }
 }
\ No newline at end of file
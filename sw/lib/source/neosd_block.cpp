@@ -6,11 +6,60 @@
 extern "C" {
 #endif
 
+// Polls between two deadline checks in blocking waits
+#ifndef NEOSD_TIME_POLLS
+#define NEOSD_TIME_POLLS 16
+#endif
+
+static uint32_t neosd_mcycle()
+{
+    return neorv32_cpu_csr_read(CSR_MCYCLE);
+}
+
+static const neosd_time_t neosd_time_mcycle = {neosd_mcycle, neorv32_sysinfo_get_clk};
+static const neosd_time_t* neosd_time = &neosd_time_mcycle;
+
 uint64_t neosd_clint_time_get_ms()
 {
     return neorv32_clint_time_get() / (((uint64_t)neorv32_sysinfo_get_clk() / 1000));
 }
 
+/**********************************************************************//**
+ * Set the time source for timeouts, nullptr selects mcycle.
+ **************************************************************************/
+void neosd_set_time_source(const neosd_time_t* time)
+{
+    neosd_time = time != nullptr ? time : &neosd_time_mcycle;
+}
+
+/**********************************************************************//**
+ * Start a timeout of ms milliseconds. Only this does a division, checking
+ * the deadline is a 32 bit subtraction.
+ *
+ * @note Timeouts are limited to 2^32 ticks, about 42 s at 100 MHz.
+ **************************************************************************/
+neosd_deadline_t neosd_deadline_ms(uint32_t ms)
+{
+    uint32_t per_ms = neosd_time->hz() / 1000;
+    neosd_deadline_t deadline;
+    deadline.start = neosd_time->ticks();
+    deadline.ticks = ms > UINT32_MAX / per_ms ? UINT32_MAX : ms * per_ms;
+    return deadline;
+}
+
+/**********************************************************************//**
+ * Restart a deadline at the current time with the same timeout.
+ **************************************************************************/
+void neosd_deadline_restart(neosd_deadline_t* deadline)
+{
+    deadline->start = neosd_time->ticks();
+}
+
+bool neosd_deadline_expired(const neosd_deadline_t* deadline)
+{
+    return (uint32_t)(neosd_time->ticks() - deadline->start) > deadline->ticks;
+}
+
 /**********************************************************************//**
  * Blocking wait for FSMs to return to idle state.
  *
@@ -31,10 +80,11 @@ void neosd_reset()
     neosd_begin_reset();
     while(neosd_busy()) {}
     // Clear data irq flags
-    NEOSD->RESP;
-    NEOSD->DATA;
-    // Clear IRQ flags and CRC sticky bit
-    NEOSD->CTRL &= ~((1 << NEOSD_CTRL_FLAG_CMD_DONE) | (1 << NEOSD_CTRL_FLAG_DAT_DONE) | (1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR));
+    neosd_discard(NEOSD->RESP);
+    neosd_discard(NEOSD->DATA);
+    // Clear IRQ flags and CRC sticky bits
+    neosd_ack((1 << NEOSD_CTRL_FLAG_CMD_DONE) | (1 << NEOSD_CTRL_FLAG_DAT_DONE) | (1 << NEOSD_CTRL_FLAG_BLK_DONE) |
+        (1 << NEOSD_CTRL_CRCERR) | (1 << NEOSD_CTRL_RESP_CRCERR));
     neosd_end_reset();
 }
 
@@ -45,25 +95,26 @@ void neosd_reset()
  **************************************************************************/
 bool neosd_cmd_wait_res(neosd_res_t* res, uint32_t rtimeout)
 {
-    uint64_t timeout = neosd_clint_time_get_ms() + rtimeout;
+    neosd_deadline_t deadline = neosd_deadline_ms(rtimeout);
 
     uint32_t* rptr = &res->_raw[4];
-    while (true)
+    for (uint32_t polls = 1; ; polls++)
     {
-        if (neosd_clint_time_get_ms() > timeout)
-        {
-            neosd_reset();
-            return false;
-        }
-
-        auto irq = NEOSD->CTRL;
+        uint32_t irq = neosd_status();
         if (irq & (1 << NEOSD_CTRL_FLAG_CMD_RESP))
             *(rptr--) = NEOSD->RESP;
         if (irq & (1 << NEOSD_CTRL_FLAG_CMD_DONE))
         {
-            NEOSD->CTRL &= ~(1 << NEOSD_CTRL_FLAG_CMD_DONE);
+            neosd_ack(1 << NEOSD_CTRL_FLAG_CMD_DONE);
             break;
         }
+
+        // Reading the time costs more than a poll, so only check every NEOSD_TIME_POLLS polls
+        if (polls % NEOSD_TIME_POLLS == 0 && neosd_deadline_expired(&deadline))
+        {
+            neosd_reset();
+            return false;
+        }
     }
 
     return true;
@@ -74,7 +125,11 @@ SD_CODE neosd_acmd_commit(SD_CMD_IDX acmd, uint32_t arg, NEOSD_RMODE rmode,
 {
     // 4.3.9.1 Application-Specific Command – APP_CMD (CMD55)
 
-    neosd_cmd_commit(SD_CMD55, rca << 16, NEOSD_RMODE_SHORT, NEOSD_DMODE_NONE);
+    // RCA 0 during identification: constant command word
+    if (rca == 0)
+        neosd_cmd_commit_const<SD_CMD55, 0, NEOSD_RMODE_SHORT, NEOSD_DMODE_NONE>();
+    else
+        neosd_cmd_commit(SD_CMD55, rca << 16, NEOSD_RMODE_SHORT, NEOSD_DMODE_NONE);
     NEOSD_DEBUG_MSG("NEOSD: Sent CMD55\n");
 
     neosd_res_t resp;
@@ -0,0 +1,239 @@
+#include "neosd.h"
+#include "neosd_irq.h"
+
+extern "C" {
+    #define NEOSD_IRQ_MASKS ((1 << NEOSD_CTRL_MASK_CMD_RESP) | (1 << NEOSD_CTRL_MASK_DAT_DATA) | \
+        (1 << NEOSD_CTRL_MASK_CMD_DONE) | (1 << NEOSD_CTRL_MASK_DAT_DONE) | (1 << NEOSD_CTRL_MASK_BLK_DONE))
+    #define NEOSD_IRQ_FLAGS ((1 << NEOSD_CTRL_FLAG_CMD_DONE) | (1 << NEOSD_CTRL_FLAG_DAT_DONE) | \
+        (1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR))
+
+    /**********************************************************************//**
+    * Setup a transfer for a command without data blocks.
+    *
+    * @note Use NEOSD_DMODE_BUSY for commands with R1b response.
+    **************************************************************************/
+    void neosd_xfer_cmd(neosd_xfer_t* xfer, SD_CMD_IDX cmd, uint32_t arg, NEOSD_RMODE rmode, NEOSD_DMODE dmode)
+    {
+        xfer->cmd = cmd;
+        xfer->arg = arg;
+        xfer->rmode = rmode;
+        xfer->dmode = dmode;
+        xfer->buf = nullptr;
+        xfer->blocks = 0;
+        xfer->stop = false;
+        xfer->state = NEOSD_XFER_IDLE;
+    }
+
+    /**********************************************************************//**
+    * Setup a transfer reading count blocks, using CMD17 or CMD18 + CMD12.
+    *
+    * @note block is passed to the card as is, so it must already be a byte
+    * address for SDSC cards.
+    **************************************************************************/
+    void neosd_xfer_read(neosd_xfer_t* xfer, size_t block, size_t count, uint32_t* buf)
+    {
+        neosd_xfer_cmd(xfer, (SD_CMD_IDX)(count == 1 ? 17 : 18), block, NEOSD_RMODE_SHORT, NEOSD_DMODE_READ);
+        xfer->buf = buf;
+        xfer->blocks = count;
+        xfer->stop = count != 1;
+    }
+
+    /**********************************************************************//**
+    * Setup a transfer writing count blocks, using CMD24 or CMD25 + CMD12.
+    *
+    * @note block is passed to the card as is, so it must already be a byte
+    * address for SDSC cards.
+    **************************************************************************/
+    void neosd_xfer_write(neosd_xfer_t* xfer, size_t block, size_t count, const uint32_t* buf)
+    {
+        neosd_xfer_cmd(xfer, (SD_CMD_IDX)(count == 1 ? 24 : 25), block, NEOSD_RMODE_SHORT, NEOSD_DMODE_WRITE);
+        // The buffer is only read for writes
+        xfer->buf = (uint32_t*)buf;
+        xfer->blocks = count;
+        xfer->stop = count != 1;
+    }
+
+    /**********************************************************************//**
+    * Finish the active transfer: Disable interrupts and notify the owner.
+    **************************************************************************/
+    static void neosd_irq_complete(neosd_xfer_t* xfer, NEOSD_XFER_STATE state)
+    {
+        neosd_ctrl_modify(NEOSD_IRQ_MASKS, 0);
+        neosd_ack(NEOSD_IRQ_FLAGS);
+        neosd_dev->xfer = nullptr;
+
+        xfer->state = state;
+        if (xfer->callback)
+            xfer->callback(xfer);
+    }
+
+    /**********************************************************************//**
+    * Start a transfer. Progress is made in neosd_irq_handler, callback is
+    * called from there once the transfer is done.
+    *
+    * @returns false if another transfer is active or the controller is busy,
+    * also with a pending write-behind (neosd_app_write_sync).
+    *
+    * @note Do not use the blocking API while a transfer is active.
+    **************************************************************************/
+    bool neosd_irq_submit(neosd_xfer_t* xfer, neosd_xfer_cb_t callback, void* user)
+    {
+        if (neosd_dev->xfer != nullptr || neosd_dev->behind.pending || neosd_busy() != 0)
+            return false;
+
+        xfer->callback = callback;
+        xfer->user = user;
+        xfer->crc_ok = true;
+        xfer->rptr = &xfer->resp._raw[4];
+        xfer->dptr = xfer->buf;
+        xfer->dend = xfer->buf + xfer->blocks * 128;
+        xfer->blocks_done = 0;
+        xfer->cmd_pending = true;
+        xfer->state = NEOSD_XFER_CMD;
+        neosd_dev->xfer = xfer;
+
+        // With DMA, data words only raise an interrupt once the DMA engine is done
+        uint32_t masks = NEOSD_IRQ_MASKS;
+        const neosd_dma_t* dma = neosd_get_dma();
+        if (dma != nullptr && xfer->blocks != 0)
+        {
+            dma->start(&NEOSD->DATA, xfer->buf, xfer->blocks * 128, xfer->dmode == NEOSD_DMODE_WRITE);
+            xfer->dptr = xfer->dend;
+            masks &= ~(1 << NEOSD_CTRL_MASK_DAT_DATA);
+        }
+
+        neosd_ctrl_modify(0, masks);
+        neosd_cmd_commit(xfer->cmd, xfer->arg, xfer->rmode, xfer->dmode);
+        return true;
+    }
+
+    /**********************************************************************//**
+    * Interrupt handler, call this from the ISR connected to irq_o.
+    *
+    * @note Any callback is run from this function.
+    **************************************************************************/
+    void neosd_irq_handler()
+    {
+        neosd_xfer_t* xfer = neosd_dev->xfer;
+        if (xfer == nullptr)
+            return;
+
+        uint32_t irq = neosd_status();
+
+        if (irq & (1 << NEOSD_CTRL_FLAG_CMD_RESP))
+            *(xfer->rptr--) = NEOSD->RESP;
+
+        if (irq & (1 << NEOSD_CTRL_FLAG_CMD_DONE))
+        {
+            neosd_ack(1 << NEOSD_CTRL_FLAG_CMD_DONE);
+            xfer->cmd_pending = false;
+            if (xfer->state == NEOSD_XFER_CMD)
+                xfer->state = xfer->blocks != 0 ? NEOSD_XFER_DATA : NEOSD_XFER_STOP;
+        }
+
+        // A block is only done after all its words were transferred. So handle this first:
+        // The same flags snapshot can already contain the first word of the next block.
+        if (irq & (1 << NEOSD_CTRL_FLAG_BLK_DONE))
+        {
+            if (irq & (1 << NEOSD_CTRL_CRCERR))
+                xfer->crc_ok = false;
+            neosd_ack(irq & ((1 << NEOSD_CTRL_FLAG_BLK_DONE) | (1 << NEOSD_CTRL_CRCERR)));
+
+            if (++xfer->blocks_done == xfer->blocks)
+            {
+                xfer->state = NEOSD_XFER_STOP;
+                neosd_ctrl_modify(0, 1 << NEOSD_CTRL_MASK_DAT_DATA);
+                if (xfer->stop)
+                {
+                    // CMD12: STOP_TRANSMISSION, also aborts the data FSM. Writes need busy handling.
+                    xfer->rptr = &xfer->resp._raw[4];
+                    xfer->cmd_pending = true;
+                    if (xfer->dmode == NEOSD_DMODE_WRITE)
+                        neosd_cmd_commit_const<(SD_CMD_IDX)12, 0, NEOSD_RMODE_SHORT, NEOSD_DMODE_BUSY, true>();
+                    else
+                        neosd_cmd_commit_const<(SD_CMD_IDX)12, 0, NEOSD_RMODE_SHORT, NEOSD_DMODE_NONE, true>();
+                }
+                else
+                {
+                    NEOSD->CMD = (1 << NEOSD_CMD_ABRT_DAT);
+                }
+            }
+        }
+
+        if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DATA))
+        {
+            // Words of the block following the last one are discarded. Until then, all words
+            // are owned by the DMA engine if there is one.
+            if (xfer->dptr != xfer->dend)
+            {
+                if (xfer->dmode == NEOSD_DMODE_WRITE)
+                    NEOSD->DATA = *(xfer->dptr++);
+                else
+                    *(xfer->dptr++) = NEOSD->DATA;
+            }
+            else if (xfer->blocks_done == xfer->blocks)
+            {
+                neosd_discard(NEOSD->DATA);
+            }
+        }
+
+        if (irq & (1 << NEOSD_CTRL_FLAG_DAT_DONE))
+            neosd_ack(1 << NEOSD_CTRL_FLAG_DAT_DONE);
+
+        // DAT_DONE is only an edge: Check the FSMs directly, busy may already have ended
+        if (xfer->state == NEOSD_XFER_STOP && !xfer->cmd_pending && neosd_busy() == 0)
+            neosd_irq_complete(xfer, xfer->crc_ok ? NEOSD_XFER_DONE : NEOSD_XFER_ERROR);
+    }
+
+#ifdef NEOSD_MULTI
+    /**********************************************************************//**
+    * Interrupt handler for the controller of dev, call this from its ISR.
+    * The selected device is restored, so transfers on several controllers
+    * can run at the same time as blocking calls on another one.
+    **************************************************************************/
+    void neosd_irq_dev_handler(neosd_dev_t* dev)
+    {
+        neosd_dev_t* selected = neosd_dev;
+        neosd_select(dev);
+        neosd_irq_handler();
+        neosd_select(selected);
+    }
+#endif
+
+    /**********************************************************************//**
+    * Check whether a transfer is active.
+    **************************************************************************/
+    bool neosd_irq_busy()
+    {
+        return neosd_dev->xfer != nullptr;
+    }
+
+    /**********************************************************************//**
+    * Abort the active transfer and reset the controller.
+    *
+    * @note There is no timeout in hardware: Use this if the card does not
+    * respond in time. The callback is called with NEOSD_XFER_ERROR.
+    **************************************************************************/
+    void neosd_irq_abort()
+    {
+        neosd_xfer_t* xfer = neosd_dev->xfer;
+        neosd_ctrl_modify(NEOSD_IRQ_MASKS, 0);
+
+        const neosd_dma_t* dma = neosd_get_dma();
+        if (xfer != nullptr && dma != nullptr && xfer->blocks != 0)
+            dma->stop();
+        neosd_reset();
+
+        if (xfer != nullptr)
+            neosd_irq_complete(xfer, NEOSD_XFER_ERROR);
+    }
+
+    /**********************************************************************//**
+    * Blocking wait for a submitted transfer.
+    **************************************************************************/
+    NEOSD_XFER_STATE neosd_irq_wait(neosd_xfer_t* xfer)
+    {
+        while (xfer->state != NEOSD_XFER_DONE && xfer->state != NEOSD_XFER_ERROR) {}
+        return xfer->state;
+    }
+}
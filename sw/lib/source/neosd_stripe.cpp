@@ -0,0 +1,126 @@
+#include "neosd_app.h"
+#include "neosd_irq.h"
+#include "neosd_stripe.h"
+
+#ifdef NEOSD_MULTI
+extern "C" {
+    /**********************************************************************//**
+    * Setup a striped device over the NEOSD_STRIPE_WAYS controllers in devs.
+    **************************************************************************/
+    void neosd_stripe_init(neosd_stripe_t* stripe, neosd_dev_t* const* devs)
+    {
+        for (size_t i = 0; i < NEOSD_STRIPE_WAYS; i++)
+            stripe->dev[i] = devs[i];
+    }
+
+    // Whether the interrupt transfer of a part still has to make progress
+    static bool neosd_stripe_pending(const neosd_xfer_t* xfer)
+    {
+        return xfer->state != NEOSD_XFER_IDLE && xfer->state != NEOSD_XFER_DONE && xfer->state != NEOSD_XFER_ERROR;
+    }
+
+    /**********************************************************************//**
+    * Transfer the blocks of up to NEOSD_STRIPE_WAYS consecutive chunks, one
+    * per controller, at the same time. The data phases progress by polling
+    * the interrupt handlers in turn, with NEOSD_STRIPE_IRQ by the ISRs.
+    * Parts that could not be submitted or failed are transferred again with
+    * the blocking API and its CRC retries.
+    *
+    * @param done Number of blocks of this round.
+    **************************************************************************/
+    static bool neosd_stripe_round(const neosd_stripe_t* stripe, size_t block, size_t count, uint32_t* buf,
+        bool write, size_t* done)
+    {
+        neosd_xfer_t xfer[NEOSD_STRIPE_WAYS];
+        neosd_dev_t* dev[NEOSD_STRIPE_WAYS];
+        size_t parts = 0;
+        bool ok = true;
+
+        // Consecutive chunks are on different controllers
+        for (*done = 0; parts < NEOSD_STRIPE_WAYS && *done < count; parts++)
+        {
+            size_t chunk = (block + *done) / NEOSD_STRIPE_CHUNK;
+            size_t offset = (block + *done) % NEOSD_STRIPE_CHUNK;
+            size_t blocks = NEOSD_STRIPE_CHUNK - offset;
+            if (blocks > count - *done)
+                blocks = count - *done;
+            size_t dev_block = chunk / NEOSD_STRIPE_WAYS * NEOSD_STRIPE_CHUNK + offset;
+
+            if (write)
+                neosd_xfer_write(&xfer[parts], dev_block, blocks, buf + *done * 128);
+            else
+                neosd_xfer_read(&xfer[parts], dev_block, blocks, buf + *done * 128);
+            *done += blocks;
+
+            dev[parts] = stripe->dev[chunk % NEOSD_STRIPE_WAYS];
+            neosd_select(dev[parts]);
+            neosd_app_stream_close();
+            // A failed write-behind of the blocking fallback is reported here
+            ok &= neosd_app_write_sync();
+            neosd_irq_submit(&xfer[parts], nullptr, nullptr);
+        }
+
+        for (bool pending = true; pending; )
+        {
+            pending = false;
+            for (size_t i = 0; i < parts; i++)
+            {
+                if (!neosd_stripe_pending(&xfer[i]))
+                    continue;
+#ifndef NEOSD_STRIPE_IRQ
+                neosd_select(dev[i]);
+                neosd_irq_handler();
+#endif
+                pending |= neosd_stripe_pending(&xfer[i]);
+            }
+        }
+
+        for (size_t i = 0; i < parts; i++)
+        {
+            if (xfer[i].state == NEOSD_XFER_DONE)
+                continue;
+
+            neosd_select(dev[i]);
+            if (write)
+                ok &= neosd_app_write_blocks(xfer[i].arg, xfer[i].blocks, xfer[i].buf);
+            else
+                ok &= neosd_app_read_blocks(xfer[i].arg, xfer[i].blocks, xfer[i].buf);
+        }
+        return ok;
+    }
+
+    static bool neosd_stripe_transfer(const neosd_stripe_t* stripe, size_t block, size_t count, uint32_t* buf,
+        bool write)
+    {
+        neosd_dev_t* selected = neosd_dev;
+        bool ok = true;
+        while (count != 0)
+        {
+            size_t done;
+            ok &= neosd_stripe_round(stripe, block, count, buf, write, &done);
+            block += done;
+            count -= done;
+            buf += done * 128;
+        }
+        neosd_select(selected);
+        return ok;
+    }
+
+    /**********************************************************************//**
+    * Read count blocks of the striped device.
+    **************************************************************************/
+    bool neosd_stripe_read(const neosd_stripe_t* stripe, size_t block, size_t count, uint32_t* buf)
+    {
+        return neosd_stripe_transfer(stripe, block, count, buf, false);
+    }
+
+    /**********************************************************************//**
+    * Write count blocks of the striped device.
+    **************************************************************************/
+    bool neosd_stripe_write(const neosd_stripe_t* stripe, size_t block, size_t count, const uint32_t* buf)
+    {
+        // The buffer is only read for writes
+        return neosd_stripe_transfer(stripe, block, count, (uint32_t*)buf, true);
+    }
+}
+#endif
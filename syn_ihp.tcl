@@ -15,7 +15,7 @@ read_verilog -defer -sv {*}$::env(SYN_SVERILOG_PATHS)
 # Read stdcells
 read_liberty -overwrite -setattr liberty_cell -lib $pdk_stdcell_lib
 
-hierarchy -check -top $::env(TOP_MODULE)
+hierarchy -check -top $::env(TOP_MODULE) -chparam FIFO_DEPTH_LOG2 $::env(FIFO_DEPTH_LOG2)
 # Synthesize, don't flatten
 synth -run :fine
 # Remove non-synthesizeable stuff
@@ -1,6 +1,7 @@
 import cocotb
 from cocotb.clock import Clock
 from cocotb.triggers import ClockCycles, RisingEdge, FallingEdge
+from cocotb.utils import get_sim_time
 
 from cocotbext.wishbone.driver import WishboneMaster
 from cocotbext.wishbone.driver import WBOp
@@ -313,6 +314,605 @@ async def test_busy_response(dut):
     result = await wbs.send_cycle([WBOp(0x4)])
     assert((result[0].datrd & 0b11) == 0)
 
+# CMD12 after a multi block write is committed with the abort bit and waits for R1b busy.
+# The still active abort bit must not end the busy wait of the data FSM.
+@cocotb.test()
+async def test_busy_response_stop(dut):
+    wbs = await init_test(dut)
+    await configure_peripheral(dut, wbs, False, False)
+
+    cmd = 0
+    # Commit, abort data
+    cmd = cmd | 0b11
+    # DMODE: busy
+    cmd = cmd | (0b01 << 4)
+    # RMODE: short
+    cmd = cmd | (1 << 6)
+    # CRC
+    cmd = cmd | (0b1110011 << 16)
+    # IDX
+    cmd = cmd | (0b101010 << 24)
+
+    await wbs.send_cycle([WBOp(0x8, 42), WBOp(0xC, cmd)])
+    await ClockCycles(dut.clk, 64*8)
+
+    # Emulate busy going high
+    dut.sd_dat0_i.value = 0
+
+    # Read the response
+    dut.sd_cmd_i.value = 0
+    await ClockCycles(dut.clk, 17*8)
+    await wbs.send_cycle([WBOp(0x4), WBOp(0x10)])
+
+    await ClockCycles(dut.clk, 64*8)
+    await wbs.send_cycle([WBOp(0x4), WBOp(0x10)])
+    dut.sd_cmd_i.value = 1
+    await ClockCycles(dut.clk, 32*8)
+
+    # Data FSM should still be busy
+    result = await wbs.send_cycle([WBOp(0x4)])
+    assert((result[0].datrd & (1 << 13)) != 0)
+
+    # Emulate busy going low
+    dut.sd_dat0_i.value = 1
+    await ClockCycles(dut.clk, 16*8)
+
+    # Should be in idle state again
+    result = await wbs.send_cycle([WBOp(0x4)])
+    assert((result[0].datrd & (0b11 << 12)) == 0)
+
+
+# A card that never releases DAT0 after an R1b: CTRL_RST still ends the busy wait, which the
+# abort bit doesn't.
+@cocotb.test()
+async def test_busy_response_rst(dut):
+    wbs = await init_test(dut)
+    await configure_peripheral(dut, wbs, False, False)
+
+    cmd = 0
+    # Commit, abort data
+    cmd = cmd | 0b11
+    # DMODE: busy
+    cmd = cmd | (0b01 << 4)
+    # RMODE: short
+    cmd = cmd | (1 << 6)
+    # CRC
+    cmd = cmd | (0b1110011 << 16)
+    # IDX
+    cmd = cmd | (0b101010 << 24)
+
+    await wbs.send_cycle([WBOp(0x8, 42), WBOp(0xC, cmd)])
+    await ClockCycles(dut.clk, 64*8)
+
+    # Busy for good
+    dut.sd_dat0_i.value = 0
+
+    # Read the response
+    dut.sd_cmd_i.value = 0
+    await ClockCycles(dut.clk, 17*8)
+    await wbs.send_cycle([WBOp(0x4), WBOp(0x10)])
+
+    await ClockCycles(dut.clk, 64*8)
+    await wbs.send_cycle([WBOp(0x4), WBOp(0x10)])
+    dut.sd_cmd_i.value = 1
+    await ClockCycles(dut.clk, 32*8)
+
+    result = await wbs.send_cycle([WBOp(0x4)])
+    cfg = result[0].datrd.integer
+    assert((cfg & (1 << 13)) != 0)
+
+    # Reset, both FSMs idle although DAT0 is still low
+    await wbs.send_cycle([WBOp(0x4, cfg | 0b1)])
+    await ClockCycles(dut.clk, 16*8)
+    result = await wbs.send_cycle([WBOp(0x4)])
+    assert((result[0].datrd.integer & (0b11 << 12)) == 0)
+
+    # And they stay idle after the reset is released
+    await wbs.send_cycle([WBOp(0x4, cfg & ~0b1)])
+    await ClockCycles(dut.clk, 16*8)
+    result = await wbs.send_cycle([WBOp(0x4)])
+    assert((result[0].datrd.integer & (0b11 << 12)) == 0)
+    dut.sd_dat0_i.value = 1
+
+def crc16_bits(bits):
+    crc = 0
+    for bit in bits:
+        fb = ((crc >> 15) & 1) ^ bit
+        crc = (crc << 1) & 0xFFFF
+        if fb:
+            crc ^= 0x1021
+    return crc
+
+# Card side of a 4 wire read block: Start bit, data nibbles, CRC16 per line, end bit
+async def send_read_block_d4(dut, data):
+    lines = [dut.sd_dat0_i, dut.sd_dat1_i, dut.sd_dat2_i, dut.sd_dat3_i]
+    nibbles = []
+    for byte in data:
+        nibbles.append(byte >> 4)
+        nibbles.append(byte & 0xF)
+    crcs = [crc16_bits([(n >> i) & 1 for n in nibbles]) for i in range(4)]
+
+    await FallingEdge(dut.sd_clk_o)
+    for line in lines:
+        line.value = 0
+
+    for n in nibbles:
+        await FallingEdge(dut.sd_clk_o)
+        for i in range(4):
+            lines[i].value = (n >> i) & 1
+
+    for bit in range(15, -1, -1):
+        await FallingEdge(dut.sd_clk_o)
+        for i in range(4):
+            lines[i].value = (crcs[i] >> bit) & 1
+
+    await FallingEdge(dut.sd_clk_o)
+    for line in lines:
+        line.value = 1
+
+# Models a DMA channel triggered by flag_data_o: Moves one word per request
+async def dma_engine(dut, wbs, words):
+    received = []
+    while len(received) < words:
+        await RisingEdge(dut.clk)
+        if dut.flag_data_o.value == 1:
+            result = await wbs.send_cycle([WBOp(0x14)])
+            received.append(result[0].datrd.integer)
+    return received
+
+# Read a block with the data words moved by a DMA engine. The CPU only handles the
+# command response and BLK_DONE.
+@cocotb.test()
+async def test_read_block_dma(dut):
+    wbs = await init_test(dut)
+    await configure_peripheral(dut, wbs, False, True)
+
+    cmd = 0
+    # Commit
+    cmd = cmd | 0b1
+    # DMODE: read
+    cmd = cmd | (0b10 << 4)
+    # RMODE: short
+    cmd = cmd | (1 << 6)
+    # CRC
+    cmd = cmd | (0b1110011 << 16)
+    # IDX
+    cmd = cmd | (0b101010 << 24)
+
+    await wbs.send_cycle([WBOp(0x8, 42), WBOp(0xC, cmd)])
+    await ClockCycles(dut.clk, 64*8)
+
+    # Short response, then data FSM waits for the block
+    dut.sd_cmd_i.value = 0
+    while True:
+        result = await wbs.send_cycle([WBOp(0x4)])
+        flags = result[0].datrd.integer
+        if flags & (1 << 16):
+            await wbs.send_cycle([WBOp(0x10)])
+        if flags & (1 << 18):
+            break
+    dut.sd_cmd_i.value = 1
+    await wbs.send_cycle([WBOp(0x1C, 1 << 18)])
+
+    data = [(i // 4) & 0xFF for i in range(512)]
+    dma = cocotb.start_soon(dma_engine(dut, wbs, 128))
+    await send_read_block_d4(dut, data)
+
+    # BLK_DONE without CRC error
+    while True:
+        result = await wbs.send_cycle([WBOp(0x4)])
+        flags = result[0].datrd.integer
+        if flags & (1 << 20):
+            break
+    assert((flags & (1 << 14)) == 0)
+
+    words = await dma
+    assert(words == [i * 0x01010101 for i in range(128)])
+    assert(dut.flag_data_o.value == 0)
+
+    # Stop the data FSM, like the driver does after the last block
+    await wbs.send_cycle([WBOp(0x1C, 1 << 20), WBOp(0xC, 0b10)])
+    await ClockCycles(dut.clk, 16*8)
+    result = await wbs.send_cycle([WBOp(0x4)])
+    assert((result[0].datrd.integer & (0b11 << 12)) == 0)
+
+def crc7_bits(bits):
+    crc = 0
+    for bit in bits:
+        fb = ((crc >> 6) & 1) ^ bit
+        crc = (crc << 1) & 0x7F
+        if fb:
+            crc ^= 0x09
+    return crc
+
+def to_bits(value, width):
+    return [(value >> i) & 1 for i in range(width - 1, -1, -1)]
+
+# Host side of a command as seen by the card: Sampled on the rising SD clock edge
+async def capture_command(dut):
+    bits = []
+    while len(bits) < 48:
+        await RisingEdge(dut.sd_clk_o)
+        if dut.sd_cmd_oe.value == 1:
+            bits.append(dut.sd_cmd_o.value.integer)
+    return bits
+
+# Card side of a short response: Start and transmission bit, index, argument, CRC7, end bit
+async def send_short_response(dut, idx, arg, crc_ok):
+    bits = [0, 0] + to_bits(idx, 6) + to_bits(arg, 32)
+    crc = crc7_bits(bits)
+    if not crc_ok:
+        crc = crc ^ 0b0010000
+    bits = bits + to_bits(crc, 7) + [1]
+
+    # N_CR
+    await FallingEdge(dut.sd_clk_o)
+    await FallingEdge(dut.sd_clk_o)
+    for bit in bits:
+        await FallingEdge(dut.sd_clk_o)
+        dut.sd_cmd_i.value = bit
+    await FallingEdge(dut.sd_clk_o)
+    dut.sd_cmd_i.value = 1
+
+# Card side of an R2: Start and transmission bit, reserved bits, CID / CSD bits 127:8, CRC7, end bit
+async def send_long_response(dut, reg, crc_ok):
+    bits = [0, 0] + [1] * 6 + to_bits(reg >> 8, 120)
+    crc = crc7_bits(bits[8:])
+    if not crc_ok:
+        crc = crc ^ 0b0000001
+    bits = bits + to_bits(crc, 7) + [1]
+
+    # N_CR
+    await FallingEdge(dut.sd_clk_o)
+    await FallingEdge(dut.sd_clk_o)
+    for bit in bits:
+        await FallingEdge(dut.sd_clk_o)
+        dut.sd_cmd_i.value = bit
+    await FallingEdge(dut.sd_clk_o)
+    dut.sd_cmd_i.value = 1
+
+# Read response words until the command FSM is done, returns the CTRL register
+async def read_response(dut, wbs):
+    while True:
+        result = await wbs.send_cycle([WBOp(0x4)])
+        flags = result[0].datrd.integer
+        if flags & (1 << 16):
+            await wbs.send_cycle([WBOp(0x10)])
+        if flags & (1 << 18):
+            return flags
+
+async def auto_crc_command(dut, wbs, idx, arg, crc_ok, ack = True):
+    cmd = 0
+    # Commit, auto CRC
+    cmd = cmd | 0b101
+    # RMODE: short
+    cmd = cmd | (1 << 6)
+    # IDX
+    cmd = cmd | (idx << 24)
+
+    capture = cocotb.start_soon(capture_command(dut))
+    await wbs.send_cycle([WBOp(0x8, arg), WBOp(0xC, cmd)])
+    bits = await capture
+
+    # Start and transmission bit, generated CRC, end bit
+    assert(bits[0:8] == [0, 1] + to_bits(idx, 6))
+    assert(bits[8:40] == to_bits(arg, 32))
+    assert(bits[40:47] == to_bits(crc7_bits(bits[0:40]), 7))
+    assert(bits[47] == 1)
+
+    cocotb.start_soon(send_short_response(dut, idx, 0x00000900, crc_ok))
+    flags = await read_response(dut, wbs)
+    if ack:
+        await wbs.send_cycle([WBOp(0x1C, 1 << 18)])
+    return flags
+
+# Commands with AUTO_CRC get the CRC from the controller. Response CRC errors set RESP_CRCERR
+# until the next command is committed.
+@cocotb.test()
+async def test_cmd_auto_crc(dut):
+    wbs = await init_test(dut)
+    await configure_peripheral(dut, wbs, False, False)
+
+    # Version 0.5.0
+    result = await wbs.send_cycle([WBOp(0x0)])
+    assert((result[0].datrd.integer & 0xFFF) == 0x050)
+
+    # CMD17 and CMD8 with its check pattern
+    flags = await auto_crc_command(dut, wbs, 17, 0x00001234, True)
+    assert((flags & (1 << 15)) == 0)
+    flags = await auto_crc_command(dut, wbs, 8, 0x000001A4, True)
+    assert((flags & (1 << 15)) == 0)
+
+    # Broken response CRC
+    flags = await auto_crc_command(dut, wbs, 13, 0x00010000, False)
+    assert((flags & (1 << 15)) != 0)
+    await ClockCycles(dut.clk, 16*8)
+    result = await wbs.send_cycle([WBOp(0x4)])
+    assert((result[0].datrd.integer & (1 << 15)) != 0)
+
+    # Cleared by the next command
+    flags = await auto_crc_command(dut, wbs, 13, 0x00010000, True)
+    assert((flags & (1 << 15)) == 0)
+
+# CMD2 with an R2: The response CRC covers the CID bits after the reserved bits only
+@cocotb.test()
+async def test_cmd_auto_crc_r2(dut):
+    wbs = await init_test(dut)
+    await configure_peripheral(dut, wbs, False, False)
+
+    cid = 0x035344534431364780B4C1F3B9013C00
+    for crc_ok in [True, False, True]:
+        cmd = 0
+        # Commit, auto CRC
+        cmd = cmd | 0b101
+        # RMODE: long
+        cmd = cmd | (2 << 6)
+        # IDX
+        cmd = cmd | (2 << 24)
+
+        capture = cocotb.start_soon(capture_command(dut))
+        await wbs.send_cycle([WBOp(0x8, 0), WBOp(0xC, cmd)])
+        bits = await capture
+        assert(bits[0:8] == [0, 1] + to_bits(2, 6))
+        assert(bits[40:47] == to_bits(crc7_bits(bits[0:40]), 7))
+
+        cocotb.start_soon(send_long_response(dut, cid, crc_ok))
+        flags = await read_response(dut, wbs)
+        await wbs.send_cycle([WBOp(0x1C, 1 << 18)])
+        if crc_ok:
+            assert((flags & (1 << 15)) == 0)
+        else:
+            assert((flags & (1 << 15)) != 0)
+
+# STATUS mirrors the CTRL status bits, FLAGS clears the written bits only. CTRL writes keep the flags
+# written as 1 and clear the ones written as 0.
+@cocotb.test()
+async def test_status_flags(dut):
+    wbs = await init_test(dut)
+    await configure_peripheral(dut, wbs, False, False)
+
+    flags = await auto_crc_command(dut, wbs, 13, 0x00010000, False, False)
+    assert((flags & ((1 << 18) | (1 << 15))) == ((1 << 18) | (1 << 15)))
+
+    # Configuration write with the flag bits written as 1 keeps them
+    await wbs.send_cycle([WBOp(0x4, flags | (0x7F << 14))])
+    result = await wbs.send_cycle([WBOp(0x4), WBOp(0x18), WBOp(0x1C)])
+    ctrl = result[0].datrd.integer
+    assert((ctrl & ((1 << 18) | (1 << 15))) == ((1 << 18) | (1 << 15)))
+    assert(result[1].datrd.integer == (ctrl & (0x1FF << 12)))
+    assert(result[2].datrd.integer == (ctrl & (0x7F << 14)))
+
+    await wbs.send_cycle([WBOp(0x1C, 1 << 18)])
+    result = await wbs.send_cycle([WBOp(0x18)])
+    assert((result[0].datrd.integer & ((1 << 18) | (1 << 15))) == (1 << 15))
+
+    # Software for 0.2.0 acknowledges by writing CTRL with the bit cleared
+    flags = await auto_crc_command(dut, wbs, 13, 0x00010000, False, False)
+    assert((flags & ((1 << 18) | (1 << 15))) == ((1 << 18) | (1 << 15)))
+    await wbs.send_cycle([WBOp(0x4, flags & ~(1 << 18))])
+    result = await wbs.send_cycle([WBOp(0x18)])
+    assert((result[0].datrd.integer & ((1 << 18) | (1 << 15))) == (1 << 15))
+
+    await wbs.send_cycle([WBOp(0x1C, 1 << 15)])
+    result = await wbs.send_cycle([WBOp(0x18)])
+    assert((result[0].datrd.integer & (0x7F << 14)) == 0)
+
+    # Read-modify-write of CTRL with CMD_DONE raised between the read and the write: Written back
+    # as 0 it is cleared, written as 1 (neosd_ctrl_modify) it is kept
+    for keep in [False, True]:
+        cmd = 0b101 | (1 << 6) | (13 << 24)
+        capture = cocotb.start_soon(capture_command(dut))
+        await wbs.send_cycle([WBOp(0x8, 0x00010000), WBOp(0xC, cmd)])
+        await capture
+        result = await wbs.send_cycle([WBOp(0x4)])
+        ctrl = result[0].datrd.integer
+        assert((ctrl & (1 << 18)) == 0)
+
+        cocotb.start_soon(send_short_response(dut, 13, 0x00000900, True))
+        await read_response(dut, wbs)
+        if keep:
+            ctrl = ctrl | (0x7F << 14)
+        await wbs.send_cycle([WBOp(0x4, ctrl)])
+        result = await wbs.send_cycle([WBOp(0x18)])
+        if keep:
+            assert((result[0].datrd.integer & (1 << 18)) != 0)
+            await wbs.send_cycle([WBOp(0x1C, 1 << 18)])
+        else:
+            assert((result[0].datrd.integer & (1 << 18)) == 0)
+
+# The block counter stops a read after the last block on its own and sends CMD12 with a generated CRC
+@cocotb.test()
+async def test_block_counter_cmd12(dut):
+    wbs = await init_test(dut)
+    await configure_peripheral(dut, wbs, False, True)
+
+    # One block, then CMD12
+    await wbs.send_cycle([WBOp(0x20, (1 << 31) | 1)])
+
+    cmd = 0
+    # Commit, auto CRC
+    cmd = cmd | 0b101
+    # DMODE: read
+    cmd = cmd | (0b10 << 4)
+    # RMODE: short
+    cmd = cmd | (1 << 6)
+    # IDX
+    cmd = cmd | (18 << 24)
+
+    capture = cocotb.start_soon(capture_command(dut))
+    await wbs.send_cycle([WBOp(0x8, 0), WBOp(0xC, cmd)])
+    await capture
+
+    # CMD12 waits for CMD_DONE of CMD18 to be acknowledged
+    cocotb.start_soon(send_short_response(dut, 18, 0x00000900, True))
+    await read_response(dut, wbs)
+    await wbs.send_cycle([WBOp(0x1C, 1 << 18)])
+
+    data = [(i // 4) & 0xFF for i in range(512)]
+    dma = cocotb.start_soon(dma_engine(dut, wbs, 128))
+    capture = cocotb.start_soon(capture_command(dut))
+    await send_read_block_d4(dut, data)
+    words = await dma
+    assert(words == [i * 0x01010101 for i in range(128)])
+
+    bits = await capture
+    assert(bits[0:8] == [0, 1] + to_bits(12, 6))
+    assert(bits[8:40] == to_bits(0, 32))
+    assert(bits[40:47] == to_bits(crc7_bits(bits[0:40]), 7))
+
+    cocotb.start_soon(send_short_response(dut, 12, 0x00000900, True))
+    flags = await read_response(dut, wbs)
+    assert((flags & ((1 << 20) | (1 << 15) | (1 << 14))) == (1 << 20))
+
+    # Counter ran down, both FSMs are idle
+    await ClockCycles(dut.clk, 16*8)
+    result = await wbs.send_cycle([WBOp(0x20), WBOp(0x18)])
+    assert(result[0].datrd.integer == (1 << 31))
+    assert((result[1].datrd.integer & (0b11 << 12)) == 0)
+
+# A CMD13 while the CMD12 of the block counter is pending goes first. CMDARG is written before
+# CMD_DONE of the CMD18 is acknowledged, which lets the CMD12 go, and the CMD write follows in
+# the next cycles. The CMD12 is sent once CMD_DONE of the CMD13 is acknowledged.
+@cocotb.test()
+async def test_block_counter_cmd13(dut):
+    wbs = await init_test(dut)
+    await configure_peripheral(dut, wbs, False, True)
+
+    # One block, then CMD12
+    await wbs.send_cycle([WBOp(0x20, (1 << 31) | 1)])
+
+    cmd = 0
+    # Commit, auto CRC
+    cmd = cmd | 0b101
+    # DMODE: read
+    cmd = cmd | (0b10 << 4)
+    # RMODE: short
+    cmd = cmd | (1 << 6)
+    # IDX
+    cmd = cmd | (18 << 24)
+
+    capture = cocotb.start_soon(capture_command(dut))
+    await wbs.send_cycle([WBOp(0x8, 0), WBOp(0xC, cmd)])
+    await capture
+
+    # CMD_DONE of the CMD18 stays set, it holds the CMD12 back
+    cocotb.start_soon(send_short_response(dut, 18, 0x00000900, True))
+    await read_response(dut, wbs)
+
+    data = [(i // 4) & 0xFF for i in range(512)]
+    dma = cocotb.start_soon(dma_engine(dut, wbs, 128))
+    await send_read_block_d4(dut, data)
+    words = await dma
+    assert(words == [i * 0x01010101 for i in range(128)])
+    while True:
+        result = await wbs.send_cycle([WBOp(0x4)])
+        if result[0].datrd.integer & (1 << 20):
+            break
+
+    # CMD13: Commit, auto CRC, RMODE short
+    cmd = 0b101 | (1 << 6) | (13 << 24)
+    capture = cocotb.start_soon(capture_command(dut))
+    await wbs.send_cycle([WBOp(0x8, 0x12340000), WBOp(0x1C, 1 << 18), WBOp(0xC, cmd)])
+    bits = await capture
+    assert(bits[0:8] == [0, 1] + to_bits(13, 6))
+    assert(bits[8:40] == to_bits(0x12340000, 32))
+    assert(bits[40:47] == to_bits(crc7_bits(bits[0:40]), 7))
+
+    cocotb.start_soon(send_short_response(dut, 13, 0x00000900, True))
+    await read_response(dut, wbs)
+
+    capture = cocotb.start_soon(capture_command(dut))
+    await wbs.send_cycle([WBOp(0x1C, 1 << 18)])
+    bits = await capture
+    assert(bits[0:8] == [0, 1] + to_bits(12, 6))
+    assert(bits[40:47] == to_bits(crc7_bits(bits[0:40]), 7))
+
+    cocotb.start_soon(send_short_response(dut, 12, 0x00000900, True))
+    flags = await read_response(dut, wbs)
+    assert((flags & ((1 << 15) | (1 << 14))) == 0)
+
+    # Counter ran down, both FSMs are idle
+    await ClockCycles(dut.clk, 16*8)
+    result = await wbs.send_cycle([WBOp(0x20), WBOp(0x18)])
+    assert(result[0].datrd.integer == (1 << 31))
+    assert((result[1].datrd.integer & (0b11 << 12)) == 0)
+
+# CPU side of FIFO mode: Waits for the watermark or the end of the block, then reads all words.
+# disturb writes DATA and commits a dataless command before the first burst. Neither may take
+# a word out of the FIFO or change its direction.
+async def fifo_drain(dut, wbs, words, disturb = False):
+    received = []
+    while len(received) < words:
+        result = await wbs.send_cycle([WBOp(0x18)])
+        if result[0].datrd.integer & ((1 << 17) | (1 << 20)):
+            result = await wbs.send_cycle([WBOp(0x24)])
+            level = result[0].datrd.integer & 0xFFFF
+            if level != 0:
+                if disturb:
+                    # Commit, DMODE and RMODE none
+                    await wbs.send_cycle([WBOp(0x14, 0xFFFFFFFF), WBOp(0xC, 0b1)])
+                    disturb = False
+                result = await wbs.send_cycle([WBOp(0x14)] * level)
+                received += [r.datrd.integer for r in result]
+    return received
+
+# FIFO mode: The block is received at full SD clock while the CPU drains the FIFO in bursts
+async def test_fifo_read_impl(dut, disturb):
+    wbs = await init_test(dut)
+    await configure_peripheral(dut, wbs, False, True)
+
+    # 16 word FIFO
+    result = await wbs.send_cycle([WBOp(0x0)])
+    assert(((result[0].datrd.integer >> 12) & 0xF) == 4)
+
+    # FIFO mode, watermark 8 words, stop the data FSM after one block
+    result = await wbs.send_cycle([WBOp(0x4)])
+    await wbs.send_cycle([WBOp(0x4, result[0].datrd.integer | 0b100), WBOp(0x24, 8 << 16), WBOp(0x20, 1)])
+    result = await wbs.send_cycle([WBOp(0x24)])
+    assert(result[0].datrd.integer == (8 << 16))
+
+    cmd = 0
+    # Commit, auto CRC
+    cmd = cmd | 0b101
+    # DMODE: read
+    cmd = cmd | (0b10 << 4)
+    # RMODE: short
+    cmd = cmd | (1 << 6)
+    # IDX
+    cmd = cmd | (17 << 24)
+
+    capture = cocotb.start_soon(capture_command(dut))
+    await wbs.send_cycle([WBOp(0x8, 0), WBOp(0xC, cmd)])
+    await capture
+    cocotb.start_soon(send_short_response(dut, 17, 0x00000900, True))
+    await read_response(dut, wbs)
+    await wbs.send_cycle([WBOp(0x1C, 1 << 18)])
+
+    data = [(i // 4) & 0xFF for i in range(512)]
+    drain = cocotb.start_soon(fifo_drain(dut, wbs, 128, disturb))
+    start = get_sim_time("ns")
+    await send_read_block_d4(dut, data)
+    # Start bit, data, CRC and end bit without a single stalled clock, 80 ns per SD clock
+    assert(get_sim_time("ns") - start <= (1 + 1024 + 16 + 1 + 1) * 80)
+
+    words = await drain
+    assert(words == [i * 0x01010101 for i in range(128)])
+
+    # Data FSM stopped by the block counter, nothing left
+    await ClockCycles(dut.clk, 16*8)
+    result = await wbs.send_cycle([WBOp(0x18), WBOp(0x24)])
+    flags = result[0].datrd.integer
+    assert((flags & ((1 << 20) | (1 << 17) | (1 << 14) | (1 << 13))) == (1 << 20))
+    assert((result[1].datrd.integer & 0xFFFF) == 0)
+    assert(dut.flag_data_o.value == 0)
+
+@cocotb.test()
+async def test_fifo_read(dut):
+    await test_fifo_read_impl(dut, False)
+
+@cocotb.test()
+async def test_fifo_read_disturbed(dut):
+    await test_fifo_read_impl(dut, True)
 
 async def write_block_data(dut, wbs, d4Mode):
     # Write data